@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <vector>
+#include "esp_log.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_md5.h"
+#include "sdkconfig.h"
+#include "block_cache.h"
+
+static const char *TAG = "BLOCK_CACHE";
+
+#define BLOCK_MD5_LEN    ESP_ROM_MD5_DIGEST_LEN
+#define BLOCK_NOT_CACHED -1      // fill: chưa có trong RAM
+#define BLOCK_DATA       -2      // fill: dữ liệu nằm ở data
+
+#if CONFIG_SPIRAM
+#define BLOCK_CACHE_CAPS (MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT)
+#else
+#define BLOCK_CACHE_CAPS (MALLOC_CAP_8BIT)
+#endif
+
+typedef struct {
+    uint8_t* data;      // BLOCK_CACHE_BLOCK_SIZE byte khi fill == BLOCK_DATA
+    int16_t  fill;      // 0..255: block toàn giá trị này; BLOCK_NOT_CACHED / BLOCK_DATA
+} cached_block_t;
+
+struct block_cache_image {
+    std::string                 key;
+    uint32_t                    size;
+    uint32_t                    last_used;
+    std::vector<uint8_t>        md5;        // blocks * 16
+    std::vector<cached_block_t> blocks;
+    uint32_t                    hits;       // Lần nạp hiện tại
+    uint32_t                    misses;
+};
+
+static std::vector<block_cache_image_t*> s_images;
+static size_t   s_used = 0;         // Byte RAM đang dùng (bảng MD5 + dữ liệu block)
+static uint32_t s_clock = 0;
+static uint32_t s_total_hits = 0;
+static uint32_t s_total_misses = 0;
+
+static size_t budget()
+{
+    return (size_t) CONFIG_BLOCK_CACHE_KB * 1024;
+}
+
+static void free_image(block_cache_image_t* img)
+{
+    for (cached_block_t& b : img->blocks) {
+        if (b.fill == BLOCK_DATA) {
+            heap_caps_free(b.data);
+            s_used -= BLOCK_CACHE_BLOCK_SIZE;
+        }
+    }
+    s_used -= img->md5.size();
+    delete img;
+}
+
+// Gỡ entry khỏi danh sách và giải phóng
+static void drop_image(size_t index)
+{
+    free_image(s_images[index]);
+    s_images.erase(s_images.begin() + index);
+}
+
+// Bỏ ảnh lâu chưa dùng nhất (trừ keep) cho tới khi còn đủ bytes. Trả về false nếu không thể.
+static bool make_room(size_t bytes, const block_cache_image_t* keep)
+{
+    while (s_used + bytes > budget()) {
+        int oldest = -1;
+        for (size_t i = 0; i < s_images.size(); i++) {
+            if (s_images[i] == keep) continue;
+            if (oldest < 0 || s_images[i]->last_used < s_images[oldest]->last_used) oldest = i;
+        }
+        if (oldest < 0) return false;
+        ESP_LOGI(TAG, "Evicting %s", s_images[oldest]->key.c_str());
+        drop_image(oldest);
+    }
+    return true;
+}
+
+static void block_md5(const uint8_t* buf, uint8_t out[BLOCK_MD5_LEN])
+{
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    esp_rom_md5_update(&ctx, buf, BLOCK_CACHE_BLOCK_SIZE);
+    esp_rom_md5_final(out, &ctx);
+}
+
+// Block chỉ gồm 1 giá trị -> trả về giá trị đó, ngược lại -1
+static int constant_fill(const uint8_t* buf)
+{
+    for (size_t i = 1; i < BLOCK_CACHE_BLOCK_SIZE; i++) {
+        if (buf[i] != buf[0]) return -1;
+    }
+    return buf[0];
+}
+
+void block_cache_put(block_cache_image_t* img, uint32_t block, const uint8_t* buf, size_t len)
+{
+    if (!img || block >= img->blocks.size() || img->blocks[block].fill != BLOCK_NOT_CACHED) return;
+
+    // Đệm 0xFF như trên flash để dạng lưu và MD5 giống nhau với block cuối
+    uint8_t* padded = (uint8_t*) buf;
+    if (len < BLOCK_CACHE_BLOCK_SIZE) {
+        padded = (uint8_t*) malloc(BLOCK_CACHE_BLOCK_SIZE);
+        if (!padded) return;
+        memcpy(padded, buf, len);
+        memset(padded + len, 0xFF, BLOCK_CACHE_BLOCK_SIZE - len);
+    }
+
+    cached_block_t& b = img->blocks[block];
+    int fill = constant_fill(padded);
+    if (fill >= 0) {
+        b.fill = fill;
+    } else if (make_room(BLOCK_CACHE_BLOCK_SIZE, img)) {
+        b.data = (uint8_t*) heap_caps_malloc(BLOCK_CACHE_BLOCK_SIZE, BLOCK_CACHE_CAPS);
+        if (b.data) {
+            memcpy(b.data, padded, BLOCK_CACHE_BLOCK_SIZE);
+            b.fill = BLOCK_DATA;
+            s_used += BLOCK_CACHE_BLOCK_SIZE;
+        }
+    }
+    if (padded != buf) free(padded);
+}
+
+bool block_cache_get(block_cache_image_t* img, uint32_t block, uint8_t* buf, size_t len)
+{
+    if (!img || block >= img->blocks.size()) return false;
+    cached_block_t& b = img->blocks[block];
+    if (b.fill == BLOCK_NOT_CACHED) {
+        img->misses++;
+        return false;
+    }
+
+    if (b.fill == BLOCK_DATA) {
+        memcpy(buf, b.data, BLOCK_CACHE_BLOCK_SIZE);
+    } else {
+        memset(buf, b.fill, BLOCK_CACHE_BLOCK_SIZE);
+    }
+    uint8_t digest[BLOCK_MD5_LEN];
+    block_md5(buf, digest);
+    if (memcmp(digest, &img->md5[block * BLOCK_MD5_LEN], BLOCK_MD5_LEN) != 0) {
+        ESP_LOGW(TAG, "%s block %" PRIu32 " corrupted in RAM, re-reading", img->key.c_str(), block);
+        if (b.fill == BLOCK_DATA) {
+            heap_caps_free(b.data);
+            s_used -= BLOCK_CACHE_BLOCK_SIZE;
+        }
+        b.data = NULL;
+        b.fill = BLOCK_NOT_CACHED;
+        img->misses++;
+        return false;
+    }
+    (void) len;
+    img->hits++;
+    return true;
+}
+
+// Đọc file 1 lượt: MD5 từng block (cho sector_map_diff) + giữ block vào RAM.
+// MD5 cả ảnh phải khớp khóa: block đọc sai từ thẻ không được vào cache (sẽ không bao giờ bị bỏ).
+static bool scan_file(block_cache_image_t* img, sd_raw_file_t& file, uint32_t file_offset)
+{
+    uint8_t* buffer = (uint8_t*) heap_caps_malloc(BLOCK_CACHE_BLOCK_SIZE, MALLOC_CAP_DMA);
+    if (!buffer) return false;
+
+    md5_context_t whole;
+    esp_rom_md5_init(&whole);
+    bool ok = sd_raw_seek(file, file_offset);
+    uint32_t remaining = img->size;
+    for (uint32_t i = 0; ok && i < img->blocks.size(); i++) {
+        size_t want = remaining < BLOCK_CACHE_BLOCK_SIZE ? remaining : BLOCK_CACHE_BLOCK_SIZE;
+        ok = sd_raw_read(file, buffer, want) == want;
+        esp_rom_md5_update(&whole, buffer, want);
+        memset(buffer + want, 0xFF, BLOCK_CACHE_BLOCK_SIZE - want);
+        remaining -= want;
+        block_md5(buffer, &img->md5[i * BLOCK_MD5_LEN]);
+        block_cache_put(img, i, buffer, BLOCK_CACHE_BLOCK_SIZE);
+    }
+    free(buffer);
+    sd_raw_seek(file, file_offset);
+    if (!ok) return false;
+
+    uint8_t digest[BLOCK_MD5_LEN];
+    esp_rom_md5_final(digest, &whole);
+    char hex[BLOCK_MD5_LEN * 2 + 1];
+    for (int i = 0; i < BLOCK_MD5_LEN; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    if (strncasecmp(hex, img->key.c_str(), BLOCK_MD5_LEN * 2) != 0) {
+        ESP_LOGW(TAG, "%s: file MD5 is %s, not caching", img->key.c_str(), hex);
+        return false;
+    }
+    return true;
+}
+
+block_cache_image_t* block_cache_prepare(const std::string& key, sd_raw_file_t& file, uint32_t file_offset,
+                                         uint32_t size, const uint8_t* known_md5)
+{
+    if (budget() == 0 || key.length() != 32 || size == 0) return NULL;
+
+    for (block_cache_image_t* img : s_images) {
+        if (img->key == key && img->size == size) {
+            img->last_used = ++s_clock;
+            img->hits = img->misses = 0;
+            return img;
+        }
+    }
+
+    uint32_t blocks = (size + BLOCK_CACHE_BLOCK_SIZE - 1) / BLOCK_CACHE_BLOCK_SIZE;
+    if (!make_room(blocks * BLOCK_MD5_LEN, NULL)) {
+        ESP_LOGW(TAG, "Block table of %s does not fit in %d KB", key.c_str(), CONFIG_BLOCK_CACHE_KB);
+        return NULL;
+    }
+
+    block_cache_image_t* img = new block_cache_image_t();
+    img->key = key;
+    img->size = size;
+    img->last_used = ++s_clock;
+    img->md5.resize(blocks * BLOCK_MD5_LEN);
+    img->blocks.assign(blocks, cached_block_t{ NULL, BLOCK_NOT_CACHED });
+    img->hits = img->misses = 0;
+    s_used += img->md5.size();
+    s_images.push_back(img);
+
+    if (known_md5) {
+        memcpy(img->md5.data(), known_md5, img->md5.size());
+    } else if (!scan_file(img, file, file_offset)) {
+        ESP_LOGW(TAG, "Cannot prepare %s", key.c_str());
+        drop_image(s_images.size() - 1);
+        return NULL;
+    }
+    return img;
+}
+
+void block_cache_remove(const std::string& key)
+{
+    for (size_t i = 0; i < s_images.size(); i++) {
+        if (s_images[i]->key == key) {
+            ESP_LOGI(TAG, "Removing %s", key.c_str());
+            drop_image(i);
+            return;
+        }
+    }
+}
+
+const uint8_t* block_cache_md5(const block_cache_image_t* img)
+{
+    return img->md5.data();
+}
+
+void block_cache_log_stats(block_cache_image_t* img)
+{
+    if (!img) return;
+    s_total_hits += img->hits;
+    s_total_misses += img->misses;
+    uint32_t total = s_total_hits + s_total_misses;
+    ESP_LOGI(TAG, "%s: %" PRIu32 " block(s) from RAM, %" PRIu32 " from file | hit rate %" PRIu32 "%% | %u / %d KB used",
+             img->key.c_str(), img->hits, img->misses, total ? (s_total_hits * 100) / total : 0,
+             (unsigned) (s_used / 1024), CONFIG_BLOCK_CACHE_KB);
+}
@@ -0,0 +1,59 @@
+#ifndef __BLOCK_CACHE_H__
+#define __BLOCK_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include "esp_err.h"
+#include "../sd_card/sd_raw.h"
+
+/*
+ * Cache trong RAM các block 4KB đã chuẩn bị của ảnh đang nạp (PSRAM nếu có CONFIG_SPIRAM).
+ *
+ * Mỗi ảnh (khóa = MD5 của ảnh) giữ bảng MD5 từng block -> sector_map_diff không phải đọc lại
+ * file, và dữ liệu của càng nhiều block càng tốt trong giới hạn CONFIG_BLOCK_CACHE_KB.
+ * Block chỉ gồm 1 giá trị (vùng 0xFF/0x00) chỉ lưu giá trị đó, không tốn RAM.
+ * Block lấy từ RAM được kiểm tra lại MD5 trước khi gửi. Hết chỗ -> bỏ ảnh lâu chưa dùng nhất.
+ */
+
+#define BLOCK_CACHE_BLOCK_SIZE 4096
+
+typedef struct block_cache_image block_cache_image_t;
+
+/**
+ * @brief Lấy (hoặc tạo) entry của ảnh. Entry mới: dùng known_md5 nếu có (bảng block của pack),
+ * ngược lại đọc file 1 lượt từ file_offset để tính MD5 từng block và giữ block vào RAM.
+ * MD5 cả ảnh đọc được phải khớp khóa, nếu không entry bị bỏ.
+ * @return NULL nếu tắt cache, khóa rỗng, không đủ bộ nhớ, lỗi đọc hoặc file không khớp khóa
+ *         (caller làm như không có cache).
+ */
+block_cache_image_t* block_cache_prepare(const std::string& key, sd_raw_file_t& file, uint32_t file_offset,
+                                         uint32_t size, const uint8_t* known_md5);
+
+/**
+ * @brief Bảng MD5 từng block (16 byte/block, block cuối đệm 0xFF) của ảnh.
+ */
+const uint8_t* block_cache_md5(const block_cache_image_t* image);
+
+/**
+ * @brief Chép block vào buf nếu có trong RAM và đúng MD5.
+ * @param len Số byte của block (nhỏ hơn 4KB với block cuối); buf phải đủ 4KB.
+ * @return false nếu không có, caller đọc từ file rồi gọi block_cache_put.
+ */
+bool block_cache_get(block_cache_image_t* image, uint32_t block, uint8_t* buf, size_t len);
+
+/**
+ * @brief Giữ block vừa đọc từ file (nếu còn chỗ).
+ */
+void block_cache_put(block_cache_image_t* image, uint32_t block, const uint8_t* buf, size_t len);
+
+/**
+ * @brief Bỏ entry của ảnh (nếu có): sau khi nạp ảnh này bị sai MD5, lần sau tính lại từ file.
+ */
+void block_cache_remove(const std::string& key);
+
+/**
+ * @brief In số block lấy từ RAM / từ file của ảnh trong lần nạp vừa rồi và tỉ lệ hit cộng dồn.
+ */
+void block_cache_log_stats(block_cache_image_t* image);
+
+#endif // __BLOCK_CACHE_H__
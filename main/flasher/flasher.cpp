@@ -8,15 +8,59 @@
 #include "esp32_port.h"      // Header "port" của thư viện esp_loader, cung cấp hàm loader_port_esp32_init
 #include "esp_loader.h"      // Header chính của thư viện esp_loader
 #include "FS.h"
-#include "SD.h"
 #include "Arduino.h"
 #include "flasher.h"
+#include "sector_map.h"
+#include "fw_pack.h"
+#include "target_cache.h"
+#include "image_cache.h"
+#include "block_cache.h"
+#include "trace_log.h"
+#include "../sd_card/sd_service.h"
+#include <algorithm>
+#include <vector>
 #include "../oled/menu.h"    // Thêm để dùng hàm oled_show_message
+#include "../oled/progress.h" // Tiến trình khi nạp blocking (không qua task UI)
 #include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_app_desc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
 
 // TAG dùng để lọc log cho module này
 static const char *TAG = "FLASHER";
 
+// Vị trí esp_app_desc_t trong ảnh app: sau image header (24B) + segment header đầu tiên (8B)
+#define APP_DESC_OFFSET     32
+
+// --- PHIÊN NẠP CHẠY NỀN (SESSION) ---
+// Đường dữ liệu: ưu tiên cao hơn UI và storage (bảng task trong main.cpp) -> vẽ OLED không làm chậm nạp.
+// Task chỉ chặn trên UART/thẻ SD nên UI vẫn được chạy giữa các block.
+#define SESSION_TASK_STACK      8192
+#define SESSION_TASK_PRIORITY   5
+#define SESSION_EVENT_QUEUE_LEN 16
+
+#define FLASHER_PROBE_SYNC_MS   50  // Target có mặt trả lời SYNC trong vài ms
+#define SESSION_SD_WAIT_SLICE_MS 100 // Chờ task storage nhả thẻ theo từng lát để vẫn hủy được
+
+#define SESSION_BIT_BUSY    BIT0    // Task nạp đang chạy
+#define SESSION_BIT_CANCEL  BIT1    // UI yêu cầu hủy
+
+static EventGroupHandle_t s_session_bits = NULL;
+static QueueHandle_t      s_event_queue = NULL;
+static std::string        s_session_fw_id;
+static bool               s_session_already_current = false; // Phiên kết thúc sớm vì target đã đúng bản
+static bool               s_flasher_ready = false;   // flasher_init đã cài UART (giữ qua các phiên)
+
+// --- THÔNG TIN TARGET ĐANG KẾT NỐI (cache NVS theo MAC) ---
+static bool                 s_target_identified = false;   // Đã đọc được MAC
+static bool                 s_target_known = false;        // Có entry trong cache từ lần nạp trước
+static uint8_t              s_target_mac[6];
+static target_cache_entry_t s_target_entry;
+
 /**
  * @brief Khởi tạo phần cứng của HOST (ESP32-C3) để giao tiếp với TARGET.
  * * Hàm này cài đặt các chân UART (TX/RX) và các chân điều khiển
@@ -35,74 +79,267 @@ const loader_esp32_config_t config = {
 
 static esp_err_t reset_sequence(const loader_esp32_config_t *config);
 
+// true khi đang chạy trong task nền của flasher_session_start()
+static bool in_session()
+{
+    return s_session_bits != NULL && (xEventGroupGetBits(s_session_bits) & SESSION_BIT_BUSY);
+}
+
+// Gửi sự kiện cho UI. Sự kiện PROGRESS có thể bị bỏ nếu queue đầy (UI chậm),
+// các sự kiện còn lại luôn được giữ.
+static void emit_event(flasher_event_type_t type, const char* segment = NULL,
+                       uint32_t done = 0, uint32_t total = 0, esp_err_t err = ESP_OK)
+{
+    if (!in_session()) return; // Gọi blocking, không ai nghe sự kiện
+    flasher_event_t evt = { type, segment, done, total, err };
+    TickType_t wait = (type == FLASHER_EVT_PROGRESS) ? 0 : pdMS_TO_TICKS(1000);
+    xQueueSend(s_event_queue, &evt, wait);
+}
+
+static bool cancel_requested()
+{
+    return in_session() && (xEventGroupGetBits(s_session_bits) & SESSION_BIT_CANCEL);
+}
+
+// So esp_app_desc_t của app trên target với ảnh trên SD (project name, version, ELF SHA-256).
+// Chỉ đọc ~256 byte từ target nên mất chưa tới 1 giây.
+static bool app_desc_equal(const esp_app_desc_t& sd_desc, uint32_t app_offset)
+{
+    esp_app_desc_t target_desc;
+
+    if (sd_desc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        ESP_LOGW(TAG, "SD image has no app descriptor, cannot quick-probe.");
+        return false;
+    }
+
+    if (esp_loader_flash_read((uint8_t*) &target_desc, app_offset + APP_DESC_OFFSET, sizeof(target_desc)) != ESP_LOADER_SUCCESS ||
+        target_desc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "Target app: %.32s %.32s | SD app: %.32s %.32s",
+             target_desc.project_name, target_desc.version, sd_desc.project_name, sd_desc.version);
+    return strncmp(sd_desc.project_name, target_desc.project_name, sizeof(sd_desc.project_name)) == 0 &&
+           strncmp(sd_desc.version, target_desc.version, sizeof(sd_desc.version)) == 0 &&
+           memcmp(sd_desc.app_elf_sha256, target_desc.app_elf_sha256, sizeof(sd_desc.app_elf_sha256)) == 0;
+}
+
+static bool app_desc_matches(const std::string& app_path, uint32_t app_offset)
+{
+    esp_app_desc_t sd_desc = {};
+
+    File appFile = g_sd_fs.open(app_path.c_str(), FILE_READ);
+    if (!appFile) return false;
+    bool ok = appFile.seek(APP_DESC_OFFSET) &&
+              appFile.read((uint8_t*) &sd_desc, sizeof(sd_desc)) == sizeof(sd_desc);
+    appFile.close();
+    return ok && app_desc_equal(sd_desc, app_offset);
+}
+
+// 1 lệnh MD5 cho 1 segment (nếu index.txt có MD5)
+static bool segment_md5_matches(const std::string& file_path, uint32_t offset, const std::string& md5)
+{
+    if (md5.length() != 32) return true; // Không có MD5 -> chỉ dựa vào app descriptor
+
+    // Target đã ghi nhận đúng nội dung này -> lấy size từ cache, không mở file trên SD
+    size_t size = s_target_identified ? target_cache_segment_size(s_target_entry, offset, md5) : 0;
+    if (size == 0) {
+        File f = g_sd_fs.open(file_path.c_str(), FILE_READ);
+        if (!f) return false;
+        size = f.size();
+        f.close();
+    }
+    return esp_loader_flash_verify_known_md5(offset, size, (const uint8_t*) md5.c_str()) == ESP_LOADER_SUCCESS;
+}
+
+// Đọc MAC của target vừa connect và nạp entry tương ứng từ cache NVS.
+// Target lạ (hoặc chip không khớp) -> tạo entry mới. Flash size không lưu: esp_loader tự dò
+// 1 lần mỗi lần connect và không có API nhận size từ ngoài.
+static void identify_target()
+{
+    s_target_identified = (esp_loader_read_mac(s_target_mac) == ESP_LOADER_SUCCESS);
+    if (!s_target_identified) {
+        ESP_LOGW(TAG, "Cannot read target MAC, cache disabled for this unit.");
+        return;
+    }
+
+    uint8_t chip = (uint8_t) esp_loader_get_target();
+    if (target_cache_load(s_target_mac, s_target_entry) == ESP_OK && s_target_entry.chip == chip) {
+        s_target_known = true;
+        return;
+    }
+
+    memset(&s_target_entry, 0, sizeof(s_target_entry));
+    s_target_entry.version = TARGET_CACHE_VERSION;
+    s_target_entry.chip = chip;
+    ESP_LOGI(TAG, "New target %02x:%02x:%02x:%02x:%02x:%02x (chip=%u)",
+             s_target_mac[0], s_target_mac[1], s_target_mac[2], s_target_mac[3], s_target_mac[4], s_target_mac[5],
+             chip);
+}
+
 esp_err_t flasher_init() {
+   // Host không còn khởi động lại sau mỗi unit: UART driver, cache... chỉ cài 1 lần
+   if (s_flasher_ready) {
+      return ESP_OK;
+   }
+
+   // Cache target không bắt buộc: lỗi NVS chỉ làm mất tối ưu, không chặn việc nạp
+   target_cache_init();
+   image_cache_init();
+   trace_log_init(); // Không có buffer trace: vòng lặp nạp vẫn chạy, chỉ mất log từng block
+
    ESP_LOGI(TAG, "Initializing UART connection for flasher...");
    if (loader_port_esp32_init(&config) != ESP_LOADER_SUCCESS) {
       ESP_LOGE(TAG, "serial initialization failed.");
       return ESP_FAIL;
    }
 
+   s_flasher_ready = true;
    ESP_LOGI(TAG, "UART connection initialized at baud rate 115200");
    return ESP_OK;
 }
 
-esp_err_t flasher_write_segment(const std::string& file_path, uint32_t offset, const std::string& md5)
+// Target vừa reset luôn nói ở baud gốc: phiên trước có thể đã boost UART của Host lên 921600,
+// và dữ liệu target cũ gửi ra (log lúc boot app) vẫn nằm trong buffer RX.
+static void reset_link()
 {
-    ESP_LOGI(TAG, "==== Writing segment ====");
-    ESP_LOGI(TAG, "File: %s | Offset: 0x%08" PRIx32, file_path.c_str(), offset);
+   uart_set_baudrate(config.uart_port, config.baud_rate);
+   uart_flush_input(config.uart_port);
+}
 
-    // --- MỞ FILE ---
-    File fwFile = SD.open(file_path.c_str(), FILE_READ);
-    if (!fwFile) {
-        ESP_LOGE(TAG, "Failed to open file: %s", file_path.c_str());
-        return ESP_ERR_NOT_FOUND;
+/*
+ * Ghi 1 ảnh nằm ở [file_offset, file_offset + total_size) của file đang mở vào địa chỉ offset.
+ * block_md5: MD5 từng block 4KB đã biết trước (bảng block của pack), NULL -> tự tính từ file.
+ * Không đóng file: caller (file .bin riêng hoặc pack) tự quản lý.
+ */
+static esp_err_t write_image(sd_raw_file_t& fwFile, uint32_t file_offset, size_t total_size, uint32_t offset,
+                             const std::string& md5, const char* segment, const char* label,
+                             const uint8_t* block_md5)
+{
+    // --- TARGET ĐÃ BIẾT: CACHE NÓI ẢNH NÀY ĐÃ CÓ -> XÁC NHẬN BẰNG 1 LỆNH MD5 ---
+    bool whole_checked = false;
+    if (s_target_identified && target_cache_has_segment(s_target_entry, offset, total_size, md5)) {
+        whole_checked = true;
+        if (esp_loader_flash_verify_known_md5(offset, total_size, (const uint8_t*) md5.c_str()) == ESP_LOADER_SUCCESS) {
+            ESP_LOGI(TAG, "Segment at 0x%08" PRIx32 " already current, skipped.", offset);
+            emit_event(FLASHER_EVT_SEGMENT_START, segment, total_size, total_size);
+            emit_event(FLASHER_EVT_VERIFIED, segment, total_size, total_size);
+            return ESP_OK;
+        }
+        ESP_LOGI(TAG, "Cached segment at 0x%08" PRIx32 " no longer matches.", offset);
     }
 
-    size_t total_size = fwFile.size();
-    if (total_size == 0) {
-        ESP_LOGE(TAG, "File is empty: %s", file_path.c_str());
-        fwFile.close();
-        return ESP_FAIL;
+    // --- CACHE RAM: MD5 TỪNG BLOCK + DỮ LIỆU BLOCK CỦA ẢNH NÀY (đọc file 1 lượt ở lần đầu) ---
+    static_assert(BUFFER_SIZE == BLOCK_CACHE_BLOCK_SIZE && BUFFER_SIZE == SECTOR_MAP_SECTOR_SIZE,
+                  "write loop reads exactly one cached block per iteration");
+    block_cache_image_t* cached = block_cache_prepare(md5, fwFile, file_offset, total_size, block_md5);
+    if (cached) block_md5 = block_cache_md5(cached);
+
+    // --- SO SÁNH VỚI FLASH CỦA TARGET: CHỈ GHI LẠI CÁC SECTOR KHÁC ---
+    // Target chưa từng nạp (không có entry trong cache): flash gần như chắc chắn khác -> không tốn lệnh so sánh
+    std::vector<bool> changed;
+    if (!s_target_known) {
+        ESP_LOGI(TAG, "Unknown target, writing whole segment.");
+        changed.assign((total_size + SECTOR_MAP_SECTOR_SIZE - 1) / SECTOR_MAP_SECTOR_SIZE, true);
+    } else if (sector_map_diff(fwFile, file_offset, total_size, offset, block_md5,
+                               (whole_checked || md5.length() != 32) ? NULL : md5.c_str(), changed) != ESP_OK) {
+        ESP_LOGW(TAG, "Sector diff unavailable, writing whole segment.");
+        changed.assign((total_size + SECTOR_MAP_SECTOR_SIZE - 1) / SECTOR_MAP_SECTOR_SIZE, true);
     }
-
-    ESP_LOGI(TAG, "Segment size: %zu bytes", total_size);
-
-    // --- BẮT ĐẦU GHI FLASH ---
-    esp_loader_error_t err = esp_loader_flash_start(offset, total_size, BUFFER_SIZE);
-    if (err != ESP_LOADER_SUCCESS) {
-        ESP_LOGE(TAG, "Failed to start flash for segment. err=%d", err);
-        fwFile.close();
-        return ESP_FAIL;
+    size_t bytes_to_write = 0;
+    for (size_t i = 0; i < changed.size(); i++) {
+        if (changed[i]) bytes_to_write += std::min<size_t>(SECTOR_MAP_SECTOR_SIZE, total_size - i * SECTOR_MAP_SECTOR_SIZE);
     }
 
-    uint8_t* buffer = (uint8_t*) malloc(BUFFER_SIZE);
+    // Buffer DMA (căn 4 byte): driver sdspi đọc thẳng vào, không qua bounce từng block
+    uint8_t* buffer = (uint8_t*) heap_caps_malloc(BUFFER_SIZE, MALLOC_CAP_DMA);
     if (!buffer) {
         ESP_LOGE(TAG, "Failed to allocate buffer!");
-        fwFile.close();
         return ESP_ERR_NO_MEM;
     }
 
+    esp_loader_error_t err = ESP_LOADER_SUCCESS;
     size_t bytes_written = 0;
-    size_t bytes_read = 0;
+    emit_event(FLASHER_EVT_SEGMENT_START, segment, 0, bytes_to_write);
+
+    // --- GHI TỪNG DẢI SECTOR LIÊN TIẾP CẦN CẬP NHẬT ---
+    size_t run = 0;
+    while (run < changed.size()) {
+        if (!changed[run]) {
+            run++;
+            continue;
+        }
+        size_t run_end = run;
+        while (run_end < changed.size() && changed[run_end]) run_end++;
+
+        uint32_t run_start = run * SECTOR_MAP_SECTOR_SIZE;
+        uint32_t run_len = std::min<size_t>(run_end * SECTOR_MAP_SECTOR_SIZE, total_size) - run_start;
+        run = run_end;
 
-    while ((bytes_read = fwFile.read(buffer, BUFFER_SIZE)) > 0) {
-        err = esp_loader_flash_write(buffer, bytes_read);
+        err = esp_loader_flash_start(offset + run_start, run_len, BUFFER_SIZE);
         if (err != ESP_LOADER_SUCCESS) {
-            ESP_LOGE(TAG, "Write error at offset %zu (err=%d)", bytes_written, err);
+            ESP_LOGE(TAG, "Failed to start flash for segment. err=%d", err);
             free(buffer);
-            fwFile.close();
             return ESP_FAIL;
         }
-
-        bytes_written += bytes_read;
-        ESP_LOGI(TAG, "Progress: %" PRIu32 "%%", (uint32_t)((bytes_written * 100) / total_size));
-        oled_show_message(file_path.c_str(), (String("Progress: ") + String((bytes_written * 100) / total_size) + String("%")).c_str());
+        uint32_t image_pos = run_start;
+
+        while (run_len > 0) {
+            // Chỉ hủy ở ranh giới block để target không nhận nửa gói
+            if (cancel_requested()) {
+                ESP_LOGW(TAG, "Cancelled at offset %zu", bytes_written);
+                free(buffer);
+                return ESP_ERR_FLASHER_CANCELLED;
+            }
+
+            // Block có trong RAM -> không đọc file; ngược lại đọc file (nhảy tới nếu block trước lấy từ RAM)
+            size_t want = std::min<uint32_t>(BUFFER_SIZE, run_len);
+            uint32_t block = image_pos / BUFFER_SIZE;
+            uint32_t block_addr = offset + image_pos;
+            size_t bytes_read = want;
+            if (!block_cache_get(cached, block, buffer, want)) {
+                int64_t read_start = esp_timer_get_time();
+                if (fwFile.position != file_offset + image_pos) sd_raw_seek(fwFile, file_offset + image_pos);
+                bytes_read = sd_raw_read(fwFile, buffer, want);
+                if (bytes_read == want) block_cache_put(cached, block, buffer, want);
+                trace_log(TRACE_BLOCK_SD_READ, block_addr, bytes_read, (uint32_t) (esp_timer_get_time() - read_start));
+            } else {
+                trace_log(TRACE_BLOCK_RAM_HIT, block_addr, bytes_read);
+            }
+            if (bytes_read == 0) {
+                ESP_LOGE(TAG, "Unexpected end of file at offset %zu", bytes_written);
+                free(buffer);
+                return ESP_FAIL;
+            }
+
+            int64_t write_start = esp_timer_get_time();
+            err = esp_loader_flash_write(buffer, bytes_read);
+            uint32_t write_us = (uint32_t) (esp_timer_get_time() - write_start);
+            if (err != ESP_LOADER_SUCCESS) {
+                ESP_LOGE(TAG, "Write error at offset %zu (err=%d)", bytes_written, err);
+                free(buffer);
+                return ESP_FAIL;
+            }
+
+            run_len -= bytes_read;
+            image_pos += bytes_read;
+            bytes_written += bytes_read;
+            // Không ESP_LOGI từng block: ~4 ms/dòng trên console 115200 baud, ngay trên đường nạp
+            trace_log(TRACE_BLOCK_WRITTEN, block_addr, write_us, (uint32_t) ((bytes_written * 100) / bytes_to_write));
+            if (in_session()) {
+                emit_event(FLASHER_EVT_PROGRESS, segment, bytes_written, bytes_to_write);
+            } else {
+                oled_progress_update(label, bytes_written, bytes_to_write); // Tự giới hạn ~10 Hz, chỉ gửi page đổi
+            }
+        }
     }
 
     free(buffer);
-    fwFile.close();
+    block_cache_log_stats(cached);
+    trace_log_dump(); // CONFIG_TRACE_LOG_SD_DUMP: ghi record của segment ra thẻ giữa 2 segment
 
-    ESP_LOGI(TAG, "Segment written %zu / %zu bytes OK", bytes_written, total_size);
+    ESP_LOGI(TAG, "Segment written %zu / %zu bytes OK (%zu unchanged)", bytes_written, total_size,
+             total_size - bytes_to_write);
 
     // --- KIỂM TRA MD5 (NẾU CÓ) ---
     if (md5.length() == 32) {
@@ -113,34 +350,205 @@ esp_err_t flasher_write_segment(const std::string& file_path, uint32_t offset, c
         err = esp_loader_flash_verify_known_md5(offset, total_size, (const uint8_t*) md5_ascii);
         if (err != ESP_LOADER_SUCCESS) {
             ESP_LOGE(TAG, "MD5 check failed for segment!");
-            return ESP_FAIL;
+            return ESP_ERR_INVALID_CRC;
         }
 
         ESP_LOGI(TAG, "MD5 verified OK for segment!");
+        emit_event(FLASHER_EVT_VERIFIED, segment, total_size, total_size);
     } else {
         ESP_LOGW(TAG, "No valid MD5 provided, skipping verification.");
     }
 
+    // Chỉ ghi nhận nội dung khi đã xác thực MD5 (md5 rỗng -> xóa slot)
+    if (s_target_identified) {
+        target_cache_set_segment(s_target_entry, offset, total_size, md5);
+    }
+
     ESP_LOGI(TAG, "Segment at 0x%08" PRIx32 " written successfully.", offset);
     return ESP_OK;
 }
 
+esp_err_t flasher_write_segment(const std::string& file_path, uint32_t offset, const std::string& md5,
+                                const char* segment)
+{
+    ESP_LOGI(TAG, "==== Writing segment ====");
+    ESP_LOGI(TAG, "File: %s | Offset: 0x%08" PRIx32, file_path.c_str(), offset);
+
+    // --- MỞ FILE: bản trong cache nội (cùng MD5) nếu có, ngược lại bản trên SD ---
+    sd_raw_file_t fwFile;
+    bool from_cache = image_cache_open(md5, fwFile) == ESP_OK;
+    if (!from_cache && sd_raw_open(file_path.c_str(), fwFile) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open file: %s", file_path.c_str());
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t total_size = fwFile.size;
+    if (total_size == 0) {
+        ESP_LOGE(TAG, "File is empty: %s", file_path.c_str());
+        sd_raw_close(fwFile);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Segment size: %zu bytes", total_size);
+    sd_raw_start_readahead(fwFile);  // Đọc trước trong lúc chờ UART
+
+    esp_err_t ret = write_image(fwFile, 0, total_size, offset, md5, segment, file_path.c_str(), NULL);
+    sd_raw_close(fwFile);
+    if (ret == ESP_ERR_INVALID_CRC) {
+        // Bảng block / bản trong cache nội có thể hỏng: xóa để lần sau đọc lại từ SD
+        block_cache_remove(md5);
+        if (from_cache) image_cache_remove(md5);
+    }
+    return ret;
+}
+
+// Bản nạp dạng 3 file .bin riêng (index.txt: path_bootloader / path_partition / path)
+static esp_err_t flash_files(const firmware_metadata_t& metadata)
+{
+    // --- KIỂM TRA NHANH - TARGET ĐÃ CHẠY ĐÚNG BẢN NÀY CHƯA? ---
+    // Descriptor khớp chỉ là "có thể đã đúng": phiên bị hủy/lỗi sau block 0 để lại descriptor mới
+    // trên app chưa ghi xong. Phải xác nhận bằng MD5 cả app; không có MD5 thì luôn nạp lại.
+    if (app_desc_matches(metadata.path, 0x10000) && metadata.md5.length() == 32 &&
+        segment_md5_matches(metadata.path, 0x10000, metadata.md5) &&
+        segment_md5_matches(metadata.path_bootloader, 0x1000, metadata.md5_bootloader) &&
+        segment_md5_matches(metadata.path_partition, 0x8000, metadata.md5_partition)) {
+        s_session_already_current = true;
+        return ESP_OK;
+    }
+
+    // --- GHI TỪNG PHÂN VÙNG ---
+    // Tùy firmware, ông đổi file_path + offset cho đúng
+    esp_err_t ret = flasher_write_segment(metadata.path_bootloader,0x1000, metadata.md5_bootloader, "bootloader");
+    if (ret != ESP_OK) return ret;
+
+    ret = flasher_write_segment(metadata.path_partition, 0x8000,metadata.md5_partition, "partition");
+    if (ret != ESP_OK) return ret;
+
+    return flasher_write_segment(metadata.path, 0x10000, metadata.md5, "app");
+}
+
+// Tên segment của pack đang nạp: sự kiện giữ con trỏ tới đây sau khi pack đã đóng
+static char s_pack_names[FW_PACK_MAX_SEGMENTS][FW_PACK_NAME_LEN + 1];
+
+// Mở pack: bản trong cache nội nếu MD5 header trùng bản trên SD, ngược lại bản trên SD.
+// pack_key: vào = khóa đã biết (metadata lấy từ cache nội khi không đọc được thẻ) hoặc "",
+// ra = MD5 header của pack đã mở.
+static esp_err_t open_pack(const std::string& pack_path, std::string& pack_key, fw_pack_t& pack, bool& from_cache)
+{
+    from_cache = false;
+    if (pack_key.empty()) {
+        esp_err_t ret = fw_pack_open(pack_path.c_str(), pack);
+        if (ret != ESP_OK) return ret;
+        pack_key = image_cache_key(pack.header.header_md5);
+        if (!image_cache_contains(pack_key)) return ESP_OK;
+        fw_pack_close(pack);
+    }
+    if (image_cache_open(pack_key, pack.file) == ESP_OK) {
+        if (fw_pack_load(pack, pack_key.c_str()) == ESP_OK && image_cache_key(pack.header.header_md5) == pack_key) {
+            from_cache = true;
+            return ESP_OK;
+        }
+        fw_pack_close(pack);
+        image_cache_remove(pack_key);
+    }
+    return fw_pack_open(pack_path.c_str(), pack);
+}
+
+// Bản nạp dạng pack (index.txt: "pack"): mọi segment trong 1 file, đọc tuần tự 1 lượt
+static esp_err_t flash_pack(const std::string& pack_path, std::string& pack_key)
+{
+    fw_pack_t pack;
+    bool from_cache = false;
+    esp_err_t ret = open_pack(pack_path, pack_key, pack, from_cache);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot use firmware pack: %s", pack_path.c_str());
+        return ret;
+    }
+
+    // --- KIỂM TRA NHANH: app descriptor, rồi 1 lệnh MD5 cho mỗi segment (kể cả app) ---
+    bool current = false;
+    for (const fw_pack_segment_t& seg : pack.segments) {
+        if (!(seg.flags & FW_PACK_SEG_APP)) continue;
+        esp_app_desc_t sd_desc = {};
+        current = sd_raw_seek(pack.file, seg.file_offset + APP_DESC_OFFSET) &&
+                  sd_raw_read(pack.file, (uint8_t*) &sd_desc, sizeof(sd_desc)) == sizeof(sd_desc) &&
+                  app_desc_equal(sd_desc, seg.address);
+        break;
+    }
+    // Descriptor khớp mà app ghi dở (phiên trước bị hủy) vẫn bị MD5 của segment app bắt lại
+    for (size_t i = 0; current && i < pack.segments.size(); i++) {
+        const fw_pack_segment_t& seg = pack.segments[i];
+        current = esp_loader_flash_verify_known_md5(seg.address, seg.raw_size,
+                                                    (const uint8_t*) fw_pack_md5_hex(seg).c_str()) == ESP_LOADER_SUCCESS;
+    }
+    if (current) {
+        s_session_already_current = true;
+        fw_pack_close(pack);
+        return ESP_OK;
+    }
+
+    // --- GHI MỌI SEGMENT THEO THỨ TỰ TRONG FILE (= thứ tự địa chỉ) ---
+    // MD5 từng block đã có trong pack -> sector_map_diff không đọc lại thẻ SD,
+    // dữ liệu chỉ được đọc 1 lần, từ đầu đến cuối.
+    sd_raw_seek(pack.file, pack.segments[0].file_offset);
+    sd_raw_start_readahead(pack.file);
+    for (size_t i = 0; i < pack.segments.size(); i++) {
+        const fw_pack_segment_t& seg = pack.segments[i];
+        snprintf(s_pack_names[i], sizeof(s_pack_names[i]), "%.*s", FW_PACK_NAME_LEN, seg.name);
+        ESP_LOGI(TAG, "==== Writing %s @0x%08" PRIx32 " (%" PRIu32 " bytes) ====", s_pack_names[i], seg.address,
+                 seg.raw_size);
+
+        ret = write_image(pack.file, seg.file_offset, seg.raw_size, seg.address, fw_pack_md5_hex(seg),
+                          s_pack_names[i], pack_path.c_str(), fw_pack_block_md5(pack, seg));
+        if (ret == ESP_ERR_INVALID_CRC) block_cache_remove(fw_pack_md5_hex(seg));
+        if (ret != ESP_OK) break;
+    }
+
+    fw_pack_close(pack);
+    if (from_cache && ret == ESP_ERR_INVALID_CRC) {
+        image_cache_remove(pack_key);
+    }
+    return ret;
+}
+
+// Chép các ảnh vừa nạp thành công vào cache nội (ảnh đã có chỉ được đánh dấu vừa dùng)
+static void cache_images(const std::string& fw_id, const firmware_metadata_t& metadata, const std::string& pack_key)
+{
+    if (!image_cache_ready()) return;
+    emit_event(FLASHER_EVT_CACHING);
+    if (metadata.path_pack.empty()) {
+        image_cache_store(metadata.path_bootloader, metadata.md5_bootloader, true, metadata.sha256_bootloader);
+        image_cache_store(metadata.path_partition, metadata.md5_partition, true, metadata.sha256_partition);
+        image_cache_store(metadata.path, metadata.md5, true, metadata.sha256);
+    } else {
+        image_cache_store(metadata.path_pack, pack_key, false, "");
+    }
+    image_cache_put_metadata(fw_id, metadata, pack_key);
+}
 
 esp_err_t flasher_begin_session(const std::string& fw_id)
 {
     firmware_metadata_t metadata;
+    std::string pack_key;   // MD5 header của pack (khóa cache nội)
 
-    // --- BƯỚC 1: LẤY THÔNG TIN FILE TỪ SD CARD ---
+    // --- BƯỚC 1: LẤY THÔNG TIN FILE TỪ SD CARD (thẻ lỗi/bị rút -> bản đã lưu trong cache nội) ---
     esp_err_t ret = sd_get_firmware_path(fw_id, metadata);
     if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to get firmware metadata for fw_id: %s", fw_id.c_str());
-        return ret;
+        if (image_cache_get_metadata(fw_id, metadata, pack_key) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to get firmware metadata for fw_id: %s", fw_id.c_str());
+            return ret;
+        }
+        ESP_LOGW(TAG, "SD metadata unavailable, using cached metadata for %s", fw_id.c_str());
     }
 
     // Thực hiện chuỗi reset để target vào bootloader cái này khá quan trọng
     // --- BƯỚC 2: HANDSHAKE ---
     esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
     // connect_config.sync_timeout = 2000;
+    emit_event(FLASHER_EVT_CONNECTING);
+    s_target_identified = false;
+    s_target_known = false;
+    reset_link();
     reset_sequence(&config); 
 
     if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS) {
@@ -148,6 +556,8 @@ esp_err_t flasher_begin_session(const std::string& fw_id)
         return ESP_FAIL;
     }
     ESP_LOGI(TAG, "Connected to target device.");
+    emit_event(FLASHER_EVT_CONNECTED);
+    sector_map_reset_caps(); // Target mới -> dò lại lệnh sector map
     
     // --- BƯỚC 3: BOOST BAUDRATE ---
     uint32_t new_baud = 921600;
@@ -159,26 +569,33 @@ esp_err_t flasher_begin_session(const std::string& fw_id)
         ESP_LOGW(TAG, "Baudrate boost failed, continue at 115200");
     }
 
+    identify_target();
 
-    // --- BƯỚC 4: GHI TỪNG PHÂN VÙNG ---
-    // Tùy firmware, ông đổi file_path + offset cho đúng
-    ret = flasher_write_segment(metadata.path_bootloader,0x1000, metadata.md5_bootloader);
+    // --- BƯỚC 4 + 5: KIỂM TRA NHANH, RỒI GHI TỪNG PHÂN VÙNG ---
+    s_session_already_current = false;
+    ret = metadata.path_pack.empty() ? flash_files(metadata) : flash_pack(metadata.path_pack, pack_key);
     if (ret != ESP_OK) return ret;
 
-    ret = flasher_write_segment(metadata.path_partition, 0x8000,metadata.md5_partition);
-    if (ret != ESP_OK) return ret;
+    if (s_session_already_current) {
+        ESP_LOGI(TAG, "Target already current, skipping transfer.");
+        esp_loader_reset_target();
+        return ESP_OK;
+    }
 
-    ret = flasher_write_segment(metadata.path, 0x10000, metadata.md5);
-    if (ret != ESP_OK) return ret;
+    if (s_target_identified) {
+        target_cache_store(s_target_mac, s_target_entry);
+    }
 
-    // --- BƯỚC 5: RESET TARGET ---
+    // --- BƯỚC 6: RESET TARGET ---
     esp_loader_reset_target();
     ESP_LOGI(TAG, "Resetting target to run app...");
     vTaskDelay(pdMS_TO_TICKS(200));
 
     ESP_LOGI(TAG, "Target restarted in normal mode.");
     ESP_LOGI(TAG, "Full firmware update completed successfully!");
-    sd_unmount(); // Giải phóng thẻ SD sau khi nạp xong
+
+    // --- BƯỚC 7: GIỮ BẢN SAO TRONG FLASH NỘI CHO CÁC LẦN NẠP SAU ---
+    cache_images(fw_id, metadata, pack_key);
 
     return ESP_OK;
 }
@@ -219,15 +636,26 @@ esp_err_t flasher_chip_erase() {
 
     // 1. Handshake với Target
     esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    emit_event(FLASHER_EVT_CONNECTING);
+    s_target_identified = false;
+    s_target_known = false;
+    reset_link();
     reset_sequence(&config); // Gọi lại sequence reset để vào bootloader
     
     if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS) {
         ESP_LOGE(TAG, "Failed to connect to target for erase.");
-        oled_show_message("Erasing Chip", "failed to connect.");
+        if (!in_session()) oled_show_message("Erasing Chip", "failed to connect.");
         return ESP_FAIL;
     }
     ESP_LOGI(TAG, "Connected. Erasing chip (please wait)...");
-    oled_show_message("Erasing Chip", "connected.");
+    emit_event(FLASHER_EVT_CONNECTED);
+    if (!in_session()) oled_show_message("Erasing Chip", "connected.");
+
+    // Lệnh xóa chip là 1 lệnh duy nhất -> chỉ hủy được TRƯỚC khi gửi
+    if (cancel_requested()) {
+        return ESP_ERR_FLASHER_CANCELLED;
+    }
+    emit_event(FLASHER_EVT_ERASING);
 
     // 2. Gọi lệnh xóa toàn bộ (Hàm này sẽ BLOCK cho đến khi xóa xong)
     esp_loader_error_t err = esp_loader_flash_erase();
@@ -237,6 +665,13 @@ esp_err_t flasher_chip_erase() {
     }
 
     ESP_LOGI(TAG, "Chip erase completed successfully!");
+
+    // Flash trống -> quên mọi nội dung đã ghi nhận của target này
+    identify_target();
+    if (s_target_identified) {
+        memset(s_target_entry.segments, 0, sizeof(s_target_entry.segments));
+        target_cache_store(s_target_mac, s_target_entry);
+    }
     
     // 3. Reset target lại cho chắc
     esp_loader_reset_target();
@@ -244,6 +679,115 @@ esp_err_t flasher_chip_erase() {
     return ESP_OK;
 }
 
+// Task nền: chạy 1 phiên nạp/xóa rồi tự hủy
+static void session_task(void* arg)
+{
+    bool erase = s_session_fw_id.empty() || s_session_fw_id == "NULL";
+    esp_err_t ret = ESP_OK;
+
+    // Chờ task storage xong lần mount/dựng catalog đang dở (có thể vài giây) ở đây, không phải trên task UI
+    while (!sd_service_wait_paused(SESSION_SD_WAIT_SLICE_MS)) {
+        if (cancel_requested()) {
+            ret = ESP_ERR_FLASHER_CANCELLED;
+            break;
+        }
+    }
+    if (ret == ESP_OK) {
+        ret = erase ? flasher_chip_erase() : flasher_begin_session(s_session_fw_id);
+    }
+
+    if (ret == ESP_ERR_FLASHER_CANCELLED) {
+        // Reset sạch: GPIO0 đã ở mức HIGH sau reset_sequence -> target boot bình thường
+        esp_loader_reset_target();
+        ESP_LOGW(TAG, "Session cancelled, target reset.");
+        emit_event(FLASHER_EVT_CANCELLED);
+    } else if (ret != ESP_OK) {
+        emit_event(FLASHER_EVT_FAILED, NULL, 0, 0, ret);
+    } else if (!erase && s_session_already_current) {
+        emit_event(FLASHER_EVT_ALREADY_CURRENT);
+    } else {
+        emit_event(FLASHER_EVT_DONE);
+    }
+
+    ESP_LOGD(TAG, "Stack high-water mark: %u bytes", (unsigned) uxTaskGetStackHighWaterMark(NULL));
+    trace_log_dump();
+    xEventGroupClearBits(s_session_bits, SESSION_BIT_BUSY | SESSION_BIT_CANCEL);
+    sd_service_pause(false); // Trả thẻ lại cho task storage (hot-plug)
+    vTaskDelete(NULL);
+}
+
+esp_err_t flasher_session_start(const std::string& fw_id)
+{
+    if (s_session_bits == NULL) {
+        s_session_bits = xEventGroupCreate();
+        s_event_queue = xQueueCreate(SESSION_EVENT_QUEUE_LEN, sizeof(flasher_event_t));
+        if (s_session_bits == NULL || s_event_queue == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate session resources!");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    if (flasher_session_busy()) {
+        ESP_LOGW(TAG, "A session is already running.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Giữ thẻ cho tới hết phiên; task nạp chờ lần mount/dựng catalog đang dở xong trước khi đọc thẻ
+    sd_service_pause(true);
+
+    s_session_fw_id = fw_id;
+    xQueueReset(s_event_queue);
+    xEventGroupClearBits(s_session_bits, SESSION_BIT_CANCEL);
+    xEventGroupSetBits(s_session_bits, SESSION_BIT_BUSY);
+
+    if (xTaskCreate(session_task, "flasher", SESSION_TASK_STACK, NULL, SESSION_TASK_PRIORITY, NULL) != pdPASS) {
+        xEventGroupClearBits(s_session_bits, SESSION_BIT_BUSY);
+        sd_service_pause(false);
+        ESP_LOGE(TAG, "Failed to create flasher task!");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool flasher_session_poll(flasher_event_t* out_event)
+{
+    if (s_event_queue == NULL) return false;
+    return xQueueReceive(s_event_queue, out_event, 0) == pdTRUE;
+}
+
+void flasher_session_cancel(void)
+{
+    if (flasher_session_busy()) {
+        ESP_LOGW(TAG, "Cancel requested.");
+        xEventGroupSetBits(s_session_bits, SESSION_BIT_CANCEL);
+    }
+}
+
+bool flasher_session_busy(void)
+{
+    return in_session();
+}
+
+esp_err_t flasher_probe_target(void)
+{
+    if (!s_flasher_ready || flasher_session_busy()) return ESP_ERR_INVALID_STATE;
+
+    // 1 lần reset vào bootloader + 1 lệnh SYNC (không lặp 10 lần như lúc nạp)
+    esp_loader_connect_args_t probe = { .sync_timeout = FLASHER_PROBE_SYNC_MS, .trials = 1 };
+    reset_link();
+    esp_err_t ret = esp_loader_connect(&probe) == ESP_LOADER_SUCCESS ? ESP_OK : ESP_ERR_NOT_FOUND;
+    uart_flush_input(config.uart_port);
+    return ret;
+}
+
+bool flasher_rx_activity(void)
+{
+    if (!s_flasher_ready || flasher_session_busy()) return false;
+    size_t len = 0;
+    if (uart_get_buffered_data_len(config.uart_port, &len) != ESP_OK || len == 0) return false;
+    uart_flush_input(config.uart_port);
+    return true;
+}
+
 /**
  * @brief Hiển thị thông báo và khởi động lại ESP32 Host.
  */
@@ -24,10 +24,43 @@ typedef struct {
     uint32_t    address_application;       // Địa chỉ nạp trên thiết bị target
 } flash_job_t;
 
+// Mã lỗi riêng của module flasher
+#define ESP_ERR_FLASHER_BASE        0x7000
+#define ESP_ERR_FLASHER_CANCELLED   (ESP_ERR_FLASHER_BASE + 1)  // Người dùng hủy giữa chừng
+
+/*
+ * @brief Loại sự kiện mà phiên nạp (chạy trên task riêng) gửi về cho UI.
+ */
+typedef enum {
+    FLASHER_EVT_CONNECTING,     // Đang reset target và handshake
+    FLASHER_EVT_CONNECTED,      // Đã kết nối với ROM bootloader của target
+    FLASHER_EVT_SEGMENT_START,  // Bắt đầu ghi 1 phân vùng (segment)
+    FLASHER_EVT_PROGRESS,       // Đã ghi thêm 1 block
+    FLASHER_EVT_VERIFIED,       // MD5 của segment khớp
+    FLASHER_EVT_ERASING,        // Đang xóa toàn bộ chip
+    FLASHER_EVT_CACHING,        // Target đã nạp xong, đang chép ảnh vào cache nội của Host
+    FLASHER_EVT_DONE,           // Phiên kết thúc thành công
+    FLASHER_EVT_ALREADY_CURRENT,// Phiên kết thúc sớm: target đã chạy đúng firmware này
+    FLASHER_EVT_FAILED,         // Phiên kết thúc với lỗi (xem err)
+    FLASHER_EVT_CANCELLED,      // Phiên bị hủy, target đã được reset
+} flasher_event_type_t;
+
+/*
+ * @brief Một sự kiện tiến trình. Chỉ chứa dữ liệu POD để đi qua FreeRTOS queue.
+ */
+typedef struct {
+    flasher_event_type_t type;
+    const char* segment;        // Tên segment ("bootloader", "partition", "app") hoặc NULL
+    uint32_t    bytes_done;     // Số byte đã ghi của segment hiện tại
+    uint32_t    bytes_total;    // Tổng số byte của segment hiện tại
+    esp_err_t   err;            // Mã lỗi (chỉ có nghĩa với FLASHER_EVT_FAILED)
+} flasher_event_t;
+
 
 /**
  * @brief Khởi tạo phần cứng (UART, GPIO) cho module flasher.
- * Chạy 1 lần duy nhất lúc khởi động.
+ * Gọi lại được nhiều lần: từ lần thứ 2 (đã thành công) không làm gì. UART, cache và
+ * target cache được giữ qua mọi phiên nạp, Host không cần khởi động lại giữa các unit.
  */
 esp_err_t flasher_init(void);
 
@@ -39,13 +72,53 @@ esp_err_t flasher_init(void);
 // esp_err_t flasher_start_update(const std::string& fw_id);
 esp_err_t flasher_begin_session(const std::string& fw_id);
 
-esp_err_t flasher_write_segment(const std::string& file_path, uint32_t offset, const std::string& md5 = "");
+esp_err_t flasher_write_segment(const std::string& file_path, uint32_t offset, const std::string& md5 = "",
+                                const char* segment = NULL);
 
 /**
  * @brief Xóa toàn bộ flash của chip Target.
  */
 esp_err_t flasher_chip_erase(void);
 
+/**
+ * @brief Chạy flasher_begin_session() trên task riêng, trả về ngay.
+ * Tiến trình được gửi về qua flasher_session_poll().
+ * @param fw_id ID firmware, hoặc "NULL" để xóa toàn bộ chip.
+ * @return ESP_ERR_INVALID_STATE nếu đang có phiên khác chạy.
+ */
+esp_err_t flasher_session_start(const std::string& fw_id);
+
+/**
+ * @brief Lấy 1 sự kiện tiến trình (không chặn).
+ * @return true nếu có sự kiện trong `out_event`.
+ */
+bool flasher_session_poll(flasher_event_t* out_event);
+
+/**
+ * @brief Yêu cầu hủy phiên đang chạy. Có hiệu lực ở ranh giới block kế tiếp;
+ * target được reset và phiên kết thúc bằng FLASHER_EVT_CANCELLED.
+ */
+void flasher_session_cancel(void);
+
+/**
+ * @brief Phiên nạp/xóa còn đang chạy hay không.
+ */
+bool flasher_session_busy(void);
+
+/**
+ * @brief Dò target: reset vào ROM bootloader và gửi đúng 1 lần SYNC (vài trăm ms, chủ yếu là
+ * thời gian giữ EN/BOOT). Target có mặt sẽ nằm lại ở bootloader.
+ * @return ESP_OK nếu target trả lời, ESP_ERR_NOT_FOUND nếu không,
+ * ESP_ERR_INVALID_STATE nếu chưa flasher_init hoặc đang có phiên chạy.
+ */
+esp_err_t flasher_probe_target(void);
+
+/**
+ * @brief Có byte nào tới chân RX của Host kể từ lần gọi trước không (ví dụ log ROM khi target
+ * vừa được cấp nguồn). Xóa buffer RX. Không gửi gì ra target.
+ */
+bool flasher_rx_activity(void);
+
 /**
  * @brief Hiển thị thông báo và khởi động lại ESP32 Host.
  */
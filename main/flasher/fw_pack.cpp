@@ -0,0 +1,134 @@
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_rom_md5.h"
+#include "fw_pack.h"
+
+static const char *TAG = "FW_PACK";
+
+static bool read_exact(sd_raw_file_t& f, void* buf, size_t len)
+{
+    return sd_raw_read(f, (uint8_t*) buf, len) == len;
+}
+
+// Mọi so sánh biên viết dạng phép trừ (vế phải không âm đã được kiểm tra trước) để uint32 không tràn:
+// pack hỏng/giả không được lọt qua rồi đọc/seek ngoài dữ liệu thật.
+static esp_err_t check_tables(const fw_pack_t& pack)
+{
+    const fw_pack_header_t& hdr = pack.header;
+
+    for (const fw_pack_segment_t& seg : pack.segments) {
+        if (seg.compression != FW_PACK_COMPRESSION_NONE) {
+            ESP_LOGE(TAG, "Segment %.16s: compression %u not supported", seg.name, seg.compression);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        uint32_t blocks = seg.raw_size / FW_PACK_BLOCK_SIZE + (seg.raw_size % FW_PACK_BLOCK_SIZE != 0);
+        if (seg.stored_size != seg.raw_size || seg.raw_size == 0 ||
+            seg.file_offset < hdr.data_offset || seg.file_offset > pack.file.size ||
+            seg.stored_size > pack.file.size - seg.file_offset ||
+            seg.first_block > hdr.block_count || blocks > hdr.block_count - seg.first_block) {
+            ESP_LOGE(TAG, "Segment %.16s out of bounds", seg.name);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t fw_pack_open(const char* path, fw_pack_t& out)
+{
+    esp_err_t ret = sd_raw_open(path, out.file);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open pack: %s", path);
+        return ret;
+    }
+    return fw_pack_load(out, path);
+}
+
+esp_err_t fw_pack_load(fw_pack_t& out, const char* path)
+{
+    out.segments.clear();
+    out.block_md5.clear();
+    esp_err_t ret;
+
+    // --- HEADER ---
+    fw_pack_header_t& hdr = out.header;
+    if (!read_exact(out.file, &hdr, sizeof(hdr)) || hdr.magic != FW_PACK_MAGIC ||
+        hdr.version != FW_PACK_VERSION || hdr.header_size != sizeof(hdr) ||
+        hdr.block_size != FW_PACK_BLOCK_SIZE) {
+        ESP_LOGE(TAG, "%s is not a v%d firmware pack", path, FW_PACK_VERSION);
+        fw_pack_close(out);
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if (hdr.segment_count == 0 || hdr.segment_count > FW_PACK_MAX_SEGMENTS ||
+        hdr.total_size != out.file.size ||
+        hdr.block_table_offset != sizeof(hdr) + hdr.segment_count * sizeof(fw_pack_segment_t) ||
+        hdr.data_offset < hdr.block_table_offset || hdr.data_offset > hdr.total_size ||
+        hdr.block_count > (hdr.data_offset - hdr.block_table_offset) / FW_PACK_MD5_LEN) {
+        ESP_LOGE(TAG, "%s: bad table layout", path);
+        fw_pack_close(out);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // --- BẢNG SEGMENT + BẢNG MD5 BLOCK (nằm ngay sau header, đọc tuần tự) ---
+    out.segments.resize(hdr.segment_count);
+    out.block_md5.resize(hdr.block_count * FW_PACK_MD5_LEN);
+    if (!read_exact(out.file, out.segments.data(), hdr.segment_count * sizeof(fw_pack_segment_t)) ||
+        !read_exact(out.file, out.block_md5.data(), out.block_md5.size())) {
+        ESP_LOGE(TAG, "%s: truncated tables", path);
+        fw_pack_close(out);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t expected[FW_PACK_MD5_LEN];
+    memcpy(expected, hdr.header_md5, sizeof(expected));
+    fw_pack_header_t zeroed = hdr;
+    memset(zeroed.header_md5, 0, sizeof(zeroed.header_md5));
+
+    md5_context_t ctx;
+    uint8_t digest[ESP_ROM_MD5_DIGEST_LEN];
+    esp_rom_md5_init(&ctx);
+    esp_rom_md5_update(&ctx, &zeroed, sizeof(zeroed));
+    esp_rom_md5_update(&ctx, out.segments.data(), out.segments.size() * sizeof(fw_pack_segment_t));
+    esp_rom_md5_update(&ctx, out.block_md5.data(), out.block_md5.size());
+    esp_rom_md5_final(digest, &ctx);
+    if (memcmp(digest, expected, sizeof(expected)) != 0) {
+        ESP_LOGE(TAG, "%s: header MD5 mismatch", path);
+        fw_pack_close(out);
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    ret = check_tables(out);
+    if (ret != ESP_OK) {
+        fw_pack_close(out);
+        return ret;
+    }
+
+    for (const fw_pack_segment_t& seg : out.segments) {
+        ESP_LOGI(TAG, "  %-10.16s 0x%08" PRIx32 " %7" PRIu32 " bytes @%" PRIu32, seg.name, seg.address,
+                 seg.raw_size, seg.file_offset);
+    }
+    return ESP_OK;
+}
+
+void fw_pack_close(fw_pack_t& pack)
+{
+    sd_raw_close(pack.file);
+    pack.segments.clear();
+    pack.block_md5.clear();
+}
+
+const uint8_t* fw_pack_block_md5(const fw_pack_t& pack, const fw_pack_segment_t& seg)
+{
+    return &pack.block_md5[seg.first_block * FW_PACK_MD5_LEN];
+}
+
+std::string fw_pack_md5_hex(const fw_pack_segment_t& seg)
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string out(FW_PACK_MD5_LEN * 2, '0');
+    for (int i = 0; i < FW_PACK_MD5_LEN; i++) {
+        out[i * 2] = hex[seg.md5[i] >> 4];
+        out[i * 2 + 1] = hex[seg.md5[i] & 0xF];
+    }
+    return out;
+}
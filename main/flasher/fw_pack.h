@@ -0,0 +1,55 @@
+#ifndef __FW_PACK_H__
+#define __FW_PACK_H__
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "esp_err.h"
+#include "fw_pack_format.h"
+#include "../sd_card/sd_raw.h"
+
+/**
+ * @brief Pack firmware đang mở: header, bảng segment và bảng MD5 block đã nằm trong RAM,
+ * dữ liệu segment được đọc tuần tự từ `file` khi nạp.
+ */
+typedef struct {
+    sd_raw_file_t                  file;
+    fw_pack_header_t               header;
+    std::vector<fw_pack_segment_t> segments;
+    std::vector<uint8_t>           block_md5;   // block_count * FW_PACK_MD5_LEN
+} fw_pack_t;
+
+/**
+ * @brief Mở pack trên thẻ SD và kiểm tra header (magic, phiên bản, MD5 header, giới hạn).
+ * @return
+ * - ESP_OK: Pack hợp lệ, phải đóng bằng fw_pack_close.
+ * - ESP_ERR_NOT_FOUND: Không mở được file.
+ * - ESP_ERR_INVALID_VERSION: Magic/phiên bản không đúng.
+ * - ESP_ERR_INVALID_CRC: MD5 header sai (pack hỏng).
+ * - ESP_ERR_INVALID_SIZE: Bảng segment/block vượt ra ngoài file.
+ * - ESP_ERR_NOT_SUPPORTED: Segment nén (chưa hỗ trợ).
+ */
+esp_err_t fw_pack_open(const char* path, fw_pack_t& out);
+
+/**
+ * @brief Như fw_pack_open nhưng pack.file đã được mở sẵn (ví dụ bản trong cache nội).
+ * @param path Tên dùng trong log. Lỗi -> pack.file bị đóng.
+ */
+esp_err_t fw_pack_load(fw_pack_t& pack, const char* path);
+
+/**
+ * @brief Đóng pack.
+ */
+void fw_pack_close(fw_pack_t& pack);
+
+/**
+ * @brief Con trỏ tới MD5 các block 4KB của 1 segment (dùng cho sector_map_diff).
+ */
+const uint8_t* fw_pack_block_md5(const fw_pack_t& pack, const fw_pack_segment_t& seg);
+
+/**
+ * @brief MD5 của segment dạng 32 ký tự hex thường (như index.txt / esp_loader).
+ */
+std::string fw_pack_md5_hex(const fw_pack_segment_t& seg);
+
+#endif // __FW_PACK_H__
@@ -0,0 +1,65 @@
+/**
+ * @file fw_pack_format.h
+ * @brief Định dạng file pack firmware (.fwp): mọi segment của 1 firmware trong 1 file.
+ *
+ * Dùng chung giữa firmware Host và tool Linux tools/linux_flasher/fw_pack.
+ * Mọi số nguyên là little-endian.
+ *
+ * Bố cục:
+ *   fw_pack_header_t
+ *   fw_pack_segment_t[segment_count]   (theo thứ tự địa chỉ nạp tăng dần)
+ *   uint8_t block_md5[block_count][16]  (MD5 từng block 4KB, block cuối đệm 0xFF)
+ *   dữ liệu segment 0 | dữ liệu segment 1 | ...  (mỗi segment căn FW_PACK_DATA_ALIGN)
+ *
+ * Toàn bộ dữ liệu nằm liền nhau theo đúng thứ tự nạp, nên Host đọc pack
+ * tuần tự từ đầu đến cuối đúng 1 lần.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define FW_PACK_MAGIC           0x4B504646u     // "FFPK"
+#define FW_PACK_VERSION         1
+#define FW_PACK_BLOCK_SIZE      4096            // = sector flash của target (sector_map)
+#define FW_PACK_DATA_ALIGN      512             // = sector thẻ SD: dữ liệu segment đọc thẳng bằng DMA
+#define FW_PACK_MAX_SEGMENTS    8
+#define FW_PACK_NAME_LEN        16
+#define FW_PACK_MD5_LEN         16
+
+// fw_pack_segment_t::compression
+#define FW_PACK_COMPRESSION_NONE    0
+
+// fw_pack_segment_t::flags
+#define FW_PACK_SEG_APP         0x01            // Ảnh app có esp_app_desc_t (dùng để kiểm tra nhanh)
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;           // sizeof(fw_pack_header_t)
+    uint16_t segment_count;
+    uint16_t block_size;            // FW_PACK_BLOCK_SIZE
+    uint32_t block_count;           // Tổng số block của mọi segment
+    uint32_t block_table_offset;    // Vị trí bảng MD5 block trong file
+    uint32_t data_offset;           // Vị trí byte dữ liệu đầu tiên
+    uint32_t total_size;            // Kích thước file pack
+    uint8_t  header_md5[FW_PACK_MD5_LEN];   // MD5(header với trường này = 0 | bảng segment | bảng block)
+} fw_pack_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t address;               // Địa chỉ nạp trên target
+    uint32_t raw_size;              // Kích thước ảnh gốc
+    uint32_t stored_size;           // Kích thước lưu trong pack (= raw_size khi không nén)
+    uint32_t file_offset;           // Vị trí dữ liệu trong pack
+    uint32_t first_block;           // Chỉ số block đầu tiên trong bảng MD5 block
+    uint8_t  compression;
+    uint8_t  flags;
+    uint8_t  reserved[2];
+    char     name[FW_PACK_NAME_LEN];        // "bootloader", "partition", "app", ... (kết thúc '\0')
+    uint8_t  md5[FW_PACK_MD5_LEN];          // MD5 của ảnh gốc (như md5 trong index.txt)
+} fw_pack_segment_t;
+
+#ifdef __cplusplus
+static_assert(sizeof(fw_pack_header_t) == 44, "fw_pack_header_t layout");
+static_assert(sizeof(fw_pack_segment_t) == 56, "fw_pack_segment_t layout");
+#endif
@@ -0,0 +1,432 @@
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_littlefs.h"
+#include "esp_rom_md5.h"
+#include "sodium.h"           // crypto_hash_sha256: kiểm tra blob của kho theo SHA-256
+#include "vfs_api.h"          // VFSImpl: gắn fs::FS của Arduino vào mount point LittleFS của IDF
+#include "sdkconfig.h"
+#include <ArduinoJson.h>
+#include <vector>
+#include "image_cache.h"
+#include "../sd_card/sd_store.h"
+
+static const char *TAG = "IMAGE_CACHE";
+
+#define CACHE_PARTITION      "fwcache"
+#define CACHE_MOUNT_POINT    "/fwcache"
+#define CACHE_LRU_PATH       "/lru.bin"
+#define CACHE_LRU_MAGIC      0x55524C46  // "FLRU"
+#define CACHE_BLOCK_SIZE     4096
+#define CACHE_RESERVE_BLOCKS 4           // LittleFS cần vài block trống cho copy-on-write
+#define CACHE_COPY_BUF       4096
+
+#define CACHE_KIND_IMAGE     1           // /<key>.bin
+#define CACHE_KIND_META      2           // /<key>.fw (key = MD5 của fw_id)
+
+typedef struct {
+    char     key[IMAGE_CACHE_KEY_LEN + 1];  // "" = slot trống
+    uint8_t  kind;
+    uint8_t  reserved[2];
+    uint32_t size;
+    uint32_t last_used;                     // Giá trị clock lần dùng cuối
+} cache_slot_t;
+
+// Bảng LRU: vài trăm byte, giữ trong RAM, ghi lại nguyên file mỗi lần đổi
+typedef struct {
+    uint32_t     magic;
+    uint32_t     clock;
+    cache_slot_t slots[IMAGE_CACHE_MAX_ENTRIES];
+} cache_lru_t;
+
+static fs::FSImplPtr s_cache_vfs = std::make_shared<fs::VFSImpl>();
+static fs::FS s_cache_fs(s_cache_vfs);
+static cache_lru_t s_lru;
+static bool s_ready = false;
+
+std::string image_cache_key(const uint8_t md5[16])
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string out(IMAGE_CACHE_KEY_LEN, '0');
+    for (int i = 0; i < 16; i++) {
+        out[i * 2] = hex[md5[i] >> 4];
+        out[i * 2 + 1] = hex[md5[i] & 0xF];
+    }
+    return out;
+}
+
+static bool valid_key(const std::string& key)
+{
+    if (key.size() != IMAGE_CACHE_KEY_LEN) return false;
+    for (char c : key) {
+        if (!isxdigit((unsigned char) c)) return false;
+    }
+    return true;
+}
+
+static std::string slot_path(const char* key, uint8_t kind)
+{
+    return std::string("/") + key + (kind == CACHE_KIND_META ? ".fw" : ".bin");
+}
+
+static int find_slot(const std::string& key, uint8_t kind)
+{
+    for (int i = 0; i < IMAGE_CACHE_MAX_ENTRIES; i++) {
+        if (s_lru.slots[i].kind == kind && strcasecmp(s_lru.slots[i].key, key.c_str()) == 0) return i;
+    }
+    return -1;
+}
+
+static bool save_lru()
+{
+    File f = s_cache_fs.open(CACHE_LRU_PATH, FILE_WRITE);
+    bool ok = f && f.write((const uint8_t*) &s_lru, sizeof(s_lru)) == sizeof(s_lru);
+    f.close();
+    if (!ok) ESP_LOGW(TAG, "Failed to save LRU table");
+    return ok;
+}
+
+static void touch(int slot)
+{
+    s_lru.slots[slot].last_used = ++s_lru.clock;
+    save_lru();
+}
+
+static void evict(int slot)
+{
+    cache_slot_t& s = s_lru.slots[slot];
+    ESP_LOGI(TAG, "Evicting %s (%" PRIu32 " KB)", s.key, s.size / 1024);
+    s_cache_fs.remove(slot_path(s.key, s.kind).c_str());
+    memset(&s, 0, sizeof(s));
+    save_lru();
+}
+
+static size_t free_bytes(size_t* total_out = NULL)
+{
+    size_t total = 0, used = 0;
+    if (esp_littlefs_info(CACHE_PARTITION, &total, &used) != ESP_OK) return 0;
+    if (total_out) *total_out = total;
+    return total > used ? total - used : 0;
+}
+
+// Xóa ảnh lâu chưa dùng nhất cho tới khi đủ chỗ cho size byte và còn 1 slot trống.
+// Trả về slot trống.
+static int make_room(size_t size)
+{
+    size_t total = 0;
+    size_t need = (size + CACHE_BLOCK_SIZE - 1) / CACHE_BLOCK_SIZE * CACHE_BLOCK_SIZE +
+                  CACHE_RESERVE_BLOCKS * CACHE_BLOCK_SIZE;
+    free_bytes(&total);
+    if (need > total) return -1;
+
+    while (true) {
+        int empty = -1, oldest = -1;
+        for (int i = 0; i < IMAGE_CACHE_MAX_ENTRIES; i++) {
+            const cache_slot_t& s = s_lru.slots[i];
+            if (s.kind == 0) {
+                if (empty < 0) empty = i;
+            } else if (oldest < 0 || s.last_used < s_lru.slots[oldest].last_used) {
+                oldest = i;
+            }
+        }
+        if (empty >= 0 && free_bytes() >= need) return empty;
+        if (oldest < 0) return -1;
+        evict(oldest);
+    }
+}
+
+// Xóa file không có trong bảng LRU (bị ngắt điện giữa lúc chép, hoặc bảng hỏng)
+static void remove_orphans()
+{
+    File root = s_cache_fs.open("/");
+    if (!root) return;
+    std::vector<std::string> orphans;
+    for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+        std::string name = f.name();
+        f.close();
+        if (name == CACHE_LRU_PATH + 1) continue;
+        bool known = false;
+        for (const cache_slot_t& s : s_lru.slots) {
+            if (s.kind != 0 && slot_path(s.key, s.kind) == "/" + name) known = true;
+        }
+        if (!known) orphans.push_back("/" + name);
+    }
+    root.close();
+    for (const std::string& path : orphans) {
+        ESP_LOGW(TAG, "Removing orphan %s", path.c_str());
+        s_cache_fs.remove(path.c_str());
+    }
+}
+
+esp_err_t image_cache_init(void)
+{
+#if !CONFIG_IMAGE_CACHE
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    if (s_ready) return ESP_OK;
+
+    esp_vfs_littlefs_conf_t conf = {};
+    conf.base_path = CACHE_MOUNT_POINT;
+    conf.partition_label = CACHE_PARTITION;
+    conf.format_if_mount_failed = true;
+    esp_err_t ret = esp_vfs_littlefs_register(&conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount cache partition '%s': %s", CACHE_PARTITION, esp_err_to_name(ret));
+        return ret;
+    }
+    s_cache_vfs->mountpoint(CACHE_MOUNT_POINT);
+
+    File f = s_cache_fs.open(CACHE_LRU_PATH, FILE_READ);
+    bool ok = f && f.read((uint8_t*) &s_lru, sizeof(s_lru)) == sizeof(s_lru) && s_lru.magic == CACHE_LRU_MAGIC;
+    f.close();
+    if (!ok) {
+        memset(&s_lru, 0, sizeof(s_lru));
+        s_lru.magic = CACHE_LRU_MAGIC;
+    }
+    for (cache_slot_t& s : s_lru.slots) {
+        s.key[IMAGE_CACHE_KEY_LEN] = '\0';
+    }
+    remove_orphans();
+
+    size_t total = 0;
+    size_t avail = free_bytes(&total);
+    int count = 0;
+    for (const cache_slot_t& s : s_lru.slots) count += s.kind != 0;
+    ESP_LOGI(TAG, "Image cache: %d entries, %u / %u KB free", count, (unsigned) (avail / 1024),
+             (unsigned) (total / 1024));
+    s_ready = true;
+    return ESP_OK;
+#endif
+}
+
+bool image_cache_ready(void)
+{
+    return s_ready;
+}
+
+bool image_cache_contains(const std::string& key)
+{
+    return s_ready && valid_key(key) && find_slot(key, CACHE_KIND_IMAGE) >= 0;
+}
+
+esp_err_t image_cache_open(const std::string& key, sd_raw_file_t& out)
+{
+    if (!s_ready || !valid_key(key)) return ESP_ERR_NOT_FOUND;
+    int slot = find_slot(key, CACHE_KIND_IMAGE);
+    if (slot < 0) return ESP_ERR_NOT_FOUND;
+
+    if (sd_raw_open_fs(s_cache_fs, slot_path(s_lru.slots[slot].key, CACHE_KIND_IMAGE).c_str(), out) != ESP_OK ||
+        out.size != s_lru.slots[slot].size) {
+        ESP_LOGW(TAG, "Cached image %s unreadable, dropping", key.c_str());
+        sd_raw_close(out);
+        evict(slot);
+        return ESP_ERR_NOT_FOUND;
+    }
+    touch(slot);
+    ESP_LOGI(TAG, "Hit %s (%" PRIu32 " KB)", key.c_str(), out.size / 1024);
+    return ESP_OK;
+}
+
+// MD5 của toàn bộ file (đọc lại bản chép)
+static void file_md5(File& f, uint8_t* buf, uint8_t digest[16])
+{
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    size_t n;
+    while ((n = f.read(buf, CACHE_COPY_BUF)) > 0) {
+        esp_rom_md5_update(&ctx, buf, n);
+    }
+    esp_rom_md5_final(digest, &ctx);
+}
+
+esp_err_t image_cache_store(const std::string& sd_path, const std::string& key, bool verify_key,
+                            const std::string& sha256)
+{
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+    if (!valid_key(key)) return ESP_ERR_INVALID_ARG;  // Không có MD5 -> không xác thực được, không cache
+
+    int slot = find_slot(key, CACHE_KIND_IMAGE);
+    if (slot >= 0) {
+        touch(slot);
+        return ESP_OK;
+    }
+
+    File src = g_sd_fs.open(sd_path.c_str(), FILE_READ);
+    if (!src) {
+        ESP_LOGE(TAG, "Cannot open %s", sd_path.c_str());
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t size = src.size();
+    slot = make_room(size);
+    if (slot < 0) {
+        ESP_LOGW(TAG, "%s (%" PRIu32 " KB) does not fit in cache", sd_path.c_str(), size / 1024);
+        src.close();
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t* buf = (uint8_t*) malloc(CACHE_COPY_BUF);
+    if (!buf) {
+        src.close();
+        return ESP_ERR_NO_MEM;
+    }
+
+    // --- CHÉP SD -> FLASH NỘI, TÍNH MD5 DỮ LIỆU ĐỌC TỪ SD ---
+    int64_t start = esp_timer_get_time();
+    std::string path = slot_path(key.c_str(), CACHE_KIND_IMAGE);
+    File dst = s_cache_fs.open(path.c_str(), FILE_WRITE);
+    md5_context_t ctx;
+    crypto_hash_sha256_state sha_ctx;   // Chỉ khi entry có SHA-256 (blob trong kho)
+    uint8_t sd_md5[16];
+    uint8_t sd_sha256[SD_STORE_DIGEST_LEN];
+    uint32_t copied = 0;
+    bool check_sha = !sha256.empty();
+    esp_rom_md5_init(&ctx);
+    if (check_sha) crypto_hash_sha256_init(&sha_ctx);
+    while (dst && copied < size) {
+        size_t n = src.read(buf, CACHE_COPY_BUF);
+        if (n == 0 || dst.write(buf, n) != n) break;
+        esp_rom_md5_update(&ctx, buf, n);
+        if (check_sha) crypto_hash_sha256_update(&sha_ctx, buf, n);
+        copied += n;
+    }
+    esp_rom_md5_final(sd_md5, &ctx);
+    if (check_sha) crypto_hash_sha256_final(&sha_ctx, sd_sha256);
+    src.close();
+    dst.close();
+
+    esp_err_t ret = ESP_OK;
+    if (copied != size) {
+        ESP_LOGE(TAG, "Copy of %s failed at %" PRIu32 " / %" PRIu32, sd_path.c_str(), copied, size);
+        ret = ESP_FAIL;
+    } else if (verify_key && strcasecmp(image_cache_key(sd_md5).c_str(), key.c_str()) != 0) {
+        ESP_LOGE(TAG, "%s does not match its catalog MD5", sd_path.c_str());
+        ret = ESP_ERR_INVALID_CRC;
+    } else if (check_sha && !sd_store_digest_equal(sd_sha256, sha256)) {
+        ESP_LOGE(TAG, "%s does not match its SHA-256", sd_path.c_str());
+        ret = ESP_ERR_INVALID_CRC;
+    } else {
+        // --- ĐỌC LẠI BẢN CHÉP, SO VỚI MD5 CỦA BẢN TRÊN SD ---
+        uint8_t copy_md5[16];
+        File chk = s_cache_fs.open(path.c_str(), FILE_READ);
+        if (chk) file_md5(chk, buf, copy_md5);
+        if (!chk || memcmp(copy_md5, sd_md5, sizeof(sd_md5)) != 0) {
+            ESP_LOGE(TAG, "Read-back of cached %s does not match SD copy", sd_path.c_str());
+            ret = ESP_ERR_INVALID_CRC;
+        }
+        chk.close();
+    }
+    free(buf);
+
+    if (ret != ESP_OK) {
+        s_cache_fs.remove(path.c_str());
+        return ret;
+    }
+
+    cache_slot_t& s = s_lru.slots[slot];
+    snprintf(s.key, sizeof(s.key), "%s", key.c_str());
+    s.kind = CACHE_KIND_IMAGE;
+    s.size = size;
+    s.last_used = ++s_lru.clock;
+    save_lru();
+    ESP_LOGI(TAG, "Cached %s as %s (%" PRIu32 " KB, %d ms)", sd_path.c_str(), key.c_str(), size / 1024,
+             (int) ((esp_timer_get_time() - start) / 1000));
+    return ESP_OK;
+}
+
+void image_cache_remove(const std::string& key)
+{
+    if (!s_ready || !valid_key(key)) return;
+    int slot = find_slot(key, CACHE_KIND_IMAGE);
+    if (slot >= 0) evict(slot);
+}
+
+// Khóa metadata: MD5 của fw_id (tên file hợp lệ với mọi fw_id)
+static std::string meta_key(const std::string& fw_id)
+{
+    md5_context_t ctx;
+    uint8_t digest[16];
+    esp_rom_md5_init(&ctx);
+    esp_rom_md5_update(&ctx, fw_id.data(), fw_id.size());
+    esp_rom_md5_final(digest, &ctx);
+    return image_cache_key(digest);
+}
+
+esp_err_t image_cache_put_metadata(const std::string& fw_id, const firmware_metadata_t& metadata,
+                                   const std::string& pack_key)
+{
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+
+    // Cùng tên trường như index.txt
+    JsonDocument doc;
+    doc["fw_id"] = fw_id;
+    doc["device_type"] = metadata.device_type;
+    doc["version"] = metadata.version;
+    doc["path"] = metadata.path;
+    doc["md5"] = metadata.md5;
+    doc["path_bootloader"] = metadata.path_bootloader;
+    doc["md5_bootloader"] = metadata.md5_bootloader;
+    doc["path_partition"] = metadata.path_partition;
+    doc["md5_partition"] = metadata.md5_partition;
+    doc["pack"] = metadata.path_pack;
+    doc["sha256"] = metadata.sha256;
+    doc["sha256_bootloader"] = metadata.sha256_bootloader;
+    doc["sha256_partition"] = metadata.sha256_partition;
+    doc["pack_md5"] = pack_key;
+
+    std::string key = meta_key(fw_id);
+    int slot = find_slot(key, CACHE_KIND_META);
+    if (slot < 0) slot = make_room(measureJson(doc));
+    if (slot < 0) return ESP_ERR_NO_MEM;
+
+    File f = s_cache_fs.open(slot_path(key.c_str(), CACHE_KIND_META).c_str(), FILE_WRITE);
+    size_t written = f ? serializeJson(doc, f) : 0;
+    f.close();
+    if (written == 0) {
+        ESP_LOGW(TAG, "Failed to store metadata of %s", fw_id.c_str());
+        return ESP_FAIL;
+    }
+
+    cache_slot_t& s = s_lru.slots[slot];
+    snprintf(s.key, sizeof(s.key), "%s", key.c_str());
+    s.kind = CACHE_KIND_META;
+    s.size = written;
+    touch(slot);
+    return ESP_OK;
+}
+
+esp_err_t image_cache_get_metadata(const std::string& fw_id, firmware_metadata_t& out, std::string& pack_key)
+{
+    if (!s_ready) return ESP_ERR_NOT_FOUND;
+    std::string key = meta_key(fw_id);
+    int slot = find_slot(key, CACHE_KIND_META);
+    if (slot < 0) return ESP_ERR_NOT_FOUND;
+
+    JsonDocument doc;
+    File f = s_cache_fs.open(slot_path(key.c_str(), CACHE_KIND_META).c_str(), FILE_READ);
+    DeserializationError error = f ? deserializeJson(doc, f) : DeserializationError::InvalidInput;
+    f.close();
+    if (error || fw_id != (doc["fw_id"] | "")) {
+        evict(slot);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    out.device_type = doc["device_type"] | "";
+    out.version = doc["version"] | "";
+    out.path = doc["path"] | "";
+    out.md5 = doc["md5"] | "";
+    out.path_bootloader = doc["path_bootloader"] | "";
+    out.md5_bootloader = doc["md5_bootloader"] | "";
+    out.path_partition = doc["path_partition"] | "";
+    out.md5_partition = doc["md5_partition"] | "";
+    out.path_pack = doc["pack"] | "";
+    out.sha256 = doc["sha256"] | "";
+    out.sha256_bootloader = doc["sha256_bootloader"] | "";
+    out.sha256_partition = doc["sha256_partition"] | "";
+    pack_key = doc["pack_md5"] | "";
+    touch(slot);
+    return ESP_OK;
+}
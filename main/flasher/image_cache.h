@@ -0,0 +1,82 @@
+#ifndef __IMAGE_CACHE_H__
+#define __IMAGE_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include "esp_err.h"
+#include "../sd_card/sd_card.h"
+#include "../sd_card/sd_raw.h"
+
+/*
+ * Cache ảnh firmware trên flash nội của Host (phân vùng LittleFS "fwcache", mount tại /fwcache).
+ *
+ * Mỗi ảnh được đặt tên theo khóa = MD5 32 ký tự hex: MD5 trong index.txt cho file .bin riêng,
+ * MD5 header cho pack. Ảnh trên SD đổi -> MD5 đổi -> cache tự trượt, không cần dọn.
+ * Lúc chép vào cache, dữ liệu được đọc lại từ flash nội và so MD5 với bản vừa đọc từ SD.
+ * Khi đầy, ảnh lâu chưa dùng nhất (LRU) bị xóa trước.
+ *
+ * Metadata của fw_id đã nạp cũng được lưu lại, để Host vẫn nạp tiếp sản phẩm đang chạy
+ * khi thẻ SD bị rút hoặc hỏng giữa ca.
+ */
+
+#define IMAGE_CACHE_MAX_ENTRIES 16      // Ảnh + metadata
+#define IMAGE_CACHE_KEY_LEN     32      // MD5 dạng hex
+
+/**
+ * @brief Mount phân vùng cache (format nếu hỏng) và đọc bảng LRU. Gọi lại được nhiều lần.
+ * @return ESP_OK, ESP_ERR_NOT_SUPPORTED nếu tắt trong menuconfig, hoặc lỗi mount.
+ */
+esp_err_t image_cache_init(void);
+
+/**
+ * @brief Cache đã mount và dùng được.
+ */
+bool image_cache_ready(void);
+
+/**
+ * @brief Cache có ảnh với khóa này không (không đọc flash).
+ */
+bool image_cache_contains(const std::string& key);
+
+/**
+ * @brief Mở ảnh trong cache để đọc bằng sd_raw_read/sd_raw_seek, đánh dấu vừa dùng.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND nếu chưa có (hoặc khóa rỗng).
+ */
+esp_err_t image_cache_open(const std::string& key, sd_raw_file_t& out);
+
+/**
+ * @brief Chép file trên SD vào cache với khóa key (bỏ qua nếu đã có).
+ * @param verify_key true nếu key là MD5 của chính file (file .bin) -> so thêm với MD5 đọc được.
+ * @param sha256 SHA-256 (hex) của file nếu entry dùng kho blob, "" nếu không có -> so thêm.
+ * @return
+ * - ESP_OK: Đã có trong cache.
+ * - ESP_ERR_INVALID_SIZE: Ảnh lớn hơn cả phân vùng cache.
+ * - ESP_ERR_INVALID_CRC: MD5/SHA-256 của file trên SD hoặc bản chép không khớp (đã xóa bản chép).
+ * - ESP_ERR_NOT_FOUND / ESP_FAIL: Lỗi đọc SD / ghi flash nội.
+ */
+esp_err_t image_cache_store(const std::string& sd_path, const std::string& key, bool verify_key,
+                            const std::string& sha256);
+
+/**
+ * @brief Xóa ảnh khỏi cache (ví dụ sau khi target báo MD5 sai).
+ */
+void image_cache_remove(const std::string& key);
+
+/**
+ * @brief Lưu metadata đã dùng để nạp fw_id (pack_key: MD5 header của pack, "" nếu không phải pack).
+ */
+esp_err_t image_cache_put_metadata(const std::string& fw_id, const firmware_metadata_t& metadata,
+                                   const std::string& pack_key);
+
+/**
+ * @brief Đọc metadata đã lưu của fw_id (dùng khi không đọc được thẻ SD).
+ * @return ESP_OK hoặc ESP_ERR_NOT_FOUND.
+ */
+esp_err_t image_cache_get_metadata(const std::string& fw_id, firmware_metadata_t& out, std::string& pack_key);
+
+/**
+ * @brief MD5 16 byte -> khóa 32 ký tự hex thường.
+ */
+std::string image_cache_key(const uint8_t md5[16]);
+
+#endif // __IMAGE_CACHE_H__
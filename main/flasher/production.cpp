@@ -0,0 +1,182 @@
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "flasher.h"
+#include "image_cache.h"
+#include "production.h"
+#include "../oled/menu.h"
+#include "../oled/progress.h"
+
+static const char *TAG = "PRODUCTION";
+
+#define PROD_RX_SETTLE_MS   200     // Chờ target in xong log ROM trước khi probe xác nhận
+#define PROD_RESULT_HOLD_MS 1000    // Giữ PASS/FAIL trước khi bắt đầu dò unit bị rút
+
+typedef enum {
+    PROD_OFF = 0,
+    PROD_WAIT_INSERT,   // Chờ unit mới
+    PROD_FLASHING,      // Phiên nạp đang chạy trên task của flasher
+    PROD_WAIT_REMOVE,   // Đã báo PASS/FAIL, chờ unit bị rút
+} prod_state_t;
+
+static prod_state_t s_state = PROD_OFF;
+static std::string  s_fw_id;
+static int64_t      s_next_probe_us = 0;
+static int          s_missed_probes = 0;
+static uint32_t     s_pass = 0;
+static uint32_t     s_fail = 0;
+static int64_t      s_unit_start_us = 0;
+
+static int64_t now_us()
+{
+    return esp_timer_get_time();
+}
+
+static void schedule_probe(uint32_t delay_ms)
+{
+    s_next_probe_us = now_us() + (int64_t) delay_ms * 1000;
+}
+
+static void show_waiting()
+{
+    std::string line2 = "Insert unit  " + std::to_string(s_pass) + "/" + std::to_string(s_fail);
+    oled_show_message(s_fw_id.c_str(), line2.c_str());
+}
+
+esp_err_t production_start(const std::string& fw_id)
+{
+    // flasher_init trước: mount cache nội -> không có thẻ SD vẫn chạy được bằng metadata đã cache
+    esp_err_t ret = flasher_init();
+    if (ret != ESP_OK) return ret;
+
+    firmware_metadata_t metadata;
+    std::string pack_key;
+    if (sd_get_firmware_path(fw_id, metadata) != ESP_OK &&
+        image_cache_get_metadata(fw_id, metadata, pack_key) != ESP_OK) {
+        ESP_LOGE(TAG, "fw_id %s not in catalog", fw_id.c_str());
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_fw_id = fw_id;
+    s_pass = s_fail = 0;
+    s_state = PROD_WAIT_INSERT;
+    flasher_rx_activity(); // Bỏ dữ liệu cũ trong buffer RX
+    schedule_probe(0);
+    ESP_LOGI(TAG, "Production mode: %s (probe every %d ms)", fw_id.c_str(), CONFIG_PRODUCTION_PROBE_MS);
+    show_waiting();
+    return ESP_OK;
+}
+
+bool production_active(void)
+{
+    return s_state != PROD_OFF;
+}
+
+static void start_unit()
+{
+    s_unit_start_us = now_us();
+    if (flasher_session_start(s_fw_id) != ESP_OK) {
+        ESP_LOGE(TAG, "Cannot start session");
+        schedule_probe(CONFIG_PRODUCTION_PROBE_MS);
+        return;
+    }
+    s_state = PROD_FLASHING;
+}
+
+// Chờ unit mới: RX có dữ liệu -> probe sớm, ngược lại probe thưa
+static void wait_insert()
+{
+    if (flasher_rx_activity() && now_us() + PROD_RX_SETTLE_MS * 1000 < s_next_probe_us) {
+        ESP_LOGI(TAG, "RX activity, probing");
+        schedule_probe(PROD_RX_SETTLE_MS);
+    }
+    if (now_us() < s_next_probe_us) return;
+
+    if (flasher_probe_target() == ESP_OK) {
+        ESP_LOGI(TAG, "Unit detected");
+        start_unit();
+    } else {
+        schedule_probe(CONFIG_PRODUCTION_PROBE_MS);
+    }
+}
+
+static void show_event(const flasher_event_t& evt)
+{
+    switch (evt.type) {
+    case FLASHER_EVT_CONNECTING:
+        oled_show_message(s_fw_id.c_str(), "Connecting...");
+        break;
+    case FLASHER_EVT_SEGMENT_START:
+    case FLASHER_EVT_PROGRESS:
+        oled_progress_update(evt.segment ? evt.segment : "", evt.bytes_done, evt.bytes_total);
+        break;
+    case FLASHER_EVT_ERASING:
+        oled_show_message(s_fw_id.c_str(), "Erasing...");
+        break;
+    default:
+        break;
+    }
+}
+
+// Kết quả của unit: PASS nếu đã nạp + xác thực (hoặc unit đã đúng bản), còn lại FAIL
+static void finish_unit(const flasher_event_t& evt)
+{
+    bool pass = evt.type == FLASHER_EVT_DONE || evt.type == FLASHER_EVT_ALREADY_CURRENT;
+    if (pass) {
+        s_pass++;
+    } else {
+        s_fail++;
+    }
+    int ms = (int) ((now_us() - s_unit_start_us) / 1000);
+    ESP_LOGI(TAG, "Unit %s in %d ms (pass %" PRIu32 ", fail %" PRIu32 ")", pass ? "PASS" : "FAIL", ms, s_pass, s_fail);
+
+    std::string line2 = "Remove unit  " + std::to_string(s_pass) + "/" + std::to_string(s_fail);
+    oled_show_message(pass ? "PASS" : "FAIL", line2.c_str());
+
+    s_state = PROD_WAIT_REMOVE;
+    s_missed_probes = 0;
+    schedule_probe(PROD_RESULT_HOLD_MS);
+}
+
+// Chờ rút unit: vài probe liên tiếp không trả lời mới tính là đã rút (tránh nạp lại unit cũ)
+static void wait_remove()
+{
+    if (now_us() < s_next_probe_us) return;
+
+    if (flasher_probe_target() == ESP_OK) {
+        s_missed_probes = 0;
+    } else if (++s_missed_probes >= CONFIG_PRODUCTION_REMOVE_PROBES) {
+        ESP_LOGI(TAG, "Unit removed");
+        s_state = PROD_WAIT_INSERT;
+        flasher_rx_activity();
+        show_waiting();
+    }
+    schedule_probe(CONFIG_PRODUCTION_PROBE_MS);
+}
+
+void production_update(void)
+{
+    switch (s_state) {
+    case PROD_WAIT_INSERT:
+        wait_insert();
+        break;
+    case PROD_FLASHING: {
+        flasher_event_t evt;
+        while (s_state == PROD_FLASHING && flasher_session_poll(&evt)) {
+            if (evt.type == FLASHER_EVT_DONE || evt.type == FLASHER_EVT_ALREADY_CURRENT ||
+                evt.type == FLASHER_EVT_FAILED || evt.type == FLASHER_EVT_CANCELLED) {
+                finish_unit(evt);
+            } else {
+                show_event(evt);
+            }
+        }
+        break;
+    }
+    case PROD_WAIT_REMOVE:
+        wait_remove();
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef __PRODUCTION_H__
+#define __PRODUCTION_H__
+
+#include <string>
+#include "esp_err.h"
+
+/*
+ * Chế độ sản xuất (fixture): nạp 1 firmware cố định cho từng unit, không cần bấm nút.
+ *
+ *   CHỜ UNIT  --(có byte trên RX / probe SYNC trả lời)-->  NẠP (connect, ghi, MD5, reset)
+ *   NẠP       --(kết thúc)-->                              PASS/FAIL, CHỜ RÚT UNIT
+ *   CHỜ RÚT   --(CONFIG_PRODUCTION_REMOVE_PROBES probe liên tiếp không trả lời)--> CHỜ UNIT
+ *
+ * Probe chỉ chạy mỗi CONFIG_PRODUCTION_PROBE_MS (1 lần reset + 1 SYNC), giữa các lần probe chỉ
+ * đọc buffer RX: target vừa cấp nguồn in log ROM -> được nạp ngay, không chờ tới lần probe kế.
+ */
+
+/**
+ * @brief Vào chế độ sản xuất với fw_id (phải có trong catalog hoặc metadata đã cache).
+ * @return ESP_OK, ESP_ERR_NOT_FOUND nếu không có fw_id, hoặc lỗi của flasher_init.
+ */
+esp_err_t production_start(const std::string& fw_id);
+
+/**
+ * @brief Đang ở chế độ sản xuất.
+ */
+bool production_active(void);
+
+/**
+ * @brief Chạy 1 bước của máy trạng thái. Gọi liên tục từ loop(), không chặn lâu hơn 1 lần probe.
+ */
+void production_update(void);
+
+#endif // __PRODUCTION_H__
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_md5.h"
+#include "esp_loader.h"
+#include "esp_loader_io.h"   // loader_port_read/write: gửi lệnh mở rộng không có trong API esp_loader
+#include "sector_map.h"
+#include "trace_log.h"
+
+static const char *TAG = "SECTOR_MAP";
+
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+#define CMD_TIMEOUT_MS  3000    // Stub băm ~1MB/100ms, để dư cho vùng 16MB
+
+// Ngân sách lệnh MD5 khi chia đôi: sectors / DIV, ít nhất MIN (1 sector đổi trong 1MB ~ 2 * 8 lệnh)
+#define SECTOR_MAP_BISECT_BUDGET_DIV    8
+#define SECTOR_MAP_BISECT_MIN_BUDGET    16
+
+// Trạng thái dò tính năng: -1 chưa biết, 0 không hỗ trợ, 1 hỗ trợ
+static int s_map_supported = -1;
+
+void sector_map_reset_caps(void)
+{
+    s_map_supported = -1;
+}
+
+// --- SLIP (giống giao thức của esptool) ---
+
+static esp_loader_error_t slip_write(const uint8_t* data, size_t len)
+{
+    static const uint8_t esc_end[] = { SLIP_ESC, SLIP_ESC_END };
+    static const uint8_t esc_esc[] = { SLIP_ESC, SLIP_ESC_ESC };
+
+    size_t start = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] != SLIP_END && data[i] != SLIP_ESC) continue;
+        if (i > start) RETURN_ON_ERROR(loader_port_write(data + start, i - start, loader_port_remaining_time()));
+        RETURN_ON_ERROR(loader_port_write(data[i] == SLIP_END ? esc_end : esc_esc, 2, loader_port_remaining_time()));
+        start = i + 1;
+    }
+    if (len > start) RETURN_ON_ERROR(loader_port_write(data + start, len - start, loader_port_remaining_time()));
+    return ESP_LOADER_SUCCESS;
+}
+
+// Đọc 1 byte đã giải mã SLIP trong frame hiện tại
+static esp_loader_error_t slip_read_byte(uint8_t* out)
+{
+    RETURN_ON_ERROR(loader_port_read(out, 1, loader_port_remaining_time()));
+    if (*out == SLIP_END) return ESP_LOADER_ERROR_INVALID_RESPONSE; // Frame kết thúc sớm
+    if (*out == SLIP_ESC) {
+        RETURN_ON_ERROR(loader_port_read(out, 1, loader_port_remaining_time()));
+        *out = (*out == SLIP_ESC_END) ? SLIP_END : SLIP_ESC;
+    }
+    return ESP_LOADER_SUCCESS;
+}
+
+static esp_loader_error_t slip_read(uint8_t* buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        RETURN_ON_ERROR(slip_read_byte(&buf[i]));
+    }
+    return ESP_LOADER_SUCCESS;
+}
+
+// Bỏ qua dữ liệu cho tới đầu frame, trả về byte đầu tiên của frame.
+// Byte đầu là direction (0x01) nên không bao giờ bị escape.
+static esp_loader_error_t slip_wait_frame(uint8_t* first)
+{
+    do {
+        RETURN_ON_ERROR(loader_port_read(first, 1, loader_port_remaining_time()));
+    } while (*first != SLIP_END);
+    // Bootloader có thể gửi thêm vài byte 0xC0 thừa
+    do {
+        RETURN_ON_ERROR(loader_port_read(first, 1, loader_port_remaining_time()));
+    } while (*first == SLIP_END);
+    return ESP_LOADER_SUCCESS;
+}
+
+/*
+ * Gửi SECTOR_MAP_CMD và so sánh từng digest ngay khi nhận (không cần buffer cho cả bảng).
+ * Trả về ESP_ERR_NOT_SUPPORTED nếu target trả lỗi lệnh không hợp lệ.
+ */
+static esp_err_t diff_with_stub(uint32_t offset, uint32_t size, const uint8_t* expected,
+                                std::vector<bool>& out_changed)
+{
+    const uint32_t sectors = out_changed.size();
+    const uint32_t payload[4] = { offset, size, SECTOR_MAP_SECTOR_SIZE, SECTOR_MAP_DIGEST_LEN };
+    const uint8_t header[8] = { 0x00, SECTOR_MAP_CMD, sizeof(payload), 0, 0, 0, 0, 0 };
+    const uint8_t end = SLIP_END;
+
+    loader_port_start_timer(CMD_TIMEOUT_MS);
+    if (loader_port_write(&end, 1, loader_port_remaining_time()) != ESP_LOADER_SUCCESS ||
+        slip_write(header, sizeof(header)) != ESP_LOADER_SUCCESS ||
+        slip_write((const uint8_t*)payload, sizeof(payload)) != ESP_LOADER_SUCCESS ||
+        loader_port_write(&end, 1, loader_port_remaining_time()) != ESP_LOADER_SUCCESS) {
+        return ESP_FAIL;
+    }
+
+    // Header response: direction(1) | command(1) | size(2) | value(4)
+    uint8_t resp[8];
+    if (slip_wait_frame(&resp[0]) != ESP_LOADER_SUCCESS || slip_read(&resp[1], sizeof(resp) - 1) != ESP_LOADER_SUCCESS) {
+        return ESP_ERR_TIMEOUT;
+    }
+    uint16_t data_size = resp[2] | (resp[3] << 8);
+    if (resp[0] != 0x01 || resp[1] != SECTOR_MAP_CMD) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    // Lệnh không được hỗ trợ: chỉ có các byte trạng thái (2 hoặc 4 byte), status[0] != 0
+    if (data_size != sectors * SECTOR_MAP_DIGEST_LEN + 2) {
+        uint8_t status[4] = { 0 };
+        slip_read(status, data_size < sizeof(status) ? data_size : sizeof(status));
+        ESP_LOGI(TAG, "Target has no sector map command (status=%u err=0x%02x)", status[0], status[1]);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    for (uint32_t i = 0; i < sectors; i++) {
+        uint8_t digest[SECTOR_MAP_DIGEST_LEN];
+        if (slip_read(digest, sizeof(digest)) != ESP_LOADER_SUCCESS) {
+            return ESP_ERR_TIMEOUT;
+        }
+        out_changed[i] = memcmp(digest, &expected[i * ESP_ROM_MD5_DIGEST_LEN], SECTOR_MAP_DIGEST_LEN) != 0;
+    }
+
+    uint8_t status[2];
+    if (slip_read(status, sizeof(status)) != ESP_LOADER_SUCCESS || status[0] != 0) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static void md5_to_hex(const uint8_t* digest, char* out)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int b = 0; b < ESP_ROM_MD5_DIGEST_LEN; b++) {
+        out[b * 2] = hex[digest[b] >> 4];
+        out[b * 2 + 1] = hex[digest[b] & 0xF];
+    }
+    out[ESP_ROM_MD5_DIGEST_LEN * 2] = '\0';
+}
+
+// MD5 của sector [first, first + count) trong ảnh, phần thừa cuối ảnh đệm 0xFF như sau khi ghi
+static esp_err_t region_md5_from_file(sd_raw_file_t& file, uint32_t file_offset, uint32_t size,
+                                      uint32_t first, uint32_t count, uint8_t* buffer, uint8_t* out)
+{
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    sd_raw_seek(file, file_offset + first * SECTOR_MAP_SECTOR_SIZE);
+    for (uint32_t i = first; i < first + count; i++) {
+        uint32_t pos = i * SECTOR_MAP_SECTOR_SIZE;
+        size_t want = size - pos < SECTOR_MAP_SECTOR_SIZE ? size - pos : SECTOR_MAP_SECTOR_SIZE;
+        if (sd_raw_read(file, buffer, want) != want) {
+            return ESP_FAIL;
+        }
+        memset(buffer + want, 0xFF, SECTOR_MAP_SECTOR_SIZE - want);
+        esp_rom_md5_update(&ctx, buffer, SECTOR_MAP_SECTOR_SIZE);
+    }
+    esp_rom_md5_final(out, &ctx);
+    return ESP_OK;
+}
+
+// 1 lệnh SPI_FLASH_MD5 cho [first, first + count) sector
+static esp_err_t probe_region(uint32_t offset, uint32_t first, uint32_t count, const uint8_t* digest, bool& changed)
+{
+    char md5_ascii[ESP_ROM_MD5_DIGEST_LEN * 2 + 1];
+    md5_to_hex(digest, md5_ascii);
+
+    uint32_t addr = offset + first * SECTOR_MAP_SECTOR_SIZE;
+    int64_t start = esp_timer_get_time();
+    esp_loader_error_t err = esp_loader_flash_verify_known_md5(addr, count * SECTOR_MAP_SECTOR_SIZE,
+                                                               (const uint8_t*) md5_ascii);
+    trace_log(TRACE_REGION_MD5, addr, count, (uint32_t) (esp_timer_get_time() - start));
+    if (err != ESP_LOADER_SUCCESS && err != ESP_LOADER_ERROR_INVALID_MD5) {
+        ESP_LOGW(TAG, "MD5 of 0x%08" PRIx32 " (+%" PRIu32 " sectors) failed (err=%d)", addr, count, err);
+        return ESP_FAIL;
+    }
+    changed = (err == ESP_LOADER_ERROR_INVALID_MD5);
+    return ESP_OK;
+}
+
+/*
+ * Fallback khi target không có SECTOR_MAP_CMD: vùng [0, sectors) đã biết là khác,
+ * chia đôi theo chiều rộng và chỉ hỏi MD5 của nửa trái - nửa trái khớp thì nửa phải chắc chắn khác.
+ * 1 sector lấy MD5 từ bảng, vùng lớn hơn băm lại từ file. Hết ngân sách lệnh -> vùng còn lại coi như khác
+ * (ảnh đổi rải rác khắp nơi: ghi lại rẻ hơn tiếp tục hỏi).
+ */
+static esp_err_t diff_by_bisect(sd_raw_file_t& file, uint32_t file_offset, uint32_t size, uint32_t offset,
+                                const uint8_t* expected, std::vector<bool>& out_changed, uint32_t& probes)
+{
+    const uint32_t sectors = out_changed.size();
+    uint32_t budget = sectors / SECTOR_MAP_BISECT_BUDGET_DIV;
+    if (budget < SECTOR_MAP_BISECT_MIN_BUDGET) budget = SECTOR_MAP_BISECT_MIN_BUDGET;
+
+    uint8_t* buffer = (uint8_t*) heap_caps_malloc(SECTOR_MAP_SECTOR_SIZE, MALLOC_CAP_DMA);
+    if (!buffer) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Hàng đợi các vùng (sector đầu, số sector) đã biết là khác
+    std::vector<std::pair<uint32_t, uint32_t>> pending = { { 0, sectors } };
+    esp_err_t ret = ESP_OK;
+    for (size_t head = 0; head < pending.size() && ret == ESP_OK; head++) {
+        const uint32_t first = pending[head].first;
+        const uint32_t count = pending[head].second;
+        if (count == 1 || probes >= budget) {
+            continue; // out_changed mặc định true
+        }
+
+        const uint32_t half = count / 2;
+        const std::pair<uint32_t, uint32_t> halves[2] = { { first, half }, { first + half, count - half } };
+        bool left_changed = true;
+        for (int h = 0; h < 2 && ret == ESP_OK; h++) {
+            const uint32_t sub_first = halves[h].first;
+            const uint32_t sub_count = halves[h].second;
+            bool changed = true;
+            if (h == 1 && !left_changed) {
+                changed = true; // Cả vùng khác mà nửa trái khớp
+            } else if (probes < budget) {
+                uint8_t digest[ESP_ROM_MD5_DIGEST_LEN];
+                const uint8_t* want = &expected[sub_first * ESP_ROM_MD5_DIGEST_LEN];
+                if (sub_count > 1) {
+                    ret = region_md5_from_file(file, file_offset, size, sub_first, sub_count, buffer, digest);
+                    want = digest;
+                }
+                if (ret == ESP_OK) {
+                    probes++;
+                    ret = probe_region(offset, sub_first, sub_count, want, changed);
+                }
+            }
+            if (h == 0) left_changed = changed;
+
+            if (!changed) {
+                for (uint32_t i = sub_first; i < sub_first + sub_count; i++) out_changed[i] = false;
+            } else {
+                pending.push_back(halves[h]);
+            }
+        }
+    }
+
+    free(buffer);
+    sd_raw_seek(file, file_offset);
+    return ret;
+}
+
+esp_err_t sector_map_diff(sd_raw_file_t& file, uint32_t file_offset, uint32_t size, uint32_t offset,
+                          const uint8_t* expected_md5, const char* image_md5, std::vector<bool>& out_changed)
+{
+    if (offset % SECTOR_MAP_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint32_t sectors = (size + SECTOR_MAP_SECTOR_SIZE - 1) / SECTOR_MAP_SECTOR_SIZE;
+    out_changed.assign(sectors, true);
+
+    // --- BƯỚC 1: CẢ ẢNH 1 LỆNH MD5 (trường hợp phổ biến: target đã có đúng ảnh) ---
+    uint32_t probes = 0;
+    if (image_md5 && strlen(image_md5) == ESP_ROM_MD5_DIGEST_LEN * 2) {
+        esp_loader_error_t err = esp_loader_flash_verify_known_md5(offset, size, (const uint8_t*) image_md5);
+        probes++;
+        if (err == ESP_LOADER_SUCCESS) {
+            out_changed.assign(sectors, false);
+            ESP_LOGI(TAG, "0x%08" PRIx32 ": image unchanged (1 MD5)", offset);
+            return ESP_OK;
+        }
+        if (err != ESP_LOADER_ERROR_INVALID_MD5) {
+            return ESP_FAIL;
+        }
+    }
+
+    // --- BƯỚC 2: MD5 MONG ĐỢI CỦA TỪNG SECTOR (phần thừa cuối ảnh là 0xFF như sau khi ghi) ---
+    // Pack đã có sẵn bảng MD5 block -> không phải đọc thẻ SD
+    std::vector<uint8_t> computed;
+    const uint8_t* expected = expected_md5;
+    uint8_t whole_md5[ESP_ROM_MD5_DIGEST_LEN];
+    bool whole_known = false;
+    if (!expected) {
+        computed.resize(sectors * ESP_ROM_MD5_DIGEST_LEN);
+        uint8_t* buffer = (uint8_t*) heap_caps_malloc(SECTOR_MAP_SECTOR_SIZE, MALLOC_CAP_DMA);
+        if (!buffer) {
+            return ESP_ERR_NO_MEM;
+        }
+        // Cùng lượt đọc: MD5 cả vùng (đã đệm), dùng cho bước chia đôi nếu không biết MD5 ảnh
+        md5_context_t whole;
+        esp_rom_md5_init(&whole);
+        sd_raw_seek(file, file_offset);
+        uint32_t remaining = size;
+        for (uint32_t i = 0; i < sectors; i++) {
+            size_t want = remaining < SECTOR_MAP_SECTOR_SIZE ? remaining : SECTOR_MAP_SECTOR_SIZE;
+            size_t n = sd_raw_read(file, buffer, want);
+            memset(buffer + n, 0xFF, SECTOR_MAP_SECTOR_SIZE - n);
+            remaining -= want;
+
+            md5_context_t ctx;
+            esp_rom_md5_init(&ctx);
+            esp_rom_md5_update(&ctx, buffer, SECTOR_MAP_SECTOR_SIZE);
+            esp_rom_md5_final(&computed[i * ESP_ROM_MD5_DIGEST_LEN], &ctx);
+            esp_rom_md5_update(&whole, buffer, SECTOR_MAP_SECTOR_SIZE);
+        }
+        esp_rom_md5_final(whole_md5, &whole);
+        whole_known = true;
+        free(buffer);
+        sd_raw_seek(file, file_offset);
+        expected = computed.data();
+    }
+
+    // --- BƯỚC 3: HỎI TARGET ---
+    esp_err_t ret = ESP_ERR_NOT_SUPPORTED;
+    if (s_map_supported != 0) {
+        ret = diff_with_stub(offset, sectors * SECTOR_MAP_SECTOR_SIZE, expected, out_changed);
+        if (s_map_supported == -1) {
+            s_map_supported = (ret == ESP_OK) ? 1 : 0;
+        }
+    }
+    if (ret != ESP_OK) {
+        out_changed.assign(sectors, true);
+        bool whole_changed = true; // Bước 1 đã hỏi MD5 cả ảnh -> chắc chắn khác
+        ret = ESP_OK;
+        if (probes == 0) {
+            if (!whole_known) {
+                uint8_t* buffer = (uint8_t*) heap_caps_malloc(SECTOR_MAP_SECTOR_SIZE, MALLOC_CAP_DMA);
+                ret = buffer ? region_md5_from_file(file, file_offset, size, 0, sectors, buffer, whole_md5) : ESP_ERR_NO_MEM;
+                free(buffer);
+                sd_raw_seek(file, file_offset);
+            }
+            if (ret == ESP_OK) {
+                probes++;
+                ret = probe_region(offset, 0, sectors, whole_md5, whole_changed);
+            }
+        }
+        if (ret == ESP_OK && !whole_changed) {
+            out_changed.assign(sectors, false);
+        } else if (ret == ESP_OK) {
+            ret = diff_by_bisect(file, file_offset, size, offset, expected, out_changed, probes);
+        }
+    }
+
+    if (ret == ESP_OK) {
+        uint32_t changed = 0;
+        for (bool c : out_changed) changed += c ? 1 : 0;
+        if (s_map_supported == 1) {
+            ESP_LOGI(TAG, "0x%08" PRIx32 ": %" PRIu32 "/%" PRIu32 " sectors differ (stub map)", offset, changed, sectors);
+        } else {
+            ESP_LOGI(TAG, "0x%08" PRIx32 ": %" PRIu32 "/%" PRIu32 " sectors differ (%" PRIu32 " region MD5)",
+                     offset, changed, sectors, probes);
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,43 @@
+#ifndef __SECTOR_MAP_H__
+#define __SECTOR_MAP_H__
+
+#include "../sd_card/sd_raw.h"
+#include <vector>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define SECTOR_MAP_SECTOR_SIZE  4096    // Kích thước sector flash của target
+#define SECTOR_MAP_DIGEST_LEN   8       // Số byte MD5 (cắt ngắn) cho mỗi sector trong bảng
+
+/*
+ * Lệnh mở rộng cho flasher stub: SPI_FLASH_SECTOR_MD5_MAP.
+ *   Request data : addr(u32) | size(u32) | sector_size(u32) | digest_len(u32)
+ *   Response data: N * digest_len byte (MD5 của từng sector, cắt còn digest_len byte) | status(2)
+ * ROM bootloader và stub chuẩn trả về lỗi "invalid command" -> dùng MD5 từng vùng (chia đôi).
+ */
+#define SECTOR_MAP_CMD          0xE0
+
+/**
+ * @brief Quên kết quả dò tính năng. Gọi sau mỗi lần connect target mới.
+ */
+void sector_map_reset_caps(void);
+
+/**
+ * @brief So sánh nội dung file với flash của target theo từng sector 4KB.
+ * Thứ tự: MD5 cả ảnh (1 lệnh, nếu biết image_md5) -> SECTOR_MAP_CMD nếu stub hỗ trợ
+ * (1 round trip cho cả vùng) -> MD5 từng vùng, chia đôi các vùng khác nhau với số lệnh giới hạn.
+ *
+ * @param file        File chứa ảnh đang mở (vị trí đọc được đưa về file_offset khi trả về).
+ * @param file_offset Vị trí ảnh trong file (0 với file .bin riêng, khác 0 với pack).
+ * @param size        Kích thước ảnh.
+ * @param offset      Địa chỉ nạp trên target (phải chia hết cho 4KB).
+ * @param expected_md5 MD5 từng sector 4KB (16 byte/sector, sector cuối đệm 0xFF) nếu đã biết trước
+ *                    (bảng block của pack); NULL -> đọc file để tính.
+ * @param image_md5   MD5 (ASCII, 32 ký tự) của cả ảnh nếu biết và chưa được hỏi target; NULL -> bỏ bước đầu.
+ * @param out_changed out_changed[i] = true nếu sector i cần ghi lại (vùng chưa xác định được coi là khác).
+ * @return ESP_OK nếu so sánh được; mã lỗi khác -> caller ghi lại toàn bộ.
+ */
+esp_err_t sector_map_diff(sd_raw_file_t& file, uint32_t file_offset, uint32_t size, uint32_t offset,
+                          const uint8_t* expected_md5, const char* image_md5, std::vector<bool>& out_changed);
+
+#endif // __SECTOR_MAP_H__
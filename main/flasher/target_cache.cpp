@@ -0,0 +1,118 @@
+#include <string.h>
+#include <stdio.h>
+#include <strings.h>
+#include "esp_log.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "target_cache.h"
+
+static const char *TAG = "TARGET_CACHE";
+static const char *NVS_NAMESPACE = "tgt_cache";
+
+static nvs_handle_t s_nvs = 0;
+static bool s_ready = false;
+
+// Khóa NVS tối đa 15 ký tự -> dùng MAC dạng hex 12 ký tự
+static void mac_to_key(const uint8_t mac[6], char key[13])
+{
+    snprintf(key, 13, "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+esp_err_t target_cache_init(void)
+{
+    if (s_ready) return ESP_OK;
+
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_LOGW(TAG, "NVS partition needs erase, clearing...");
+        nvs_flash_erase();
+        ret = nvs_flash_init();
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "NVS init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &s_nvs);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_ready = true;
+    return ESP_OK;
+}
+
+esp_err_t target_cache_load(const uint8_t mac[6], target_cache_entry_t& out_entry)
+{
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+
+    char key[13];
+    mac_to_key(mac, key);
+    size_t len = sizeof(out_entry);
+    esp_err_t ret = nvs_get_blob(s_nvs, key, &out_entry, &len);
+    if (ret != ESP_OK || len != sizeof(out_entry) || out_entry.version != TARGET_CACHE_VERSION) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    ESP_LOGI(TAG, "Known target %s (chip=%u)", key, out_entry.chip);
+    return ESP_OK;
+}
+
+esp_err_t target_cache_store(const uint8_t mac[6], const target_cache_entry_t& entry)
+{
+    if (!s_ready) return ESP_ERR_INVALID_STATE;
+
+    char key[13];
+    mac_to_key(mac, key);
+    esp_err_t ret = nvs_set_blob(s_nvs, key, &entry, sizeof(entry));
+    if (ret == ESP_ERR_NVS_NOT_ENOUGH_SPACE) {
+        // Cache chỉ là tối ưu: đầy thì bỏ hết các target cũ
+        ESP_LOGW(TAG, "NVS full, dropping all cached targets");
+        nvs_erase_all(s_nvs);
+        ret = nvs_set_blob(s_nvs, key, &entry, sizeof(entry));
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(s_nvs);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to store target %s: %s", key, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+bool target_cache_has_segment(const target_cache_entry_t& entry, uint32_t offset, uint32_t size,
+                              const std::string& md5)
+{
+    return size != 0 && target_cache_segment_size(entry, offset, md5) == size;
+}
+
+uint32_t target_cache_segment_size(const target_cache_entry_t& entry, uint32_t offset, const std::string& md5)
+{
+    if (md5.length() != 32) return 0;
+
+    for (const auto& seg : entry.segments) {
+        if (seg.md5[0] != '\0' && seg.offset == offset) {
+            return strncasecmp(seg.md5, md5.c_str(), 32) == 0 ? seg.size : 0;
+        }
+    }
+    return 0;
+}
+
+void target_cache_set_segment(target_cache_entry_t& entry, uint32_t offset, uint32_t size,
+                              const std::string& md5)
+{
+    target_segment_record_t* slot = NULL;
+    for (auto& seg : entry.segments) {
+        if (seg.md5[0] != '\0' && seg.offset == offset) { slot = &seg; break; }
+        if (seg.md5[0] == '\0' && slot == NULL) slot = &seg;
+    }
+    if (slot == NULL) slot = &entry.segments[TARGET_CACHE_MAX_SEGMENTS - 1];
+
+    slot->offset = offset;
+    slot->size = size;
+    if (md5.length() == 32) {
+        memcpy(slot->md5, md5.c_str(), 32);
+        slot->md5[32] = '\0';
+    } else {
+        slot->md5[0] = '\0';
+    }
+}
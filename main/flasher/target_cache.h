@@ -0,0 +1,64 @@
+#ifndef __TARGET_CACHE_H__
+#define __TARGET_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+#include "esp_err.h"
+
+#define TARGET_CACHE_MAX_SEGMENTS 4     // bootloader, partition, app (+1 dự phòng)
+#define TARGET_CACHE_VERSION      2     // Tăng khi đổi layout struct -> entry cũ bị bỏ qua
+
+/*
+ * @brief Nội dung đã ghi tại 1 địa chỉ trên target.
+ */
+typedef struct {
+    uint32_t offset;        // Địa chỉ nạp
+    uint32_t size;          // Kích thước ảnh đã ghi
+    char     md5[33];       // MD5 (ASCII, giống index.txt) của ảnh đã ghi, "" nếu slot trống
+} target_segment_record_t;
+
+/*
+ * @brief Thông tin lưu trong NVS cho 1 target, khóa theo MAC.
+ */
+typedef struct {
+    uint8_t  version;
+    uint8_t  chip;          // target_chip_t
+    target_segment_record_t segments[TARGET_CACHE_MAX_SEGMENTS];
+} target_cache_entry_t;
+
+/**
+ * @brief Mở NVS namespace của cache. Gọi 1 lần lúc khởi động.
+ */
+esp_err_t target_cache_init(void);
+
+/**
+ * @brief Đọc entry của target theo MAC.
+ * @return ESP_ERR_NOT_FOUND nếu chưa từng gặp target này (hoặc entry sai version).
+ */
+esp_err_t target_cache_load(const uint8_t mac[6], target_cache_entry_t& out_entry);
+
+/**
+ * @brief Ghi entry của target. Khi NVS đầy, xóa toàn bộ cache rồi ghi lại.
+ */
+esp_err_t target_cache_store(const uint8_t mac[6], const target_cache_entry_t& entry);
+
+/**
+ * @brief Entry có ghi nhận đúng ảnh (size + md5) tại offset không.
+ * Chỉ là gợi ý: caller vẫn phải xác nhận bằng 1 lệnh MD5 trên target.
+ */
+bool target_cache_has_segment(const target_cache_entry_t& entry, uint32_t offset, uint32_t size,
+                              const std::string& md5);
+
+/**
+ * @brief Kích thước ảnh có MD5 md5 đã ghi tại offset theo entry, 0 nếu không ghi nhận.
+ * Ảnh cùng nội dung (cùng blob) -> cùng MD5: biết size để hỏi MD5 target mà không cần mở file.
+ */
+uint32_t target_cache_segment_size(const target_cache_entry_t& entry, uint32_t offset, const std::string& md5);
+
+/**
+ * @brief Ghi nhận ảnh vừa nạp tại offset (md5 rỗng = nội dung không rõ, xóa slot).
+ */
+void target_cache_set_segment(target_cache_entry_t& entry, uint32_t offset, uint32_t size,
+                              const std::string& md5);
+
+#endif // __TARGET_CACHE_H__
@@ -0,0 +1,215 @@
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "../sd_card/sd_card.h"
+#include "trace_log.h"
+
+static const char *TAG = "TRACE";
+
+// Ưu tiên thấp nhất (bảng task trong main.cpp): chỉ in khi đường nạp, UI, storage đều đang chờ
+#define TRACE_TASK_STACK    3072
+#define TRACE_TASK_PRIORITY 1
+#define TRACE_FLUSH_MS      200
+#define TRACE_TEXT_LEN      sizeof(((trace_record_t*) 0)->args)
+
+// Format của từng trace_msg_t; tham số luôn là 3 số 32 bit không dấu
+static const char* const s_formats[TRACE_MSG_COUNT] = {
+    "block 0x%08x: esp_loader_flash_write %u us, %u%%",
+    "block 0x%08x: %u bytes from SD in %u us",
+    "block 0x%08x: %u bytes from RAM cache",
+    "region 0x%08x: MD5 of %u sector(s) in %u us",
+    "loader: %s",
+};
+
+static trace_record_t* s_ring = NULL;
+static uint32_t        s_capacity = 0;
+static uint32_t        s_head = 0;      // Tổng số record đã ghi (vị trí = s_head % s_capacity)
+static uint32_t        s_tail = 0;      // Tổng số record đã lấy ra
+static uint32_t        s_seq = 0;
+static uint32_t        s_dropped = 0;
+static portMUX_TYPE    s_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void trace_log(trace_msg_t id, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    if (!s_ring) return;
+    trace_record_t rec = { (uint32_t) esp_timer_get_time(), (uint16_t) id, 0, { a0, a1, a2 } };
+
+    portENTER_CRITICAL(&s_lock);
+    rec.seq = (uint16_t) s_seq++;
+    if (s_head - s_tail < s_capacity) {
+        s_ring[s_head % s_capacity] = rec;
+        s_head++;
+    } else {
+        s_dropped++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+static bool pop(trace_record_t* out)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_tail != s_head) {
+        *out = s_ring[s_tail % s_capacity];
+        s_tail++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&s_lock);
+    return ok;
+}
+
+static uint32_t take_dropped()
+{
+    portENTER_CRITICAL(&s_lock);
+    uint32_t n = s_dropped;
+    s_dropped = 0;
+    portEXIT_CRITICAL(&s_lock);
+    return n;
+}
+
+// Chuỗi của esp_loader: cắt thành các record TRACE_LOADER_TEXT 12 byte, record cuối có '\0'
+static void trace_text(const char* str)
+{
+    size_t len = strlen(str);
+    for (size_t off = 0; ; off += TRACE_TEXT_LEN) {
+        uint32_t args[3] = { 0, 0, 0 };
+        size_t n = std::min(len - off, TRACE_TEXT_LEN);
+        memcpy(args, str + off, n);
+        trace_log(TRACE_LOADER_TEXT, args[0], args[1], args[2]);
+        if (n < TRACE_TEXT_LEN) break;
+    }
+}
+
+// loader_port_debug_print của esp-serial-flasher in thẳng ra console (vd. 5 dòng cho mỗi sector
+// MD5 khác khi dò sector map không có stub). main/CMakeLists.txt bọc hàm này (-Wl,--wrap).
+extern "C" {
+void __real_loader_port_debug_print(const char* str);
+
+void __wrap_loader_port_debug_print(const char* str)
+{
+    if (s_ring) {
+        trace_text(str);
+    } else {
+        __real_loader_port_debug_print(str);
+    }
+}
+}
+
+#if !CONFIG_TRACE_LOG_SD_DUMP
+// Định dạng và in các record đang chờ
+static void trace_task(void* arg)
+{
+    char text[64];
+    size_t text_len = 0;
+    char line[96];
+
+    for (;;) {
+        vTaskDelay(pdMS_TO_TICKS(TRACE_FLUSH_MS));
+        trace_record_t rec;
+        while (pop(&rec)) {
+            if (rec.id >= TRACE_MSG_COUNT) continue;
+            if (rec.id == TRACE_LOADER_TEXT) {
+                const char* chunk = (const char*) rec.args;
+                size_t n = strnlen(chunk, TRACE_TEXT_LEN);
+                size_t room = sizeof(text) - 1 - text_len;
+                memcpy(text + text_len, chunk, std::min(n, room));
+                text_len += std::min(n, room);
+                if (n == TRACE_TEXT_LEN) continue; // Chuỗi còn tiếp ở record sau
+                text[text_len] = '\0';
+                text_len = 0;
+                snprintf(line, sizeof(line), s_formats[rec.id], text);
+            } else {
+                snprintf(line, sizeof(line), s_formats[rec.id], (unsigned) rec.args[0], (unsigned) rec.args[1],
+                         (unsigned) rec.args[2]);
+            }
+            ESP_LOGI(TAG, "[%u.%03u ms] %s", (unsigned) (rec.time_us / 1000), (unsigned) (rec.time_us % 1000), line);
+        }
+        uint32_t dropped = take_dropped();
+        if (dropped) {
+            ESP_LOGW(TAG, "%u record(s) dropped, buffer full (CONFIG_TRACE_LOG_RECORDS)", (unsigned) dropped);
+        }
+    }
+}
+#endif
+
+esp_err_t trace_log_init(void)
+{
+#if CONFIG_TRACE_LOG_RECORDS > 0
+    if (s_ring) return ESP_OK;
+    s_ring = (trace_record_t*) heap_caps_malloc(CONFIG_TRACE_LOG_RECORDS * sizeof(trace_record_t), MALLOC_CAP_8BIT);
+    if (!s_ring) {
+        ESP_LOGE(TAG, "Failed to allocate %d trace records", CONFIG_TRACE_LOG_RECORDS);
+        return ESP_ERR_NO_MEM;
+    }
+    s_capacity = CONFIG_TRACE_LOG_RECORDS;
+#if !CONFIG_TRACE_LOG_SD_DUMP
+    if (xTaskCreate(trace_task, "trace_log", TRACE_TASK_STACK, NULL, TRACE_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create trace task!");
+        heap_caps_free(s_ring);
+        s_ring = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+#endif
+    return ESP_OK;
+}
+
+#if CONFIG_TRACE_LOG_SD_DUMP
+static bool write_u16(File& f, uint16_t v)
+{
+    return f.write((const uint8_t*) &v, sizeof(v)) == sizeof(v);
+}
+
+static bool write_u32(File& f, uint32_t v)
+{
+    return f.write((const uint8_t*) &v, sizeof(v)) == sizeof(v);
+}
+#endif
+
+esp_err_t trace_log_dump(void)
+{
+#if CONFIG_TRACE_LOG_SD_DUMP
+    if (!s_ring || !g_is_sd_mounted) return ESP_ERR_INVALID_STATE;
+
+    portENTER_CRITICAL(&s_lock);
+    uint32_t count = s_head - s_tail; // Record ghi thêm trong lúc dump để lần sau
+    portEXIT_CRITICAL(&s_lock);
+    if (count == 0) return ESP_OK;
+
+    File f = g_sd_fs.open(TRACE_LOG_DUMP_PATH, FILE_APPEND, true);
+    if (!f) {
+        ESP_LOGE(TAG, "Cannot open %s", TRACE_LOG_DUMP_PATH);
+        return ESP_FAIL;
+    }
+
+    // Khối tự mô tả: magic, kích thước record, bảng format, rồi các record
+    bool ok = f.write((const uint8_t*) "TRC1", 4) == 4 && write_u16(f, sizeof(trace_record_t)) &&
+              write_u16(f, TRACE_MSG_COUNT);
+    for (int i = 0; ok && i < TRACE_MSG_COUNT; i++) {
+        uint16_t len = strlen(s_formats[i]);
+        ok = write_u16(f, len) && f.write((const uint8_t*) s_formats[i], len) == len;
+    }
+    ok = ok && write_u32(f, count);
+    trace_record_t rec;
+    for (uint32_t i = 0; ok && i < count && pop(&rec); i++) {
+        ok = f.write((const uint8_t*) &rec, sizeof(rec)) == sizeof(rec);
+    }
+    f.close();
+
+    uint32_t dropped = take_dropped();
+    if (!ok) {
+        ESP_LOGE(TAG, "Write to %s failed", TRACE_LOG_DUMP_PATH);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "%u record(s) -> %s (%u dropped)", (unsigned) count, TRACE_LOG_DUMP_PATH, (unsigned) dropped);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
@@ -0,0 +1,63 @@
+/**
+ * @file trace_log.h
+ * @brief Log trì hoãn (nhị phân) cho đường nạp: vòng lặp ghi block, sector map, esp_loader.
+ *
+ * ESP_LOGI trên console UART0 115200 baud tốn ~4 ms cho mỗi dòng ngắn và chặn chính task
+ * đang nạp. trace_log() chỉ chép 1 record 20 byte (thời điểm, id thông điệp, 3 tham số)
+ * vào ring buffer trong RAM; việc định dạng chuỗi để sau:
+ *   - mặc định: task "trace_log" (ưu tiên thấp nhất) in ra console khi CPU rảnh;
+ *   - CONFIG_TRACE_LOG_SD_DUMP: cuối mỗi phiên nạp, record được ghi nguyên dạng nhị phân
+ *     vào TRACE_LOG_DUMP_PATH trên thẻ SD để giải mã offline.
+ *
+ * File dump (little-endian), mỗi lần dump nối thêm 1 khối:
+ *   "TRC1" | u16 kích thước record | u16 số thông điệp
+ *   | số thông điệp x (u16 độ dài + chuỗi format printf, không '\0')
+ *   | u32 số record | các record trace_record_t
+ * Khối tự mô tả: không cần firmware để giải mã. Thông điệp TRACE_LOADER_TEXT mang
+ * 12 byte văn bản trong args, chuỗi dài nối qua nhiều record liên tiếp cho tới record có '\0'.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define TRACE_LOG_DUMP_PATH "/trace.bin"
+
+/**
+ * @brief Id thông điệp. Chỉ thêm vào cuối (file dump cũ vẫn giải mã được nhờ bảng format kèm theo).
+ */
+typedef enum {
+    TRACE_BLOCK_WRITTEN = 0,    // address, us trong esp_loader_flash_write, % của segment
+    TRACE_BLOCK_SD_READ,        // address, bytes, us
+    TRACE_BLOCK_RAM_HIT,        // address, bytes
+    TRACE_REGION_MD5,           // address, sectors, us (sector_map: 1 lệnh MD5 cho 1 vùng)
+    TRACE_LOADER_TEXT,          // 12 byte văn bản của loader_port_debug_print
+    TRACE_MSG_COUNT
+} trace_msg_t;
+
+/**
+ * @brief 1 record trong ring buffer / file dump.
+ */
+typedef struct {
+    uint32_t time_us;   // esp_timer_get_time() (32 bit thấp, quay vòng sau ~71 phút)
+    uint16_t id;        // trace_msg_t
+    uint16_t seq;       // Số thứ tự (16 bit thấp): lỗ hổng = record bị bỏ vì buffer đầy
+    uint32_t args[3];
+} trace_record_t;
+
+/**
+ * @brief Cấp ring buffer (CONFIG_TRACE_LOG_RECORDS record) và tạo task định dạng. Gọi nhiều lần không sao.
+ */
+esp_err_t trace_log_init(void);
+
+/**
+ * @brief Ghi 1 record (không định dạng, không chặn). Buffer đầy -> bỏ record, đếm số bị bỏ.
+ */
+void trace_log(trace_msg_t id, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0);
+
+/**
+ * @brief Nối các record đang chờ vào file dump trên thẻ SD rồi xóa khỏi buffer.
+ * Chỉ có tác dụng khi bật CONFIG_TRACE_LOG_SD_DUMP và thẻ đang mount.
+ */
+esp_err_t trace_log_dump(void);
@@ -14,6 +14,8 @@
 // 1. ESP-IDF DRIVERS & LIBRARIES
 // ============================================================
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
 #include "driver/uart.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -22,8 +24,14 @@
 // 2. PROJECT MODULES (THƯ VIỆN DỰ ÁN)
 // ============================================================
 #include "sd_card/sd_card.h"  // Quản lý file system trên thẻ SD
+#include "sd_card/sd_index.h" // Danh sách firmware (benchmark)
+#include "sd_card/sd_raw.h"   // Đọc file firmware theo sector (benchmark)
+#include "sd_card/sd_crc.h"   // CRC bus SD (benchmark)
+#include "sd_card/sd_service.h" // Task storage: hot-plug thẻ SD
 #include "flasher/flasher.h"  // Lõi xử lý nạp firmware (Flasher Core)
 #include "oled/menu.h"        // Giao diện người dùng trên OLED
+#include "oled/progress.h"    // Màn hình tiến trình nạp (vẽ theo page, ~10 Hz)
+#include "flasher/production.h" // Chế độ sản xuất (fixture, không cần bấm nút)
 
 // ============================================================
 // 3. DEFINITIONS & CONSTANTS (ĐỊNH NGHĨA & HẰNG SỐ)
@@ -33,6 +41,30 @@ static const char *TAG = "MAIN_APP"; // Tag log chính cho ứng dụng
 #define SD_CS_PIN   GPIO_NUM_7       // Chân Chip Select cho thẻ SD
 #define BUF_LEN     128              // Độ dài buffer tạm (nếu dùng)
 
+/*
+ * Các task của Host (ESP32-C3 1 nhân: ưu tiên quyết định ai chạy trước).
+ *
+ *   Task          Ưu tiên  Stack   Việc
+ *   buttons       7        2560    Ngắt GPIO nút nhấn -> sự kiện nhấn/nhả/lặp/giữ (oled/buttons.cpp)
+ *   sd_readahead  6        3072    Đọc trước sector cho phiên nạp (sd_raw.cpp)
+ *   flasher       5        8192    Phiên nạp/xóa: UART + thẻ SD (flasher.cpp), tạo mỗi phiên
+ *   ui            4        4096    Nút nhấn, menu, OLED, chế độ sản xuất (loop() bên dưới)
+ *   storage       3        4096    Hot-plug thẻ SD: mount, dựng catalog (sd_service.cpp)
+ *   trace_log     1        3072    In log trì hoãn của đường nạp (flasher/trace_log.cpp)
+ *
+ * flasher -> ui: queue sự kiện + event group BUSY/CANCEL; PROGRESS bị bỏ khi UI chưa kịp đọc,
+ * nên vẽ OLED không bao giờ chặn đường dữ liệu. storage -> ui: queue sự kiện hot-plug;
+ * phiên nạp tạm dừng storage (event group PAUSE/IDLE) để mount không chen vào bus SPI.
+ * UI chỉ bị flasher chiếm CPU trong lúc tính MD5/so sector, còn lại flasher chờ UART/DMA.
+ */
+#define UI_TASK_STACK       4096
+#define UI_TASK_PRIORITY    4
+
+// UI chặn trên queue nút (menu_update) thay vì delay cố định; hết giờ chờ -> xem sự kiện
+// của task nạp / task storage. Đang nạp chờ ngắn hơn để tiến trình được vẽ đều.
+#define UI_WAIT_IDLE_MS     100
+#define UI_WAIT_BUSY_MS     20
+
 // ============================================================
 // 4. GLOBAL OBJECTS & VARIABLES (BIẾN TOÀN CỤC)
 // ============================================================
@@ -45,10 +77,139 @@ static uint8_t buf[BUF_LEN] = {0};
 // Handle cho task giám sát (nếu triển khai sau này)
 TaskHandle_t monitor_task_handle = NULL;
 
+static bool s_menu_ready = false;       // Đã có catalog và menu trên OLED
+
+// Nhịp dây chuyền: Host chạy liên tục qua các unit, units/giờ tính từ phiên đầu tiên
+static uint32_t s_units_done = 0;
+static int64_t  s_first_session_us = 0;
+static int64_t  s_session_start_us = 0;
+
 // ============================================================
 // 5. MAIN FUNCTIONS IMPLEMENTATION
 // ============================================================
 
+/**
+ * @brief  Provider cho menu: đọc 1 mục menu từ module SD.
+ */
+static bool menu_item_from_sd(int index, menu_item_t* out) {
+    std::string label, fw_id;
+    bool stale = false;
+    if (sd_menu_get_item(index, label, fw_id, &stale) != ESP_OK) {
+        return false;
+    }
+    if (fw_id.size() >= sizeof(out->id)) {
+        ESP_LOGW(TAG, "fw_id qua dai (%u ky tu): %s", (unsigned) fw_id.size(), fw_id.c_str());
+        return false;
+    }
+    snprintf(out->label, sizeof(out->label), "%s", label.c_str());
+    snprintf(out->id, sizeof(out->id), "%s", fw_id.c_str());
+    out->stale = stale;
+    return true;
+}
+
+static const menu_provider_t s_menu_provider = { menu_item_from_sd, sd_menu_group_start };
+
+/**
+ * @brief  Báo lỗi thẻ SD trên OLED. Không dừng hệ thống: loop() tự thử lại khi thẻ được gắn/thay.
+ */
+static void show_sd_error(esp_err_t err) {
+    if (err == ESP_ERR_INVALID_SIZE) {
+        ESP_LOGE(TAG, "[ERROR] The SD qua cham, hay thay the khac!");
+        oled_show_message("ERROR", "SD Card Too Slow!");
+    } else if (err == ESP_ERR_NOT_FOUND || err == ESP_ERR_INVALID_ARG) {
+        ESP_LOGE(TAG, "[ERROR] Khong doc duoc index.txt!");
+        oled_show_message("ERROR", "Bad index.txt!");
+    } else {
+        ESP_LOGE(TAG, "[ERROR] Mount SD Card that bai!");
+        oled_show_message("Insert SD card", "Waiting...");
+    }
+}
+
+/**
+ * @brief  Dựng (lại) menu từ catalog vừa tải.
+ */
+static void start_menu() {
+    // Số mục menu; từng dòng được đọc từ chỉ mục khi menu vẽ tới
+    int menuLength = sd_menu_count();
+
+    // Kiểm tra tính hợp lệ của dữ liệu menu
+    if (menuLength == 0) {
+        ESP_LOGE(TAG, "[ERROR] Menu rong hoac loi du lieu! Kiem tra the SD.");
+        oled_show_message("ERROR", "Menu Data Empty!");
+        s_menu_ready = false;
+        return;
+    }
+
+    // Menu lấy dữ liệu qua provider của module SD
+    menu_init(display, &s_menu_provider, menuLength);
+    s_menu_ready = true;
+}
+
+/**
+ * @brief  Thẻ SD bị rút / gắn lại: task storage đã mount lại, UI chỉ dựng lại menu khi catalog đổi.
+ */
+static void handle_sd_hotplug(sd_hotplug_event_t event, esp_err_t err) {
+    switch (event) {
+    case SD_HOTPLUG_REMOVED:
+        // Menu cũ vẫn dùng được: firmware đã nạp trước đó nằm trong cache flash nội
+        oled_show_message("SD removed", "Cached FW only");
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        if (s_menu_ready) {
+            menu_redisplay();
+        } else {
+            show_sd_error(ESP_FAIL);
+        }
+        break;
+    case SD_HOTPLUG_SAME_CATALOG:
+        if (s_menu_ready) {
+            menu_redisplay();
+        } else {
+            start_menu();
+        }
+        break;
+    case SD_HOTPLUG_NEW_CATALOG:
+        start_menu();
+        break;
+    case SD_HOTPLUG_FAILED:
+        show_sd_error(err);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief  Vào chế độ sản xuất nếu menuconfig chỉ định fw_id (CONFIG_PRODUCTION_FW_ID).
+ */
+static void start_production() {
+    if (strlen(CONFIG_PRODUCTION_FW_ID) == 0) {
+        return;
+    }
+    if (production_start(CONFIG_PRODUCTION_FW_ID) != ESP_OK) {
+        ESP_LOGE(TAG, "[ERROR] Khong vao duoc che do san xuat: %s", CONFIG_PRODUCTION_FW_ID);
+        oled_show_message("ERROR", "Prod FW missing!");
+        vTaskDelay(pdMS_TO_TICKS(2000));
+        if (s_menu_ready) {
+            menu_redisplay();
+        } else {
+            show_sd_error(ESP_FAIL);
+        }
+    }
+}
+
+/**
+ * @brief  Ghi nhận 1 phiên vừa kết thúc và in nhịp dây chuyền (units/giờ).
+ */
+static void log_throughput(bool ok) {
+    int64_t now = esp_timer_get_time();
+    if (ok) s_units_done++;
+    int64_t elapsed = now - s_first_session_us;
+    ESP_LOGD(TAG, "UI stack high-water mark: %u bytes", (unsigned) uxTaskGetStackHighWaterMark(NULL));
+    ESP_LOGI(TAG, "Unit %s in %d ms | %u units, %u units/h", ok ? "done" : "failed",
+             (int) ((now - s_session_start_us) / 1000), (unsigned) s_units_done,
+             elapsed > 0 ? (unsigned) ((int64_t) s_units_done * 3600000000LL / elapsed) : 0u);
+}
+
 /**
  * @brief  Khởi tạo hệ thống (System Setup)
  * @note   Hàm này chỉ chạy 1 lần khi khởi động.
@@ -68,49 +229,151 @@ void setup() {
     oled_show_message("Booting...", "System Init OK");
     vTaskDelay(pdMS_TO_TICKS(500));
 
-    // [3] Khởi tạo thẻ nhớ SD
-    if (sd_mount(SD_CS_PIN) != ESP_OK) {
-        ESP_LOGE(TAG, "[CRITICAL] Mount SD Card that bai!");
-        oled_show_message("ERROR", "SD Mount Failed!");
-        for (;;);
+    // [3] Khởi tạo thẻ nhớ SD và tải catalog
+    // Lỗi không còn dừng hệ thống: loop() chờ thẻ được gắn/thay rồi mount lại (hot-plug)
+    esp_err_t sd_ret = sd_mount(SD_CS_PIN);
+    if (sd_ret == ESP_OK) {
+        const sd_bus_info_t& sd_bus = sd_get_bus_info();
+        std::string sd_line = "SD " + std::to_string(sd_bus.clock_khz / 1000) + "MHz " +
+                              std::to_string(sd_bus.read_kbps) + "KB/s";
+        oled_show_message("Booting...", sd_line.c_str());
+        vTaskDelay(pdMS_TO_TICKS(500));
+
+        // [4] Tải cấu hình và Menu từ thẻ SD
+        ESP_LOGI(TAG, "Dang tai metadata va xay dung menu...");
+        sd_ret = sd_load_metadata(); // Đọc file cấu hình (vd: index.txt) để lấy danh sách FW
     }
-    oled_show_message("Booting...", "SD Card OK");
-    vTaskDelay(pdMS_TO_TICKS(500));
 
-    // [4] Tải cấu hình và Menu từ thẻ SD
-    ESP_LOGI(TAG, "Dang tai metadata va xay dung menu...");
-    sd_load_metadata(); // Đọc file cấu hình (vd: index.txt) để lấy danh sách FW
+#if CONFIG_SD_RAW_BENCHMARK
+    // Đo tốc độ đọc raw so với File::read (menuconfig -> SD Flasher Configuration)
+    for (uint32_t i = 0; sd_ret == ESP_OK && i < sd_index_count(); i++) {
+        firmware_metadata_t fw;
+        if (sd_index_get(i, fw) == ESP_OK) sd_raw_benchmark(fw.path.c_str());
+    }
+    if (sd_ret == ESP_OK) sd_crc_benchmark();
+#endif
 
-    // Lấy dữ liệu menu đã được module SD phân tích
-    int menuLength = 0;
-    const char** displayItems = sd_get_menu_display_items(menuLength);
-    const char** idItems = sd_get_menu_id_items();
+    // [5] Khởi tạo giao diện Menu
+    if (sd_ret == ESP_OK) {
+        start_menu();
+    } else {
+        sd_unmount(); // Để hot-plug thử lại từ đầu khi thẻ được thay
+        show_sd_error(sd_ret);
+    }
 
-    // Kiểm tra tính hợp lệ của dữ liệu menu
-    if (menuLength == 0 || displayItems == NULL || idItems == NULL) {
-        ESP_LOGE(TAG, "[ERROR] Menu rong hoac loi du lieu! Kiem tra the SD.");
-        oled_show_message("ERROR", "Menu Data Empty!");
-        for(;;);
+    // [6] Task storage: từ giờ thẻ SD được theo dõi ngoài task UI
+    if (sd_service_start(SD_CS_PIN) != ESP_OK) {
+        ESP_LOGE(TAG, "[ERROR] Khong tao duoc task storage, tat hot-plug.");
     }
 
-    // [5] Khởi tạo giao diện Menu
-    // Truyền dữ liệu đã lấy từ SD vào module hiển thị
-    menu_init(display, displayItems, idItems, menuLength);
+    // [7] Chế độ sản xuất (nếu cấu hình): thay menu bằng vòng dò/nạp tự động
+    start_production();
     
     ESP_LOGI(TAG, "========== SYSTEM BOOT COMPLETE ==========");
     ESP_LOGI(TAG, "Hien thi menu chinh.");
 }
 
+/**
+ * @brief  Hiển thị 1 sự kiện tiến trình từ phiên nạp chạy nền.
+ * @return true nếu đây là sự kiện kết thúc phiên (DONE/ALREADY_CURRENT/FAILED/CANCELLED).
+ */
+static bool handle_session_event(const flasher_event_t& evt) {
+    switch (evt.type) {
+    case FLASHER_EVT_CONNECTING:
+        oled_show_message("Please wait...", "Connecting...");
+        return false;
+    case FLASHER_EVT_CONNECTED:
+        oled_show_message("Please wait...", "Connected.");
+        return false;
+    case FLASHER_EVT_SEGMENT_START:
+    case FLASHER_EVT_PROGRESS:
+        // Mỗi block 1 sự kiện; widget tự bỏ bớt lần vẽ và chỉ gửi page đổi
+        oled_progress_update(evt.segment ? evt.segment : "", evt.bytes_done, evt.bytes_total);
+        return false;
+    case FLASHER_EVT_VERIFIED:
+        return false;
+    case FLASHER_EVT_ERASING:
+        oled_show_message("Erasing Chip...", "PLEASE WAIT!");
+        return false;
+    case FLASHER_EVT_CACHING:
+        oled_show_message("Please wait...", "Caching image...");
+        return false;
+    case FLASHER_EVT_DONE:
+        ESP_LOGI(TAG, ">>> THANH CONG!");
+        oled_show_message("SUCCESS!", "Operation Complete.");
+        vTaskDelay(pdMS_TO_TICKS(2000));
+        return true;
+    case FLASHER_EVT_ALREADY_CURRENT:
+        ESP_LOGI(TAG, ">>> Target da la ban moi nhat, bo qua nap.");
+        oled_show_message("UP TO DATE", "Already current.");
+        vTaskDelay(pdMS_TO_TICKS(2000));
+        return true;
+    case FLASHER_EVT_CANCELLED:
+        ESP_LOGW(TAG, ">>> DA HUY, target da reset.");
+        oled_show_message("CANCELLED", "Target reset.");
+        vTaskDelay(pdMS_TO_TICKS(2000));
+        return true;
+    case FLASHER_EVT_FAILED:
+    default:
+        ESP_LOGE(TAG, ">>> THAT BAI! err=0x%x", evt.err);
+        oled_show_message("Error", "Operation Failed!");
+        vTaskDelay(pdMS_TO_TICKS(3000)); // Giữ thông báo lỗi lâu hơn chút
+        return true;
+    }
+}
+
 /**
  * @brief  Vòng lặp chính (Main Loop)
  * @note   Xử lý logic tương tác người dùng và điều phối quy trình nạp.
+ * Việc nạp/xóa chạy trên task riêng (flasher_session_start), nên vòng lặp
+ * này vẫn đọc nút nhấn và cập nhật OLED trong suốt quá trình nạp.
  */
 void loop() {
-    // [1] Cập nhật trạng thái Menu & Nút nhấn
-    // Trả về -1 nếu chưa chọn, hoặc index >= 0 nếu đã nhấn OK
-    int selectedIndex = menu_update();
+    sd_hotplug_event_t sd_event;
+    esp_err_t sd_err = ESP_OK;
+
+    // Chế độ sản xuất: không đọc nút, máy trạng thái tự dò và nạp từng unit
+    if (production_active()) {
+        while (sd_service_poll(&sd_event, &sd_err)) {
+            // Thẻ vẫn được mount lại nền; không có menu cần dựng lại
+        }
+        production_update();
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+
+    // [0] Sự kiện từ task storage (thẻ SD bị rút/gắn lại). Chưa có catalog -> chỉ chờ thẻ.
+    while (sd_service_poll(&sd_event, &sd_err)) {
+        handle_sd_hotplug(sd_event, sd_err);
+    }
+    if (!s_menu_ready) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        return;
+    }
+
+    // [1] Chờ nút nhấn (ngắt GPIO) rồi cập nhật Menu
+    // Trả về -1 nếu chưa chọn, index >= 0 nếu đã nhấn OK, MENU_CANCEL nếu nhấn OK lúc đang nạp
+    int selectedIndex = menu_update(flasher_session_busy() ? UI_WAIT_BUSY_MS : UI_WAIT_IDLE_MS);
+
+    // [2] Người dùng muốn hủy phiên đang chạy (có hiệu lực ở block kế tiếp)
+    if (selectedIndex == MENU_CANCEL) {
+        ESP_LOGW(TAG, "USER CANCEL REQUEST");
+        oled_show_message("Cancelling...", "Please wait");
+        flasher_session_cancel();
+    }
+
+    // [3] Hiển thị tiến trình từ task nạp
+    flasher_event_t evt;
+    while (flasher_session_poll(&evt)) {
+        if (handle_session_event(evt)) {
+            menu_set_busy(false);
+            log_throughput(evt.type == FLASHER_EVT_DONE || evt.type == FLASHER_EVT_ALREADY_CURRENT);
+            // Không khởi động lại Host: UART, thẻ SD và catalog được giữ cho unit kế tiếp
+            menu_redisplay();
+        }
+    }
 
-    // [2] Xử lý khi người dùng chọn một mục (selectedIndex != -1)
+    // [4] Xử lý khi người dùng chọn một mục (selectedIndex >= 0)
     if (selectedIndex >= 0) {
         // Lấy Firmware ID tương ứng với mục đã chọn
         const char* fw_id_char = menu_get_id(selectedIndex);
@@ -118,7 +381,7 @@ void loop() {
 
         ESP_LOGI(TAG, "USER SELECTED: Index=%d, ID='%s'", selectedIndex, fw_id_to_flash.c_str());
 
-        // [3] Phân loại hành động dựa trên ID
+        // [5] Phân loại hành động dựa trên ID
         if (!fw_id_to_flash.empty() && fw_id_to_flash != "NULL") {
             // === TRƯỜNG HỢP 1: NẠP FIRMWARE (ID hợp lệ) ===
             ESP_LOGI(TAG, ">>> Bat dau quy trinh FLASH FW: %s", fw_id_to_flash.c_str());
@@ -126,59 +389,52 @@ void loop() {
             std::string msg = "Flashing: " + fw_id_to_flash;
             oled_show_message("Please wait...", msg.c_str());
 
-            // Lưu ý: Kiểm tra lại việc gọi sd_mount lần 2 ở đây có cần thiết không.
-            // Nếu thẻ SD không bị tháo ra, có thể bỏ qua bước này để tối ưu.
-            if (sd_mount(SD_CS_PIN) != ESP_OK) {
-                 ESP_LOGE(TAG, "SD Card mat ket noi truoc khi flash!");
-                 oled_show_message("ERROR", "SD Lost!");
-                 for (;;);
-            }
-
-            // -- Bắt đầu nạp --
-            flasher_init(); // Khởi tạo các chân/cấu hình cho flasher
-            ESP_LOGI(TAG, "Flasher Core ready.");
-
-            if(flasher_begin_session(fw_id_to_flash) != ESP_OK){
-                ESP_LOGE(TAG, ">>> FLASH THAT BAI!");
-                oled_show_message("Error", "Flash Failed!");
-                vTaskDelay(pdMS_TO_TICKS(3000)); // Giữ thông báo lỗi lâu hơn chút
-            } else {
-                ESP_LOGI(TAG, ">>> FLASH THANH CONG!");
-                oled_show_message("SUCCESS!", "Flash Complete.");
-                vTaskDelay(pdMS_TO_TICKS(2000));
+            // Thẻ SD do hot-plug quản lý (mount sẵn, tự mount lại khi gắn lại).
+            // Không có thẻ: phiên nạp dùng metadata + ảnh trong cache flash nội nếu đã có.
+            if (!g_is_sd_mounted) {
+                ESP_LOGW(TAG, "Khong co the SD, nap tu cache noi (neu co).");
             }
-
         } else {
             // === TRƯỜNG HỢP 2: XÓA CHIP (ID là "NULL" hoặc Entry đặc biệt) ===
             // Thường dùng cho mục "Exit" hoặc "Erase Chip" trong menu
             ESP_LOGW(TAG, ">>> Phat hien yeu cau CHIP ERASE (ID=NULL)");
             oled_show_message("Erasing Chip...", "PLEASE WAIT!");
-            
-            flasher_init();
-            if(flasher_chip_erase() != ESP_OK){
-                ESP_LOGE(TAG, ">>> ERASE THAT BAI!");
-                oled_show_message("Error", "Erase Failed!");
-                vTaskDelay(pdMS_TO_TICKS(2000));
-            } else {
-                ESP_LOGI(TAG, ">>> ERASE THANH CONG!");
-                oled_show_message("SUCCESS!", "Chip Erased.");
-                vTaskDelay(pdMS_TO_TICKS(1000));
-            }
+            fw_id_to_flash = "NULL";
         }
 
-        // [4] Khởi động lại Host sau khi hoàn tất tác vụ
-        ESP_LOGI(TAG, "Yeu cau khoi dong lai Host...");
-        vTaskDelay(pdMS_TO_TICKS(500)); // Đợi log đẩy hết ra UART
-        host_system_restart(); 
-    }
+        // -- Bắt đầu phiên nạp/xóa trên task riêng --
+        // Chỉ lần đầu thực sự cài UART, các lần sau trả về ngay
+        esp_err_t ret = flasher_init();
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "Flasher Core ready.");
+            s_session_start_us = esp_timer_get_time();
+            if (s_first_session_us == 0) s_first_session_us = s_session_start_us;
+            ret = flasher_session_start(fw_id_to_flash);
+        }
 
-    // Delay nhỏ để tránh chiếm dụng 100% CPU (Watchdog triggering)
-    vTaskDelay(pdMS_TO_TICKS(10)); 
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, ">>> Khong the bat dau phien nap!");
+            oled_show_message("Error", "Session Failed!");
+            vTaskDelay(pdMS_TO_TICKS(2000));
+            menu_redisplay();
+        } else {
+            menu_set_busy(true); // Từ giờ OK = hủy
+        }
+    }
 }
 
 // ============================================================
 // 6. ESP-IDF APP MAIN ENTRY POINT
 // ============================================================
+/**
+ * @brief  Task UI: gọi loop() mãi mãi.
+ */
+static void ui_task(void* arg) {
+    while (true) {
+        loop();
+    }
+}
+
 /**
  * @brief  Điểm vào chính của ứng dụng ESP-IDF
  * @note   Cần thiết khi sử dụng cấu trúc dự án ESP-IDF nhưng viết code kiểu Arduino.
@@ -190,8 +446,10 @@ extern "C" void app_main() {
     // Gọi hàm setup() của Arduino
     setup();
 
-    // Vòng lặp vĩnh cửu gọi loop()
-    while (true) {
-        loop();
+    // loop() chạy trên task UI với ưu tiên/stack rõ ràng (bảng ở mục 3), dưới task nạp.
+    // app_main trả về -> task main của IDF tự được giải phóng.
+    if (xTaskCreate(ui_task, "ui", UI_TASK_STACK, NULL, UI_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "[CRITICAL] Khong tao duoc task UI, chay loop() tren task main.");
+        ui_task(NULL);
     }
 }
\ No newline at end of file
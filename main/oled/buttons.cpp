@@ -0,0 +1,205 @@
+// buttons.cpp
+#include <algorithm>
+#include "esp_log.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "buttons.h"
+
+static const char *TAG = "BUTTONS";
+
+// Trên mọi task khác (bảng task trong main.cpp): mỗi lần chạy chỉ vài us, nút không bao giờ
+// phải chờ đường nạp. Queue cạnh ngắt đủ cho mọi nút cùng dội; queue sự kiện đủ cho UI chậm ~1 s.
+#define BUTTON_TASK_STACK       2560
+#define BUTTON_TASK_PRIORITY    7
+#define BUTTON_EDGE_QUEUE_LEN   (BUTTON_MAX * 2)
+#define BUTTON_EVENT_QUEUE_LEN  16
+
+typedef struct {
+    button_config_t cfg;
+    bool            pressed;        // Trạng thái đã lọc dội
+    bool            debouncing;     // Ngắt đang tắt, chờ tới debounce_end
+    TickType_t      debounce_end;
+    TickType_t      press_start;
+    TickType_t      next_repeat;
+    TickType_t      next_long;
+    uint16_t        repeats;
+    uint16_t        longs;
+} button_state_t;
+
+static button_state_t s_buttons[BUTTON_MAX];
+static int            s_count = 0;
+static QueueHandle_t  s_edge_queue = NULL;
+static QueueHandle_t  s_event_queue = NULL;
+static volatile uint32_t s_held = 0;
+
+static void IRAM_ATTR button_isr(void* arg)
+{
+    uint8_t idx = (uint8_t) (uintptr_t) arg;
+    BaseType_t woken = pdFALSE;
+    gpio_intr_disable((gpio_num_t) s_buttons[idx].cfg.pin); // Dội: task bật lại sau debounce_ms
+    xQueueSendFromISR(s_edge_queue, &idx, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void emit(button_state_t& b, button_event_type_t type, uint16_t count, TickType_t now)
+{
+    button_event_t evt = { b.cfg.pin, (uint8_t) type, count, (uint32_t) ((now - b.press_start) * portTICK_PERIOD_MS) };
+    if (xQueueSend(s_event_queue, &evt, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Event queue full, GPIO %u event %d dropped", b.cfg.pin, (int) type);
+    }
+}
+
+static void set_pressed(button_state_t& b, bool pressed, TickType_t now)
+{
+    b.pressed = pressed;
+    if (pressed) {
+        s_held |= 1u << b.cfg.pin;
+        b.press_start = now;
+        b.repeats = b.longs = 0;
+        b.next_repeat = now + pdMS_TO_TICKS(b.cfg.repeat_delay_ms);
+        b.next_long = now + pdMS_TO_TICKS(b.cfg.long_ms);
+        emit(b, BUTTON_PRESS, 0, now);
+    } else {
+        s_held &= ~(1u << b.cfg.pin);
+        emit(b, BUTTON_RELEASE, b.longs, now);
+    }
+}
+
+// Số tick từ now tới t (0 nếu đã quá hạn)
+static TickType_t ticks_until(TickType_t t, TickType_t now)
+{
+    return (int32_t) (t - now) > 0 ? t - now : 0;
+}
+
+// Chu kỳ tự lặp rút ngắn theo thời gian giữ
+static TickType_t repeat_interval(const button_state_t& b, TickType_t now)
+{
+    uint32_t held_ms = (now - b.press_start) * portTICK_PERIOD_MS;
+    uint32_t shrink = held_ms > b.cfg.repeat_delay_ms ? (held_ms - b.cfg.repeat_delay_ms) / 10 : 0;
+    uint32_t ms = b.cfg.repeat_start_ms > b.cfg.repeat_min_ms + shrink ? b.cfg.repeat_start_ms - shrink : b.cfg.repeat_min_ms;
+    return pdMS_TO_TICKS(ms ? ms : 1);
+}
+
+// Cập nhật 1 nút tại thời điểm now, trả về số tick tới việc kế tiếp cần làm (portMAX_DELAY nếu không có)
+static TickType_t service(button_state_t& b, TickType_t now)
+{
+    TickType_t wait = portMAX_DELAY;
+
+    if (b.debouncing) {
+        if ((int32_t) (now - b.debounce_end) < 0) return ticks_until(b.debounce_end, now);
+        // Hết dội: mức thật khác trạng thái đã báo (vd. nhấn rất ngắn) -> báo tiếp, dội lại
+        b.debouncing = false;
+        bool level_pressed = gpio_get_level((gpio_num_t) b.cfg.pin) == 0;
+        if (level_pressed != b.pressed) {
+            set_pressed(b, level_pressed, now);
+            b.debouncing = true;
+            b.debounce_end = now + pdMS_TO_TICKS(b.cfg.debounce_ms);
+            return pdMS_TO_TICKS(b.cfg.debounce_ms);
+        }
+        gpio_intr_enable((gpio_num_t) b.cfg.pin);
+    }
+    if (!b.pressed) return wait;
+
+    if (b.cfg.repeat_delay_ms > 0) {
+        if ((int32_t) (now - b.next_repeat) >= 0) {
+            emit(b, BUTTON_REPEAT, ++b.repeats, now);
+            b.next_repeat = now + repeat_interval(b, now);
+        }
+        wait = std::min(wait, ticks_until(b.next_repeat, now));
+    }
+    if (b.cfg.long_ms > 0) {
+        if ((int32_t) (now - b.next_long) >= 0) {
+            emit(b, BUTTON_LONG, ++b.longs, now);
+            b.next_long += pdMS_TO_TICKS(b.cfg.long_ms);
+        }
+        wait = std::min(wait, ticks_until(b.next_long, now));
+    }
+    return wait;
+}
+
+static void button_task(void* arg)
+{
+    TickType_t wait = portMAX_DELAY;
+    for (;;) {
+        uint8_t idx;
+        bool edge = xQueueReceive(s_edge_queue, &idx, wait) == pdTRUE;
+        TickType_t now = xTaskGetTickCount();
+
+        // Cạnh đầu tiên sau trạng thái ổn định = đổi trạng thái, báo ngay không chờ hết dội
+        if (edge && idx < s_count && !s_buttons[idx].debouncing) {
+            button_state_t& b = s_buttons[idx];
+            set_pressed(b, !b.pressed, now);
+            b.debouncing = true;
+            b.debounce_end = now + pdMS_TO_TICKS(b.cfg.debounce_ms);
+        }
+
+        wait = portMAX_DELAY;
+        for (int i = 0; i < s_count; i++) {
+            wait = std::min(wait, service(s_buttons[i], now));
+        }
+    }
+}
+
+esp_err_t buttons_init(const button_config_t* configs, int count)
+{
+    if (s_event_queue != NULL) return ESP_OK;
+    if (count > BUTTON_MAX) return ESP_ERR_INVALID_ARG;
+
+    s_edge_queue = xQueueCreate(BUTTON_EDGE_QUEUE_LEN, sizeof(uint8_t));
+    s_event_queue = xQueueCreate(BUTTON_EVENT_QUEUE_LEN, sizeof(button_event_t));
+    if (s_edge_queue == NULL || s_event_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate button queues!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Arduino (attachInterrupt) có thể đã cài ISR service -> ESP_ERR_INVALID_STATE không phải lỗi
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) {
+        ESP_LOGE(TAG, "GPIO ISR service: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_count = count;
+    for (int i = 0; i < count; i++) {
+        button_state_t& b = s_buttons[i];
+        b = {};
+        b.cfg = configs[i];
+
+        gpio_config_t io = {};
+        io.pin_bit_mask = 1ULL << b.cfg.pin;
+        io.mode = GPIO_MODE_INPUT;
+        io.pull_up_en = GPIO_PULLUP_ENABLE;
+        io.intr_type = GPIO_INTR_ANYEDGE;
+        ret = gpio_config(&io);
+        if (ret == ESP_OK) ret = gpio_isr_handler_add((gpio_num_t) b.cfg.pin, button_isr, (void*) (uintptr_t) i);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "GPIO %u: %s", b.cfg.pin, esp_err_to_name(ret));
+            return ret;
+        }
+        // Nút đang bị giữ lúc khởi động: không tính là 1 lần nhấn
+        b.pressed = gpio_get_level((gpio_num_t) b.cfg.pin) == 0;
+        if (b.pressed) s_held |= 1u << b.cfg.pin;
+    }
+
+    if (xTaskCreate(button_task, "buttons", BUTTON_TASK_STACK, NULL, BUTTON_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create button task!");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool buttons_wait(button_event_t* out, uint32_t timeout_ms)
+{
+    if (s_event_queue == NULL) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return false;
+    }
+    return xQueueReceive(s_event_queue, out, pdMS_TO_TICKS(timeout_ms)) == pdTRUE;
+}
+
+uint32_t buttons_held(void)
+{
+    return s_held;
+}
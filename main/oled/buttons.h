@@ -0,0 +1,59 @@
+// buttons.h
+#ifndef BUTTONS_H
+#define BUTTONS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Nút nhấn qua ngắt GPIO: cạnh đầu tiên được nhận ngay (độ trễ vài chục us tới task
+ * "buttons"), sau đó ngắt của nút đó tắt trong debounce_ms rồi đọc lại mức ổn định.
+ * Task "buttons" sinh sự kiện nhấn/nhả/tự lặp/giữ lâu vào 1 queue; UI chỉ cần chặn
+ * trên buttons_wait() thay vì đọc digitalRead định kỳ.
+ */
+#define BUTTON_MAX 4
+
+typedef enum {
+    BUTTON_PRESS = 0,   // Vừa nhấn
+    BUTTON_RELEASE,     // Vừa nhả; count = số BUTTON_LONG đã phát trong lần giữ này
+    BUTTON_REPEAT,      // Đang giữ: tự lặp (nhanh dần)
+    BUTTON_LONG,        // Đang giữ: mỗi long_ms 1 lần
+} button_event_type_t;
+
+typedef struct {
+    uint8_t  pin;       // GPIO của nút (BTN_UP, BTN_DOWN, BTN_OK)
+    uint8_t  type;      // button_event_type_t
+    uint16_t count;     // REPEAT/LONG: lần thứ mấy trong lần giữ này (từ 1)
+    uint32_t held_ms;   // Thời gian đã giữ
+} button_event_t;
+
+/**
+ * @brief Cấu hình 1 nút (nối GND khi nhấn, kéo lên nội).
+ */
+typedef struct {
+    uint8_t  pin;
+    uint16_t debounce_ms;       // Bỏ qua dội trong bấy lâu sau mỗi lần đổi trạng thái
+    uint16_t long_ms;           // > 0: BUTTON_LONG sau mỗi long_ms giữ
+    uint16_t repeat_delay_ms;   // > 0: BUTTON_REPEAT khi giữ lâu hơn...
+    uint16_t repeat_start_ms;   // ...với chu kỳ ban đầu, rút 1 ms mỗi 10 ms giữ...
+    uint16_t repeat_min_ms;     // ...tới chu kỳ nhỏ nhất
+} button_config_t;
+
+/**
+ * @brief Cấu hình GPIO + ngắt và tạo task "buttons". Gọi lại (menu_init lại) không làm gì.
+ * @return ESP_OK, ESP_ERR_INVALID_ARG nếu count > BUTTON_MAX, hoặc lỗi của driver GPIO / ESP_ERR_NO_MEM.
+ */
+esp_err_t buttons_init(const button_config_t* configs, int count);
+
+/**
+ * @brief Chờ 1 sự kiện nút tối đa timeout_ms (0 = không chờ).
+ * @return true nếu có sự kiện.
+ */
+bool buttons_wait(button_event_t* out, uint32_t timeout_ms);
+
+/**
+ * @brief Mặt nạ (1 << pin) các nút đang được giữ.
+ */
+uint32_t buttons_held(void);
+
+#endif // BUTTONS_H
@@ -1,10 +1,13 @@
 // menu.cpp
 #include "menu.h"
+#include "progress.h"
+#include "buttons.h"
+
+static const char *TAG = "MENU";
 
 // --- CÁC BIẾN NỘI BỘ (STATIC) ---
 static Adafruit_SSD1306* _display;
-static const char** _menuItems;
-static const char** _fw_ids;
+static const menu_provider_t* _provider;
 static int _menuLength;
 static int _currentIndex;
 
@@ -13,14 +16,72 @@ static int _currentIndex;
 static int _menuTopIndex; 
 static const int _maxLines = 4; // Vì màn hình 32 / 8 = 4 dòng
 
-static unsigned long _lastDebounce = 0;
-static const unsigned long _debounceDelay = 200;
+// Chỉ các dòng đang hiển thị được lấy từ provider; cuộn 1 dòng dùng lại 3 dòng còn lại
+static menu_item_t _rows[_maxLines];
+static int _rowIndex[_maxLines] = { -1, -1, -1, -1 };
+static menu_item_t _selected; // Mục vừa chọn (cho menu_get_id / menu_display_selection)
+
+static bool _busy = false; // Đang nạp: chỉ nhận nút OK để hủy
+static bool _onScreen = false; // Menu đang hiện trên OLED (chưa bị thông báo khác vẽ đè)
+
+// Nút đang giữ lúc đổi chế độ (1 << pin): bỏ qua sự kiện của chúng cho tới khi nhả
+static uint32_t _ignoreHeld = 0;
+
+// UP/DOWN: tự lặp nhanh dần; OK: mỗi MENU_GROUP_HOLD_MS giữ = 1 lần nhảy nhóm
+static const button_config_t _buttons[] = {
+    { BTN_UP,   MENU_DEBOUNCE_MS, 0, MENU_REPEAT_DELAY_MS, MENU_REPEAT_START_MS, MENU_REPEAT_MIN_MS },
+    { BTN_DOWN, MENU_DEBOUNCE_MS, 0, MENU_REPEAT_DELAY_MS, MENU_REPEAT_START_MS, MENU_REPEAT_MIN_MS },
+    { BTN_OK,   MENU_DEBOUNCE_MS, MENU_GROUP_HOLD_MS, 0, 0, 0 },
+};
 extern Adafruit_SSD1306 display;
 
 // --- HÀM NỘI BỘ (STATIC) ---
 
+static bool fetchItem(int index, menu_item_t* out) {
+    out->stale = false;
+    if (_provider->get(index, out)) return true;
+    snprintf(out->label, sizeof(out->label), "%d. <read error>", index + 1);
+    out->id[0] = '\0';
+    return false;
+}
+
+// Lấy các dòng trong cửa sổ hiện tại, dòng đã có thì chỉ đổi chỗ
+static void fillRows() {
+    menu_item_t rows[_maxLines];
+    int rowIndex[_maxLines];
+    for (int i = 0; i < _maxLines; i++) {
+        int itemIndex = _menuTopIndex + i;
+        rowIndex[i] = itemIndex < _menuLength ? itemIndex : -1;
+        if (rowIndex[i] < 0) continue;
+        int cached = -1;
+        for (int j = 0; j < _maxLines; j++) {
+            if (_rowIndex[j] == itemIndex && !_rows[j].stale) { cached = j; break; }
+        }
+        if (cached >= 0) {
+            rows[i] = _rows[cached];
+        } else if (!fetchItem(itemIndex, &rows[i])) {
+            rowIndex[i] = -1; // Thử đọc lại ở lần vẽ sau
+        }
+    }
+    memcpy(_rows, rows, sizeof(rows));
+    memcpy(_rowIndex, rowIndex, sizeof(rowIndex));
+}
+
+static void clearRows() {
+    for (int i = 0; i < _maxLines; i++) _rowIndex[i] = -1;
+}
+
+// Còn dòng đang hiện nhãn tạm -> cần hỏi lại provider
+static bool rowsStale() {
+    for (int i = 0; i < _maxLines; i++) {
+        if (_rowIndex[i] >= 0 && _rows[i].stale) return true;
+    }
+    return false;
+}
+
 // (CẬP NHẬT) Hàm drawMenu() giờ sẽ thông minh hơn
 static void drawMenu() {
+    fillRows();
     _display->clearDisplay();
     _display->setTextSize(1);
     _display->setTextColor(SSD1306_WHITE);
@@ -40,7 +101,7 @@ static void drawMenu() {
         int yPos = i * 8; 
 
         // Lấy nội dung text
-        const char* itemText = _menuItems[itemIndex];
+        const char* itemText = _rowIndex[i] == itemIndex ? _rows[i].label : "...";
 
         // So sánh index thật với index đang chọn
         if (itemIndex == _currentIndex) {
@@ -54,95 +115,136 @@ static void drawMenu() {
         _display->println(itemText);
     }
     _display->display();
+    _onScreen = true;
+}
+
+// Chỉnh _menuTopIndex để _currentIndex nằm trong cửa sổ
+static void scrollToCurrent() {
+    if (_currentIndex < _menuTopIndex) {
+        _menuTopIndex = _currentIndex;
+    }
+    // Vd: top=0, maxLines=4. Mục 3 (0+4-1) là mục cuối.
+    // Nếu _currentIndex > 3 (là 4), thì top=1 (4 - 4 + 1)
+    if (_currentIndex >= (_menuTopIndex + _maxLines)) {
+        _menuTopIndex = _currentIndex - _maxLines + 1;
+    }
+}
+
+// Di chuyển step mục theo hướng dir. 1 bước thì quay vòng; nhảy trang dừng ở đầu/cuối
+// rồi mới quay vòng ở lần nhảy sau.
+static void moveBy(int dir, int step) {
+    int target = _currentIndex + dir * step;
+    if (target < 0) {
+        target = (_currentIndex == 0 || step == 1) ? _menuLength - 1 : 0;
+    } else if (target >= _menuLength) {
+        target = (_currentIndex == _menuLength - 1 || step == 1) ? 0 : _menuLength - 1;
+    }
+    _currentIndex = target;
+    scrollToCurrent();
+}
+
+// Nhảy tới mục đầu nhóm, đưa mục đó lên dòng trên cùng
+static void jumpGroup(int dir) {
+    if (_provider->group_start == NULL) return;
+    _currentIndex = _provider->group_start(_currentIndex, dir);
+    if (_currentIndex < 0 || _currentIndex >= _menuLength) _currentIndex = 0;
+    _menuTopIndex = _currentIndex;
+    if (_menuTopIndex > _menuLength - _maxLines) _menuTopIndex = _menuLength - _maxLines;
+    if (_menuTopIndex < 0) _menuTopIndex = 0;
 }
 
 // --- ĐỊNH NGHĨA CÁC HÀM PUBLIC ---
 
 // (CẬP NHẬT) menu_init
-void menu_init(Adafruit_SSD1306& disp, const char* displayItems[], const char* idItems[], int len) {
+void menu_init(Adafruit_SSD1306& disp, const menu_provider_t* provider, int len) {
     _display = &disp;
-    _menuItems = displayItems;
-    _fw_ids = idItems;
+    _provider = provider;
     _menuLength = len;
     _currentIndex = 0;
-    _lastDebounce = 0;
     _menuTopIndex = 0; // (MỚI) Khởi tạo
-    
-    pinMode(BTN_UP, INPUT_PULLUP);
-    pinMode(BTN_DOWN, INPUT_PULLUP);
-    pinMode(BTN_OK, INPUT_PULLUP);
+    clearRows();
+
+    // Ngắt GPIO + task "buttons" (chỉ tạo lần đầu, menu_init lại khi thẻ SD đổi catalog)
+    if (buttons_init(_buttons, sizeof(_buttons) / sizeof(_buttons[0])) != ESP_OK) {
+        ESP_LOGE(TAG, "Button init failed, menu has no input!");
+    }
+    _ignoreHeld = buttons_held();
 
     drawMenu();
 }
 
-// (KHÔNG ĐỔI) Hàm lấy ID
+// Hàm lấy ID (đọc lại mục từ provider)
 const char* menu_get_id(int index) {
     if (index < 0 || index >= _menuLength) {
         return NULL;
     }
-    return _fw_ids[index];
+    if (!fetchItem(index, &_selected)) {
+        return NULL;
+    }
+    return _selected.id;
 }
 
 
-// (CẬP NHẬT) menu_update với logic SCROLLING
-int menu_update() {
-    if (millis() - _lastDebounce > _debounceDelay) {
-        
-        bool menuChanged = false; // Dùng cờ để biết khi nào cần vẽ lại
-
-        // Nút UP
-        if (digitalRead(BTN_UP) == LOW) {
-            _currentIndex--;
-            if (_currentIndex < 0) {
-                // (MỚI) Quay vòng từ 0 lên cuối
-                _currentIndex = _menuLength - 1; 
-                // Cập nhật top index để thấy 4 mục cuối
-                _menuTopIndex = _menuLength - _maxLines;
-                if (_menuTopIndex < 0) _menuTopIndex = 0; // Cho list < 4 mục
-            }
-            
-            // (MỚI) Nếu index chọn < top index -> trượt menu xuống
-            if (_currentIndex < _menuTopIndex) {
-                _menuTopIndex = _currentIndex;
-            }
-            menuChanged = true;
-        }
-        // Nút DOWN
-        else if (digitalRead(BTN_DOWN) == LOW) {
-            _currentIndex++;
-            if (_currentIndex >= _menuLength) {
-                // (MỚI) Quay vòng từ cuối về 0
-                _currentIndex = 0; 
-                _menuTopIndex = 0; // Reset về đầu
-            }
-
-            // (MỚI) Nếu index chọn > (top + 3) -> trượt menu lên
-            // Vd: top=0, maxLines=4. Mục 3 (0+4-1) là mục cuối.
-            // Nếu _currentIndex > 3 (là 4), thì top=1 (4 - 4 + 1)
-            if (_currentIndex >= (_menuTopIndex + _maxLines)) {
-                _menuTopIndex = _currentIndex - _maxLines + 1;
-            }
-            menuChanged = true;
-        }
-        // Nút OK
-        else if (digitalRead(BTN_OK) == LOW) {
-            _lastDebounce = millis();
-            return _currentIndex; // Trả về index
-        }
+void menu_set_busy(bool busy) {
+    _busy = busy;
+    // Nút còn đang giữ lúc đổi chế độ không được tính là 1 lần nhấn mới
+    _ignoreHeld = buttons_held();
+}
+
+// (CẬP NHẬT) menu_update: xử lý 1 sự kiện nút (chờ tối đa wait_ms)
+int menu_update(uint32_t wait_ms) {
+    button_event_t evt;
+    if (!buttons_wait(&evt, wait_ms)) {
+        // Không có nút: dòng vẽ lúc nguồn bận được đọc lại, nhãn thật hiện ra khi thẻ rảnh
+        if (!_busy && _onScreen && rowsStale()) drawMenu();
+        return MENU_NONE;
+    }
+    uint32_t bit = 1u << evt.pin;
+    if (_ignoreHeld & bit) {
+        if (evt.type == BUTTON_RELEASE) _ignoreHeld &= ~bit;
+        return MENU_NONE;
+    }
 
-        // (MỚI) Chỉ vẽ lại khi menu thay đổi
-        if (menuChanged) {
+    // Đang nạp: không điều hướng, OK = hủy
+    if (_busy) {
+        return (evt.pin == BTN_OK && evt.type == BUTTON_PRESS) ? MENU_CANCEL : MENU_NONE;
+    }
+
+    int dir = evt.pin == BTN_UP ? -1 : 1;
+    switch (evt.type) {
+    case BUTTON_PRESS:
+        if (evt.pin != BTN_OK) {
+            moveBy(dir, 1);
             drawMenu();
-            _lastDebounce = millis();
         }
+        break;
+    case BUTTON_REPEAT:
+        // Giữ UP/DOWN: tự lặp nhanh dần, sau MENU_PAGE_AFTER_MS thì nhảy cả trang
+        moveBy(dir, evt.held_ms >= MENU_PAGE_AFTER_MS ? _maxLines : 1);
+        drawMenu();
+        break;
+    case BUTTON_LONG:
+        // Giữ OK: mỗi MENU_GROUP_HOLD_MS nhảy sang nhóm kế tiếp
+        jumpGroup(1);
+        drawMenu();
+        break;
+    case BUTTON_RELEASE:
+        // OK nhả nhanh (chưa nhảy nhóm) -> chọn
+        if (evt.pin == BTN_OK && evt.count == 0) {
+            return _currentIndex;
+        }
+        break;
+    default:
+        break;
     }
-    return -1;
+    return MENU_NONE;
 }
 
-// (KHÔNG ĐỔI) menu_display_selection
+// (CẬP NHẬT) menu_display_selection
 void menu_display_selection(int index) {
     if (index < 0 || index >= _menuLength) return; 
-    const char* item = _menuItems[index]; 
+    fetchItem(index, &_selected);
+    const char* item = _selected.label; 
 
     _display->clearDisplay();
     _display->setTextSize(1);
@@ -152,6 +254,7 @@ void menu_display_selection(int index) {
     _display->setCursor(10, 20);
     _display->println(item);
     _display->display();
+    _onScreen = false;
 }
 
 // (CẬP NHẬT) menu_redisplay
@@ -168,6 +271,7 @@ void menu_redisplay() {
             if (_menuTopIndex < 0) _menuTopIndex = 0;
         }
     }
+    clearRows(); // Thẻ có thể đã đổi trạng thái: không dùng lại dòng cũ
     drawMenu();
 }
 
@@ -175,6 +279,8 @@ void menu_redisplay() {
  * @brief Hàm helper để hiển thị thông báo nhanh ra OLED
  */
 void oled_show_message(const char* line1, const char* line2) {
+    oled_progress_end(); // Vẽ cả frame: màn hình tiến trình (nếu có) kết thúc
+    _onScreen = false;
     display.clearDisplay();
     display.setTextSize(1);
     display.setTextColor(SSD1306_WHITE);
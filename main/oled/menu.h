@@ -15,28 +15,69 @@
 #define OLED_RESET -1
 #define OLED_I2C_ADDR 0x3C
 
+// Giá trị trả về đặc biệt của menu_update()
+#define MENU_NONE   -1  // Chưa chọn gì
+#define MENU_CANCEL -2  // Nhấn OK khi menu đang bận (đang nạp) -> yêu cầu hủy
+
+// Điều hướng nhanh
+#define MENU_DEBOUNCE_MS     20    // Bỏ qua dội bấy lâu sau mỗi lần nhấn/nhả (từng nút)
+#define MENU_REPEAT_DELAY_MS 400   // Giữ UP/DOWN lâu hơn -> tự lặp
+#define MENU_REPEAT_START_MS 150   // Chu kỳ lặp ban đầu, rút dần...
+#define MENU_REPEAT_MIN_MS   40    // ...tới chu kỳ nhỏ nhất
+#define MENU_PAGE_AFTER_MS   2000  // Giữ lâu hơn -> mỗi bước nhảy 1 trang
+#define MENU_GROUP_HOLD_MS   700   // Giữ OK -> nhảy sang nhóm device_type kế tiếp (nhả nhanh = chọn)
+
+#define MENU_LABEL_LEN 32   // Màn 128px chỉ hiện 21 ký tự
+#define MENU_ID_LEN    64
+
+/**
+ * @brief 1 dòng menu do provider điền.
+ */
+typedef struct {
+    char label[MENU_LABEL_LEN];  // Chuỗi hiển thị (ví dụ: "1. ESP32 1.0.0")
+    char id[MENU_ID_LEN];        // ID tương ứng (ví dụ: "FW_001")
+    bool stale;                  // Nhãn tạm (nguồn đang bận): hiện nhưng không giữ, hỏi lại ở lần vẽ sau
+} menu_item_t;
+
+/**
+ * @brief Nguồn dữ liệu menu. Menu chỉ hỏi các dòng đang hiển thị, không giữ danh sách.
+ */
+typedef struct {
+    bool (*get)(int index, menu_item_t* out);  // Điền mục ở vị trí index, false nếu lỗi
+    int  (*group_start)(int index, int dir);   // Đầu nhóm kế tiếp (dir > 0) / trước (dir < 0); NULL = không nhóm
+} menu_provider_t;
+
 // --- KHAI BÁO CÁC HÀM CÔNG CỘNG ---
 
 /**
  * @brief Khởi tạo module menu.
- * @param disp         Đối tượng Adafruit_SSD1306
- * @param displayItems Mảng chuỗi để *hiển thị* (ví dụ: "1. Start")
- * @param idItems      Mảng chuỗi là ID tương ứng (ví dụ: "FW_001.bin")
- * @param len          Số lượng mục (phải giống nhau cho cả 2 mảng)
+ * @param disp     Đối tượng Adafruit_SSD1306
+ * @param provider Nguồn dữ liệu (phải sống suốt chương trình)
+ * @param len      Số lượng mục
  */
-void menu_init(Adafruit_SSD1306& disp, const char* displayItems[], const char* idItems[], int len);
+void menu_init(Adafruit_SSD1306& disp, const menu_provider_t* provider, int len);
 
 /**
- * @brief Cập nhật trạng thái menu, kiểm tra nút nhấn.
+ * @brief Chờ tối đa wait_ms cho 1 sự kiện nút (ngắt GPIO, xem buttons.h) và cập nhật menu.
+ * UP/DOWN: 1 bước; giữ để tự lặp nhanh dần, giữ lâu thì nhảy từng trang.
+ * OK: nhả trước MENU_GROUP_HOLD_MS = chọn; giữ = nhảy nhóm device_type (lặp lại nếu giữ tiếp).
+ * @param wait_ms Thời gian chặn tối đa (0 = không chờ); trả về ngay khi có nút.
  * @return  Trả về index của mục được chọn (0, 1, 2...).
- * @return  Trả về -1 nếu không có mục nào được chọn.
+ * @return  Trả về -1 (MENU_NONE) nếu không có mục nào được chọn.
+ * @return  Trả về MENU_CANCEL nếu nhấn OK trong lúc bận.
+ */
+int menu_update(uint32_t wait_ms = 0);
+
+/**
+ * @brief Bật/tắt chế độ bận (đang nạp). Khi bận, menu_update() vẫn chạy
+ * nhưng bỏ qua UP/DOWN (không vẽ đè màn hình tiến trình) và nút OK trả về MENU_CANCEL.
  */
-int menu_update();
+void menu_set_busy(bool busy);
 
 /**
  * @brief (MỚI) Lấy chuỗi ID từ index đã chọn.
  * @param index Index nhận được từ hàm menu_update().
- * @return const char* (chuỗi ID, ví dụ "FW_001.bin").
+ * @return const char* (chuỗi ID, ví dụ "FW_001.bin"), hợp lệ tới lần gọi kế tiếp.
  * @return NULL nếu index không hợp lệ.
  */
 const char* menu_get_id(int index);
@@ -48,7 +89,7 @@ const char* menu_get_id(int index);
 void menu_display_selection(int index);
 
 /**
- * @brief Vẽ lại menu. 
+ * @brief Vẽ lại menu, đọc lại mọi dòng từ provider (sau hot-plug / hết phiên nạp).
  */
 void menu_redisplay();
 
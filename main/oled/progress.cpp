@@ -0,0 +1,153 @@
+// progress.cpp
+#include <string.h>
+#include <stdio.h>
+#include <Wire.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "menu.h"
+#include "progress.h"
+
+static const char *TAG = "OLED_PROGRESS";
+
+#define PROGRESS_PAGES      (SCREEN_HEIGHT / 8)
+#define PROGRESS_I2C_CHUNK  64          // Byte dữ liệu mỗi transaction (buffer Wire của ESP32 là 128)
+#define PROGRESS_I2C_CLOCK  400000      // Như Adafruit_SSD1306::display() khi gửi frame
+#define PROGRESS_I2C_IDLE   100000      // Clock Adafruit_SSD1306 trả lại sau mỗi lần vẽ
+#define PROGRESS_BAR_Y      9           // Thanh tiến trình nằm trong page 1 (dòng 8..15)
+#define PROGRESS_BAR_H      6
+
+extern Adafruit_SSD1306 display;
+
+static uint8_t  s_sent[SCREEN_WIDTH * PROGRESS_PAGES];  // Nội dung đang có trên panel
+static bool     s_active = false;
+static char     s_title[MENU_LABEL_LEN];
+static uint32_t s_done = 0;
+static uint32_t s_total = 0;
+static int64_t  s_start_us = 0;         // Đầu segment, để tính KB/s
+static int64_t  s_last_draw_us = 0;
+
+// Thống kê của 1 màn hình tiến trình (in ở oled_progress_end)
+static uint32_t s_frames = 0;
+static uint32_t s_pages = 0;
+static int64_t  s_i2c_us = 0;
+
+// Gửi page [first..last] của framebuffer: đặt cửa sổ ghi rồi đẩy thẳng dữ liệu GDDRAM
+static void push_pages(int first, int last) {
+    const uint8_t* buf = display.getBuffer() + first * SCREEN_WIDTH;
+    size_t len = (last - first + 1) * SCREEN_WIDTH;
+
+    display.ssd1306_command(SSD1306_PAGEADDR);
+    display.ssd1306_command(first);
+    display.ssd1306_command(last);
+    display.ssd1306_command(SSD1306_COLUMNADDR);
+    display.ssd1306_command(0);
+    display.ssd1306_command(SCREEN_WIDTH - 1);
+
+    Wire.setClock(PROGRESS_I2C_CLOCK);
+    for (size_t i = 0; i < len; i += PROGRESS_I2C_CHUNK) {
+        Wire.beginTransmission(OLED_I2C_ADDR);
+        Wire.write((uint8_t) 0x40); // Co = 0, D/C = 1: các byte sau là dữ liệu
+        Wire.write(buf + i, PROGRESS_I2C_CHUNK);
+        Wire.endTransmission();
+    }
+    Wire.setClock(PROGRESS_I2C_IDLE);
+
+    memcpy(s_sent + first * SCREEN_WIDTH, buf, len);
+    s_pages += last - first + 1;
+}
+
+// Vẽ số liệu hiện tại vào framebuffer (không gửi)
+static void render() {
+    char line[MENU_LABEL_LEN];
+    display.setTextSize(1);
+    display.setTextColor(SSD1306_WHITE, SSD1306_BLACK);
+
+    display.fillRect(0, 0, SCREEN_WIDTH, 8, SSD1306_BLACK);
+    display.setCursor(0, 0);
+    display.print(s_title);
+
+    uint32_t fill = s_total ? (uint64_t) s_done * (SCREEN_WIDTH - 2) / s_total : 0;
+    display.fillRect(0, 8, SCREEN_WIDTH, 8, SSD1306_BLACK);
+    display.drawRect(0, PROGRESS_BAR_Y, SCREEN_WIDTH, PROGRESS_BAR_H, SSD1306_WHITE);
+    display.fillRect(1, PROGRESS_BAR_Y + 1, fill, PROGRESS_BAR_H - 2, SSD1306_WHITE);
+
+    int64_t elapsed_us = esp_timer_get_time() - s_start_us;
+    uint32_t bps = elapsed_us > 0 ? (uint32_t) ((uint64_t) s_done * 1000000 / elapsed_us) : 0;
+    uint32_t percent = s_total ? (uint32_t) ((uint64_t) s_done * 100 / s_total) : 0;
+    snprintf(line, sizeof(line), "%3u%%  %u KB/s", (unsigned) percent, (unsigned) (bps / 1024));
+    display.fillRect(0, 16, SCREEN_WIDTH, 8, SSD1306_BLACK);
+    display.setCursor(0, 16);
+    display.print(line);
+
+    if (bps > 0 && s_done < s_total) {
+        uint32_t eta = (s_total - s_done + bps - 1) / bps;
+        snprintf(line, sizeof(line), "ETA %u:%02u", (unsigned) (eta / 60), (unsigned) (eta % 60));
+    } else {
+        snprintf(line, sizeof(line), s_done >= s_total ? "ETA 0:00" : "ETA --:--");
+    }
+    display.fillRect(0, 24, SCREEN_WIDTH, 8, SSD1306_BLACK);
+    display.setCursor(0, 24);
+    display.print(line);
+}
+
+// Gửi các dải page liên tiếp đã đổi so với panel
+static void flush_changed() {
+    int64_t start = esp_timer_get_time();
+    const uint8_t* buf = display.getBuffer();
+    int first = -1;
+    for (int page = 0; page <= PROGRESS_PAGES; page++) {
+        bool changed = page < PROGRESS_PAGES &&
+                       memcmp(buf + page * SCREEN_WIDTH, s_sent + page * SCREEN_WIDTH, SCREEN_WIDTH) != 0;
+        if (changed && first < 0) {
+            first = page;
+        } else if (!changed && first >= 0) {
+            push_pages(first, page - 1);
+            first = -1;
+        }
+    }
+    s_frames++;
+    s_i2c_us += esp_timer_get_time() - start;
+}
+
+void oled_progress_update(const char* title, uint32_t done, uint32_t total) {
+    int64_t now = esp_timer_get_time();
+    bool restart = !s_active || strncmp(title, s_title, sizeof(s_title) - 1) != 0 || done < s_done;
+    s_done = done;
+    s_total = total;
+
+    if (restart) {
+        if (!s_active) {
+            s_frames = s_pages = 0;
+            s_i2c_us = 0;
+        }
+        s_active = true;
+        snprintf(s_title, sizeof(s_title), "%s", title);
+        s_start_us = now;
+        // Màn hình trước đó (menu, thông báo) không giống frame nào đã gửi -> vẽ cả frame 1 lần
+        int64_t start = now;
+        display.clearDisplay();
+        render();
+        display.display();
+        memcpy(s_sent, display.getBuffer(), sizeof(s_sent));
+        s_frames++;
+        s_pages += PROGRESS_PAGES;
+        s_i2c_us += esp_timer_get_time() - start;
+        s_last_draw_us = now;
+        return;
+    }
+
+    // Tối đa ~10 Hz; block cuối luôn được vẽ
+    if (now - s_last_draw_us < (int64_t) OLED_PROGRESS_MIN_MS * 1000 && done < total) {
+        return;
+    }
+    s_last_draw_us = now;
+    render();
+    flush_changed();
+}
+
+void oled_progress_end(void) {
+    if (!s_active) return;
+    s_active = false;
+    ESP_LOGI(TAG, "%u frame(s), %u page(s) sent, %d ms on I2C", (unsigned) s_frames, (unsigned) s_pages,
+             (int) (s_i2c_us / 1000));
+}
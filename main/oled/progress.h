@@ -0,0 +1,32 @@
+// progress.h
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <stdint.h>
+
+/*
+ * Màn hình tiến trình nạp (128x32 = 4 page x 8 dòng):
+ *   page 0: tên segment      page 1: thanh tiến trình
+ *   page 2: "45%  312 KB/s"  page 3: "ETA 0:12"
+ *
+ * Mỗi lần vẽ chỉ gửi qua I2C các page khác với nội dung đang có trên panel
+ * (thường 1-2 page x 128 byte thay vì cả frame 512 byte), và vẽ tối đa
+ * 1 lần mỗi OLED_PROGRESS_MIN_MS; các lần gọi dày hơn chỉ cập nhật số liệu.
+ */
+#define OLED_PROGRESS_MIN_MS 100    // ~10 Hz
+
+/**
+ * @brief Cập nhật tiến trình. Gọi bao nhiêu lần cũng được (mỗi block), chỉ vẽ khi tới nhịp.
+ * Đổi title hoặc done giảm -> bắt đầu segment mới (vẽ cả frame, tính lại KB/s).
+ * @param title Tên segment (dòng đầu).
+ * @param done  Số byte đã ghi.
+ * @param total Tổng số byte cần ghi của segment.
+ */
+void oled_progress_update(const char* title, uint32_t done, uint32_t total);
+
+/**
+ * @brief Kết thúc màn hình tiến trình (in thống kê thời gian I2C). oled_show_message tự gọi.
+ */
+void oled_progress_end(void);
+
+#endif // PROGRESS_H
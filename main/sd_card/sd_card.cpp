@@ -1,153 +1,520 @@
 #include "esp_log.h"
 #include "sd_card.h"
-#include "ArduinoJson.h"
-#include <SD.h>
+#include "sd_crc.h"
+#include "sd_index.h"
+#include "sd_store.h"
+#include "vfs_api.h"          // VFSImpl: gắn fs::FS của Arduino vào mount point FatFs của IDF
+#include "esp_vfs_fat.h"
+#include "sdmmc_cmd.h"
+#include "driver/sdspi_host.h"
+#include "driver/spi_common.h"
+#include "driver/gpio.h"
+#include "diskio_sdmmc.h"     // ff_diskio_get_pdrv_card
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <vector> // Cần cho mảng động
-#include <map>    // Vẫn dùng map cho get_firmware_path
+#include <algorithm>
+#include <string.h>
+#include <inttypes.h>
 
-//Khai báo TAG cho module sd_card
+//Khai báo TAG cho module sd_card
 static const char *TAG = "SD_CARD";
 static const char *TAG1 = "SD_METADATA";
-const char *METADATA_FILE_PATH = "/index.txt";// đường dẫn cố định đến file metadata trên thẻ SD
-bool g_is_sd_mounted = false; //Khai báo trạng thái mount thẻ SD
+const char *METADATA_FILE_PATH = "/index.txt";// đường dẫn cố định đến file metadata trên thẻ SD
+static const char *INDEX_FILE_PATH = "/index.bin"; // Chỉ mục nhị phân của index.txt (sd_index)
+bool g_is_sd_mounted = false; //Khai báo trạng thái mount thẻ SD
 
-//Bản đồ lưu trữ metadata firmware
-std::map<std::string, firmware_metadata_t> g_firmware_map;
+#define SD_MOUNT_POINT      "/sd"
+#define SD_MAX_FILES        5
+#define SD_SPI_HOST         SPI2_HOST
+#define SD_MAX_TRANSFER     4096        // Kích thước 1 transaction DMA lớn nhất trên bus
+#define SD_PROBE_SECTORS    64          // 32KB đọc lại ở mỗi mức clock khi dò
+#define SD_PROBE_ROUNDS     2
 
-// (MỚI) Các vector tĩnh để LƯU TRỮ mảng menu (tốn RAM nhưng dễ code)
-static std::vector<std::string> g_displayStrings;
-static std::vector<std::string> g_idStrings;
-static std::vector<const char*> g_menuDisplayItemsPtrs;
-static std::vector<const char*> g_menuFirmwareIDsPtrs;
+// Các mức clock SPI đạt được từ APB 80MHz, thử từ cao xuống thấp
+static const uint32_t s_probe_clocks_khz[] = { 40000, 26667, 20000, 16000, 10000 };
 
-//Khởi tạo giao tiêp thẻ SD
+// Driver sdspi của IDF: SPI master + DMA. Khi đọc nhiều block, token của block sau
+// được nhận chung transaction với CRC của block trước thay vì poll từng byte.
+static sdmmc_card_t* s_card = NULL;
+static sd_bus_info_t s_bus_info = {};
+static fs::FSImplPtr s_sd_vfs = std::make_shared<fs::VFSImpl>();
+fs::FS g_sd_fs(s_sd_vfs);
+
+// Menu: chỉ fw_id của mọi mục nằm trong RAM (1 arena, mỗi chuỗi kết thúc '\0') để tra cứu khi nạp,
+// tên hiển thị đọc lại từ chỉ mục khi menu vẽ tới dòng đó. Mục được xếp theo nhóm device_type
+// (nhóm theo thứ tự xuất hiện đầu tiên trong index.txt, trong nhóm giữ nguyên thứ tự).
+typedef struct {
+    std::vector<char>     arena;
+    std::vector<uint32_t> ids;      // Vị trí fw_id của từng mục trong arena
+    std::vector<uint32_t> records;  // Số record trong sd_index của từng mục
+    std::vector<uint32_t> by_id;    // Chỉ số mục sắp theo fw_id (tra cứu không cần đọc thẻ)
+    std::vector<uint32_t> groups;   // Vị trí mục đầu tiên của từng nhóm (mục "(Erase Chip)" là nhóm cuối)
+} menu_store_t;
+
+static menu_store_t s_menu;
+
+// Nhận dạng catalog đã dựng menu: thẻ (serial trong CID) + kích thước/mtime của index.txt.
+// Gắn lại đúng thẻ đó với index.txt không đổi -> giữ nguyên menu, chỉ mở lại chỉ mục.
+typedef struct {
+    int      card_serial;
+    uint32_t size;
+    uint32_t mtime;
+} catalog_sig_t;
+
+static catalog_sig_t s_catalog_sig = {};
+static bool          s_catalog_valid = false;
+
+// Trạng thái hot-plug (chỉ dùng từ sd_hotplug_poll)
+static int64_t s_hotplug_last_poll = 0;
+static int64_t s_hotplug_last_try = 0;
+static bool    s_hotplug_failed = false;   // Lần mount/đọc catalog gần nhất lỗi -> chỉ báo 1 lần
+static bool    s_cd_configured = false;
+
+#define SD_HOTPLUG_RETRY_MS 3000    // Thử mount lại thẻ lỗi / khi không có chân CD
+
+// Thẻ + chỉ mục dùng chung giữa task storage (hot-plug: mount, unmount, dựng lại catalog),
+// task nạp (tra fw_id) và task UI (nhãn mục menu, chỉ thử lấy không chờ).
+// Đệ quy vì sd_hotplug_poll gọi lại sd_mount/sd_load_metadata.
+// Tạo lần đầu từ setup() (sd_mount), trước khi các task khác chạy.
+static SemaphoreHandle_t s_sd_mutex = NULL;
+
+struct sd_lock_guard {
+    sd_lock_guard() {
+        if (s_sd_mutex == NULL) s_sd_mutex = xSemaphoreCreateRecursiveMutex();
+        xSemaphoreTakeRecursive(s_sd_mutex, portMAX_DELAY);
+    }
+    ~sd_lock_guard() { xSemaphoreGiveRecursive(s_sd_mutex); }
+};
+
+// Menu trong RAM có khóa riêng, chỉ giữ trong lúc tra/đổi vector: task UI không phải chờ
+// task storage mount/dựng catalog (giữ s_sd_mutex cả giây). Thứ tự khóa: s_sd_mutex rồi s_menu_mutex;
+// đang giữ s_menu_mutex thì chỉ được thử lấy s_sd_mutex không chờ.
+static SemaphoreHandle_t s_menu_mutex = NULL;
+
+struct menu_lock_guard {
+    menu_lock_guard() {
+        if (s_menu_mutex == NULL) s_menu_mutex = xSemaphoreCreateMutex();
+        xSemaphoreTake(s_menu_mutex, portMAX_DELAY);
+    }
+    ~menu_lock_guard() { xSemaphoreGive(s_menu_mutex); }
+};
+
+// Đọc lại vùng probe (CRC dữ liệu luôn bật ở chế độ SPI). Trả về thời gian (us), -1 nếu lỗi.
+static int64_t probe_read(uint8_t* buf) {
+    int64_t start = esp_timer_get_time();
+    if (sdmmc_read_sectors(s_card, buf, 0, SD_PROBE_SECTORS) != ESP_OK) {
+        return -1;
+    }
+    return esp_timer_get_time() - start;
+}
+
+/*
+ * Tìm clock SPI cao nhất mà thẻ đọc ổn định: đọc SD_PROBE_ROUNDS lần ở mỗi mức,
+ * không lỗi CRC và dữ liệu trùng với mẫu đọc ở tốc độ mặc định thì chọn.
+ * Các mức trên 20MHz chỉ được thử khi thẻ đã chuyển sang High-Speed (CMD6).
+ */
+static esp_err_t probe_bus_clock() {
+    const size_t len = SD_PROBE_SECTORS * s_card->csd.sector_size;
+    uint8_t* ref = (uint8_t*) heap_caps_malloc(len, MALLOC_CAP_DMA);
+    uint8_t* buf = (uint8_t*) heap_caps_malloc(len, MALLOC_CAP_DMA);
+    esp_err_t ret = ESP_FAIL;
+
+    if (!ref || !buf) {
+        ret = ESP_ERR_NO_MEM;
+    } else if (sdspi_host_set_card_clk(s_card->host.slot, SDMMC_FREQ_DEFAULT) != ESP_OK || probe_read(ref) < 0) {
+        ESP_LOGE(TAG, "Probe reference read failed");
+    } else {
+        for (uint32_t clk : s_probe_clocks_khz) {
+            if (clk > s_card->max_freq_khz) {
+                continue;
+            }
+            sdspi_host_set_card_clk(s_card->host.slot, clk);
+
+            int64_t best_us = INT64_MAX;
+            bool stable = true;
+            for (int r = 0; r < SD_PROBE_ROUNDS && stable; r++) {
+                int64_t us = probe_read(buf);
+                stable = us > 0 && memcmp(ref, buf, len) == 0;
+                best_us = std::min(best_us, us);
+            }
+            if (stable) {
+                s_bus_info.clock_khz = clk;
+                s_bus_info.read_kbps = (uint32_t) ((uint64_t) len * 1000000 / best_us / 1024);
+                ret = ESP_OK;
+                break;
+            }
+            ESP_LOGW(TAG, "%" PRIu32 " kHz unstable, trying lower clock", clk);
+        }
+    }
+
+    free(ref);
+    free(buf);
+    return ret;
+}
+
+//Khởi tạo giao tiêp thẻ SD
 esp_err_t sd_mount(int cs_pin) {
-    if (!SD.begin(cs_pin, SPI, 40000000)) { // Thử 40MHz
+    sd_lock_guard lock;
+    if (s_card) { // Đã mount: giống SD.begin trước đây, gọi lại không làm gì
+        return ESP_OK;
+    }
+
+    // CRC luôn bật ở chế độ SPI: kiểm tra kernel nhanh trước khi driver dùng tới
+    sd_crc_selftest();
+
+    // Bus SPI có DMA, dùng các chân SPI mặc định của board như thư viện SD trước đây
+    spi_bus_config_t bus_cfg = {};
+    bus_cfg.mosi_io_num = MOSI;
+    bus_cfg.miso_io_num = MISO;
+    bus_cfg.sclk_io_num = SCK;
+    bus_cfg.quadwp_io_num = -1;
+    bus_cfg.quadhd_io_num = -1;
+    bus_cfg.max_transfer_sz = SD_MAX_TRANSFER;
+    esp_err_t ret = spi_bus_initialize(SD_SPI_HOST, &bus_cfg, SPI_DMA_CH_AUTO);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "SPI bus init failed (%s)", esp_err_to_name(ret));
+        g_is_sd_mounted = false;
+        return ESP_FAIL;
+    }
+
+    sdspi_device_config_t slot_cfg = SDSPI_DEVICE_CONFIG_DEFAULT();
+    slot_cfg.gpio_cs = (gpio_num_t) cs_pin;
+    slot_cfg.host_id = SD_SPI_HOST;
+
+    esp_vfs_fat_sdmmc_mount_config_t mount_cfg = {};
+    mount_cfg.format_if_mount_failed = false;
+    mount_cfg.max_files = SD_MAX_FILES;
+
+    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+    host.slot = SD_SPI_HOST;
+    host.max_freq_khz = 40000; // Thử 40MHz
+    ret = esp_vfs_fat_sdspi_mount(SD_MOUNT_POINT, &host, &slot_cfg, &mount_cfg, &s_card);
+    if (ret != ESP_OK) {
         ESP_LOGW(TAG, "Failed to mount at 40MHz, trying 20MHz...");
-        if (!SD.begin(cs_pin, SPI, 20000000)) { // Fallback về 20MHz nếu thất bại
-             ESP_LOGE(TAG, "Card Mount Failed at 20MHz too");
+        host.max_freq_khz = 20000; // Fallback về 20MHz nếu thất bại
+        ret = esp_vfs_fat_sdspi_mount(SD_MOUNT_POINT, &host, &slot_cfg, &mount_cfg, &s_card);
+        if (ret != ESP_OK) {
+             ESP_LOGE(TAG, "Card Mount Failed at 20MHz too (%s)", esp_err_to_name(ret));
+             s_card = NULL;
+             spi_bus_free(SD_SPI_HOST);
              g_is_sd_mounted = false;
              return ESP_FAIL;
         }
     }
 
-    ESP_LOGI(TAG, "SD initialized OK!");
+    s_sd_vfs->mountpoint(SD_MOUNT_POINT);
     g_is_sd_mounted = true;
+
+    // --- DÒ CLOCK ỔN ĐỊNH CAO NHẤT VÀ ĐO TỐC ĐỘ ĐỌC ---
+    // sdmmc_card_init đã gửi CMD6 chuyển High-Speed nếu thẻ hỗ trợ (max_freq_khz > 20MHz)
+    s_bus_info.high_speed = s_card->max_freq_khz > SDMMC_FREQ_DEFAULT;
+    if (probe_bus_clock() != ESP_OK) {
+        ESP_LOGE(TAG, "No stable SPI clock found for card %s", s_card->cid.name);
+        sd_unmount();
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    ESP_LOGI(TAG, "SD initialized OK! (%s, %s, %" PRIu32 " kHz, read %" PRIu32 " KB/s)", s_card->cid.name,
+             s_bus_info.high_speed ? "High-Speed" : "Default Speed", s_bus_info.clock_khz, s_bus_info.read_kbps);
+
+    if (s_bus_info.read_kbps < CONFIG_SD_MIN_READ_KBPS) {
+        ESP_LOGE(TAG, "Card too slow: %" PRIu32 " KB/s < %d KB/s", s_bus_info.read_kbps, CONFIG_SD_MIN_READ_KBPS);
+        sd_unmount();
+        return ESP_ERR_INVALID_SIZE;
+    }
     return ESP_OK;
 }
 
-//Giải phóng tài nguyên
+//Giải phóng tài nguyên
 esp_err_t sd_unmount() {
-    SD.end();
+    sd_lock_guard lock;
+    sd_index_close();
+    if (s_card) {
+        esp_vfs_fat_sdcard_unmount(SD_MOUNT_POINT, s_card);
+        s_card = NULL;
+        spi_bus_free(SD_SPI_HOST);
+    }
+    s_sd_vfs->mountpoint(NULL);
+    g_is_sd_mounted = false;
     ESP_LOGI(TAG, "SD Unmounted");
     return ESP_OK;
 }
 
+const sd_bus_info_t& sd_get_bus_info() {
+    return s_bus_info;
+}
+
+uint8_t sd_get_pdrv() {
+    return s_card ? ff_diskio_get_pdrv_card(s_card) : 0xFF;
+}
+
+// Đọc nhận dạng catalog của thẻ đang mount (không parse index.txt)
+static bool read_catalog_sig(catalog_sig_t& out) {
+    File f = g_sd_fs.open(METADATA_FILE_PATH, FILE_READ);
+    if (!f) return false;
+    out.card_serial = s_card ? s_card->cid.serial : 0;
+    out.size = f.size();
+    out.mtime = (uint32_t) f.getLastWrite();
+    f.close();
+    return true;
+}
+
 //Đọc metadata của thẻ SD
 esp_err_t sd_load_metadata(){
+    sd_lock_guard lock;
     //1. Kiểm tra thẻ SD đã được mount chưa
     if (!g_is_sd_mounted) {
         ESP_LOGE(TAG1, "SD Card not mounted");
         return ESP_FAIL;
     }
 
-    //2. Mở file INDEX.JSON từ thẻ SD
-    File metadataFile = SD.open(METADATA_FILE_PATH, FILE_READ);
-    if (!metadataFile) {
-        ESP_LOGE(TAG1, "Failed to open metadata file");
-        return ESP_ERR_NOT_FOUND;
+    //2. Mở chỉ mục nhị phân (/index.bin), tạo lại từ index.txt nếu file này đã đổi
+    esp_err_t ret = sd_index_load(METADATA_FILE_PATH, INDEX_FILE_PATH);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG1, "Failed to load metadata index (%s)", esp_err_to_name(ret));
+        return ret;
     }
 
-    // 3. Phân tích cú pháp JSON
-    // Cấp phát bộ nhớ động cho bộ đệm JSON
-    const size_t JSON_BUFFER_SIZE = 10 * 1024; // 10KB
-    DynamicJsonDocument doc(JSON_BUFFER_SIZE);
-    DeserializationError error = deserializeJson(doc, metadataFile);
-    metadataFile.close(); 
-    if (error) {
-        ESP_LOGE(TAG1, "Failed to parse metadata JSON: %s", error.c_str());
-        return ESP_ERR_INVALID_STATE;
-    }
-    // 4. Lưu trữ metadata vào bản đồ trong RAM
-    g_firmware_map.clear(); 
-    JsonArray root = doc.as<JsonArray>();
-
-    // (MỚI) Xóa menu cũ trước khi tạo menu mới
-    g_displayStrings.clear();
-    g_idStrings.clear();
-    g_menuDisplayItemsPtrs.clear();
-    g_menuFirmwareIDsPtrs.clear();
-
-    int i = 1;
-    for (JsonObject firmware_obj:root) {
-        const char* fw_id = firmware_obj["fw_id"];
-        if(!fw_id){
-            ESP_LOGW(TAG1, "Firmware entry without fw_id, skipping");
+    // 3. Đọc fw_id + device_type của từng firmware, gán số nhóm theo device_type.
+    // Menu mới dựng riêng rồi mới đổi chỗ: UI vẫn đọc được menu cũ trong lúc này.
+    size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    s_catalog_valid = false;
+    menu_store_t menu;
+    struct menu_entry_t { uint32_t group; uint32_t record; uint32_t id; };
+    std::vector<menu_entry_t> entries;
+    std::vector<std::string> device_types;  // Chỉ cần lúc dựng menu, số nhóm nhỏ
+    for (uint32_t n = 0; n < sd_index_count(); n++) {
+        std::string fw_id, device_type, version;
+        if (sd_index_get_label(n, fw_id, device_type, version) != ESP_OK) {
+            ESP_LOGW(TAG1, "Cannot read index entry %" PRIu32 ", skipping", n);
             continue;
         }
-        firmware_metadata_t metadata = {
-            .device_type = firmware_obj["device_type"] |"",
-            .version = firmware_obj["version"] | "",
-            .path = firmware_obj["path"] | "",
-            .md5 = firmware_obj["md5"] | "",
-            .path_bootloader = firmware_obj["path_bootloader"] | "",
-            .md5_bootloader = firmware_obj["md5_bootloader"] | "",
-            .path_partition = firmware_obj["path_partition"] | "",
-            .md5_partition = firmware_obj["md5_partition"] | ""
-        };
-        g_firmware_map[fw_id] = metadata;
-        // (MỚI) Đồng thời tạo menu
-        std::string displayName = std::to_string(i) + ". " + metadata.device_type + " " + metadata.version;
-        g_displayStrings.push_back(displayName); // Lưu chuỗi
-        g_idStrings.push_back(fw_id);            // Lưu ID
-        i++;
-        ESP_LOGD(TAG1, "Tải FW: %s (Path: %s)", fw_id, metadata.path.c_str());
-    }
-    
-    // (MỚI) Thêm mục Exit vào cuối
-    g_displayStrings.push_back(std::to_string(i) + ". (Erase Chip)");
-    g_idStrings.push_back("NULL");
-
-    // (MỚI) Tạo mảng con trỏ
-    for (const auto& s : g_displayStrings) {
-        g_menuDisplayItemsPtrs.push_back(s.c_str());
-    }
-    for (const auto& s : g_idStrings) {
-        g_menuFirmwareIDsPtrs.push_back(s.c_str());
-    }
-    ESP_LOGI(TAG, "Tải Metadata hoàn tất. Tổng cộng %d firmware được tải.", g_firmware_map.size());
+        uint32_t group = std::find(device_types.begin(), device_types.end(), device_type) - device_types.begin();
+        if (group == device_types.size()) device_types.push_back(device_type);
+
+        uint32_t off = menu.arena.size();
+        menu.arena.insert(menu.arena.end(), fw_id.c_str(), fw_id.c_str() + fw_id.size() + 1);
+        entries.push_back({ group, n, off });
+    }
+    menu.arena.shrink_to_fit();
+
+    // 4. Xếp mục theo nhóm, ghi lại vị trí đầu mỗi nhóm cho thao tác nhảy nhóm
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const menu_entry_t& a, const menu_entry_t& b) { return a.group < b.group; });
+    menu.ids.reserve(entries.size());
+    menu.records.reserve(entries.size());
+    for (size_t k = 0; k < entries.size(); k++) {
+        if (k == 0 || entries[k].group != entries[k - 1].group) menu.groups.push_back(k);
+        menu.ids.push_back(entries[k].id);
+        menu.records.push_back(entries[k].record);
+    }
+    menu.groups.push_back(entries.size()); // (MỚI) Mục "(Erase Chip)" ở cuối
+
+    // Bảng tra fw_id -> mục, fw_id trùng giữ mục xuất hiện sau cùng trong index.txt như trước đây
+    menu.by_id.resize(menu.records.size());
+    for (uint32_t k = 0; k < menu.by_id.size(); k++) menu.by_id[k] = k;
+    std::sort(menu.by_id.begin(), menu.by_id.end(), [&menu](uint32_t a, uint32_t b) {
+        int cmp = strcmp(&menu.arena[menu.ids[a]], &menu.arena[menu.ids[b]]);
+        return cmp != 0 ? cmp < 0 : menu.records[a] < menu.records[b];
+    });
+
+    int heap_used = (int) (heap_before - heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+    size_t arena_size = menu.arena.size();
+
+    // 5. Đổi sang menu mới (chỉ hoán đổi con trỏ), menu cũ giải phóng sau khi nhả khóa
+    {
+        menu_lock_guard menu_lock;
+        std::swap(s_menu, menu);
+    }
+    menu = menu_store_t();
+
+    s_catalog_valid = read_catalog_sig(s_catalog_sig);
+
+    ESP_LOGI(TAG, "Tải Metadata hoàn tất. Tổng cộng %d firmware được tải.", (int) entries.size());
+    ESP_LOGI(TAG1, "Menu store: %u groups, %u bytes arena, heap used %d bytes", (unsigned) device_types.size(),
+             (unsigned) arena_size, heap_used);
     return ESP_OK;
 }
 
+esp_err_t sd_reload_metadata(bool* changed) {
+    sd_lock_guard lock;
+    if (changed) *changed = true;
+    if (!g_is_sd_mounted) {
+        ESP_LOGE(TAG1, "SD Card not mounted");
+        return ESP_FAIL;
+    }
+
+    catalog_sig_t sig = {};
+    if (!s_catalog_valid || !read_catalog_sig(sig) || memcmp(&sig, &s_catalog_sig, sizeof(sig)) != 0) {
+        return sd_load_metadata();
+    }
+
+    // Cùng thẻ, index.txt không đổi: /index.bin vẫn khớp -> chỉ đọc lại header, giữ menu trong RAM
+    esp_err_t ret = sd_index_load(METADATA_FILE_PATH, INDEX_FILE_PATH);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG1, "Failed to reopen metadata index (%s)", esp_err_to_name(ret));
+        return ret;
+    }
+    if (changed) *changed = false;
+    ESP_LOGI(TAG1, "Catalog unchanged, menu kept.");
+    return ESP_OK;
+}
+
+// Thẻ có trong khe không: theo chân CD nếu có, không có chân CD -> luôn coi là có
+static bool card_detected() {
+#if CONFIG_SD_CARD_DETECT_GPIO >= 0
+    if (!s_cd_configured) {
+        gpio_config_t cd_cfg = {};
+        cd_cfg.pin_bit_mask = 1ULL << CONFIG_SD_CARD_DETECT_GPIO;
+        cd_cfg.mode = GPIO_MODE_INPUT;
+        cd_cfg.pull_up_en = GPIO_PULLUP_ENABLE;
+        s_cd_configured = gpio_config(&cd_cfg) == ESP_OK;
+    }
+    int level = gpio_get_level((gpio_num_t) CONFIG_SD_CARD_DETECT_GPIO);
+#if CONFIG_SD_CARD_DETECT_ACTIVE_LOW
+    return level == 0;
+#else
+    return level != 0;
+#endif
+#else
+    return true;
+#endif
+}
+
+sd_hotplug_event_t sd_hotplug_poll(int cs_pin, esp_err_t* err) {
+    sd_lock_guard lock;
+    int64_t now = esp_timer_get_time();
+    if (now - s_hotplug_last_poll < (int64_t) CONFIG_SD_HOTPLUG_POLL_MS * 1000) {
+        return SD_HOTPLUG_NONE;
+    }
+    s_hotplug_last_poll = now;
+    bool present = card_detected();
+
+    // --- THẺ ĐANG MOUNT: CÒN TRONG KHE VÀ CÒN TRẢ LỜI CMD13? ---
+    if (s_card) {
+        if (present && sdmmc_get_status(s_card) == ESP_OK) {
+            return SD_HOTPLUG_NONE;
+        }
+        ESP_LOGW(TAG, "SD card removed");
+        sd_unmount();
+        s_hotplug_failed = false;
+        return SD_HOTPLUG_REMOVED;
+    }
+
+    // --- CHƯA MOUNT: THẺ VỪA GẮN? (thẻ lỗi / không có chân CD -> thử lại thưa hơn) ---
+    if (!present) {
+        s_hotplug_failed = false;
+        return SD_HOTPLUG_NONE;
+    }
+    if (s_hotplug_failed && now - s_hotplug_last_try < (int64_t) SD_HOTPLUG_RETRY_MS * 1000) {
+        return SD_HOTPLUG_NONE;
+    }
+    s_hotplug_last_try = now;
+
+    bool changed = true;
+    esp_err_t ret = sd_mount(cs_pin);
+    if (ret == ESP_OK) {
+        ret = sd_reload_metadata(&changed);
+        if (ret != ESP_OK) sd_unmount(); // Không có catalog dùng được: lần sau thử lại từ đầu
+    }
+    if (err) *err = ret;
+    if (ret != ESP_OK) {
+        bool first = !s_hotplug_failed;
+        s_hotplug_failed = true;
+        return first ? SD_HOTPLUG_FAILED : SD_HOTPLUG_NONE;
+    }
+
+    s_hotplug_failed = false;
+    ESP_LOGI(TAG, "SD card ready in %d ms (%s catalog)", (int) ((esp_timer_get_time() - now) / 1000),
+             changed ? "new" : "same");
+    return changed ? SD_HOTPLUG_NEW_CATALOG : SD_HOTPLUG_SAME_CATALOG;
+}
+
 //Path firmware theo fw_id
 esp_err_t sd_get_firmware_path(const std::string& fw_id, firmware_metadata_t& out_metadata){
+    sd_lock_guard lock;
     //Kiểm tra thẻ SD đã được mount chưa
     if (!g_is_sd_mounted) {
         ESP_LOGE(TAG1, "SD Card not mounted");
         return ESP_FAIL;
     }
 
-    //Tìm kiếm fw_id trong bản đồ metadata
-    auto it = g_firmware_map.find(fw_id);
-    if (it == g_firmware_map.end()) {
+    //Tìm fw_id trong bảng của menu (RAM) rồi đọc đúng 1 record; ngoài menu -> tìm trên chỉ mục
+    int64_t start = esp_timer_get_time();
+    int record = -1;
+    {
+        menu_lock_guard menu_lock;
+        auto it = std::upper_bound(s_menu.by_id.begin(), s_menu.by_id.end(), fw_id.c_str(),
+                                   [](const char* id, uint32_t k) { return strcmp(id, &s_menu.arena[s_menu.ids[k]]) < 0; });
+        if (it != s_menu.by_id.begin() && fw_id == &s_menu.arena[s_menu.ids[*(it - 1)]]) {
+            record = s_menu.records[*(it - 1)];
+        }
+    }
+    esp_err_t ret = record >= 0 ? sd_index_get(record, out_metadata) : sd_index_find(fw_id, out_metadata);
+    if (ret != ESP_OK) {
         ESP_LOGE(TAG1, "Firmware ID %s not found in metadata", fw_id.c_str());
         return ESP_ERR_NOT_FOUND;
     }
+    sd_store_resolve(out_metadata); // Entry chỉ ghi SHA-256 -> đường dẫn trong kho blob
+    ESP_LOGD(TAG1, "Lookup %s: %d us", fw_id.c_str(), (int) (esp_timer_get_time() - start));
 
-    //Lấy path firmware
-    out_metadata = it->second;
     ESP_LOGI(TAG1, "Firmware ID %s found: Path=%s, Version=%s", 
              fw_id.c_str(), out_metadata.path.c_str(), out_metadata.version.c_str());
     return ESP_OK;
 }
 
-// --- (MỚI) VIẾT 2 HÀM LẤY MENU ---
-// 2 hàm này chỉ đơn giản là trả về con trỏ của 2 mảng static ở trên
-const char** sd_get_menu_display_items(int& out_count) {
-    out_count = g_menuDisplayItemsPtrs.size();
-    return g_menuDisplayItemsPtrs.data();
+// --- MENU: ĐỌC TỪNG MỤC THEO VỊ TRÍ ---
+// Gọi từ task UI: chỉ giữ khóa menu, không bao giờ chờ thẻ (xem s_menu_mutex).
+static int menu_count_locked() {
+    return s_menu.groups.empty() ? 0 : s_menu.records.size() + 1;
 }
 
-const char** sd_get_menu_id_items() {
-    return g_menuFirmwareIDsPtrs.data();
-}
\ No newline at end of file
+int sd_menu_count() {
+    menu_lock_guard lock;
+    return menu_count_locked();
+}
+
+esp_err_t sd_menu_get_item(int pos, std::string& label, std::string& fw_id, bool* stale) {
+    menu_lock_guard lock;
+    if (stale) *stale = false;
+    if (pos < 0 || pos >= menu_count_locked()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pos == (int) s_menu.records.size()) {
+        label = std::to_string(pos + 1) + ". (Erase Chip)";
+        fw_id = "NULL";
+        return ESP_OK;
+    }
+    // Thẻ đang bận (task storage giữ thẻ) hoặc lỗi/bị rút: fw_id vẫn có trong RAM -> hiện fw_id,
+    // vẫn chọn được firmware đã có trong cache nội. Chỉ bận -> nhãn tạm (stale), menu hỏi lại sau.
+    std::string device_type, version;
+    bool card_free = s_sd_mutex != NULL && xSemaphoreTakeRecursive(s_sd_mutex, 0) == pdTRUE;
+    esp_err_t ret = card_free ? sd_index_get_label(s_menu.records[pos], fw_id, device_type, version) : ESP_ERR_TIMEOUT;
+    if (card_free) xSemaphoreGiveRecursive(s_sd_mutex);
+    if (ret != ESP_OK) {
+        fw_id = &s_menu.arena[s_menu.ids[pos]];
+        label = std::to_string(pos + 1) + ". " + fw_id;
+        if (stale) *stale = !card_free; // Thẻ bị rút/lỗi: sự kiện hot-plug sẽ vẽ lại menu
+        return ESP_OK;
+    }
+    label = std::to_string(pos + 1) + ". " + device_type + " " + version;
+    return ESP_OK;
+}
+
+int sd_menu_group_start(int pos, int dir) {
+    menu_lock_guard lock;
+    if (s_menu.groups.empty()) {
+        return 0;
+    }
+    // Nhóm chứa pos
+    size_t g = std::upper_bound(s_menu.groups.begin(), s_menu.groups.end(), (uint32_t) pos) - s_menu.groups.begin() - 1;
+    size_t n = s_menu.groups.size();
+    if (dir > 0) {
+        return s_menu.groups[(g + 1) % n];
+    }
+    // Lùi: đang giữa nhóm -> về đầu nhóm, đang ở đầu nhóm -> đầu nhóm trước (quay vòng)
+    return pos > (int) s_menu.groups[g] ? s_menu.groups[g] : s_menu.groups[(g + n - 1) % n];
+}
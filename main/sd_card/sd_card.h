@@ -9,9 +9,7 @@
 //===== CÁC THƯ VIỆN CẦN THIẾT =====
 #include "Arduino.h" // Thư viện lõi Arduino
 #include "FS.h"      // Thư viện File System (Hệ thống file)
-#include "SD.h"      // Thư viện giao tiếp thẻ SD
 #include <string>   // Thư viện C++ cho std::string
-#include <map>      // Thư viện C++ cho std::map (để lưu metadata)
 // Lưu ý: Kiểu esp_err_t được định nghĩa bên trong các header của ESP-IDF,
 // thường đã được "Arduino.h" (cho ESP32) include sẵn.
 
@@ -25,6 +23,12 @@
  */
 extern bool g_is_sd_mounted;
 
+/**
+ * @brief File system của thẻ SD (mount tại "/sd" qua driver sdspi của IDF).
+ * Dùng như đối tượng `SD` của Arduino: g_sd_fs.open(path, FILE_READ).
+ */
+extern fs::FS g_sd_fs;
+
 //===== ĐỊNH NGHĨA CẤU TRÚC =====
 
 /**
@@ -40,18 +44,12 @@ typedef struct {
     std::string md5_bootloader;   // Mã MD5 của file bootloader
     std::string path_partition;   // Đường dẫn tới file partitions.bin (nếu có)
     std::string md5_partition;    // Mã MD5 của file partitions
+    std::string path_pack;        // Pack .fwp chứa mọi phân vùng (nếu có, thay cho 3 file trên)
+    std::string sha256;           // SHA-256 của file .bin chính (kho blob, thay cho path)
+    std::string sha256_bootloader; // SHA-256 của bootloader (kho blob)
+    std::string sha256_partition; // SHA-256 của partitions (kho blob)
 } firmware_metadata_t;
 
-//===== BIẾN TOÀN CỤC (KHAI BÁO) =====
-
-/**
- * @brief Bản đồ (Map) C++ lưu trữ toàn bộ metadata đọc được từ thẻ SD.
- * (Được *định nghĩa* trong file .cpp tương ứng)
- * - KEY: (std::string) ID của firmware (ví dụ: "FW_ESP32_S3_V1.0.2")
- * - VALUE: (firmware_metadata_t) Cấu trúc chứa toàn bộ thông tin.
- */
-extern std::map<std::string, firmware_metadata_t> g_firmware_map;
-
 //===== KHAI BÁO HÀM (PROTOTYPES) =====
 
 /**
@@ -59,7 +57,9 @@ extern std::map<std::string, firmware_metadata_t> g_firmware_map;
  * @param cs_pin Chân GPIO được sử dụng làm chân Chip Select (CS) cho thẻ SD.
  * @return 
  * - ESP_OK: Mount thẻ SD thành công.
- * - Mã lỗi của esp_err_t (ví dụ: ESP_FAIL) nếu thất bại.
+ * - ESP_FAIL: Không mount được thẻ.
+ * - ESP_ERR_INVALID_RESPONSE: Không tìm được clock SPI nào đọc ổn định.
+ * - ESP_ERR_INVALID_SIZE: Tốc độ đọc thấp hơn CONFIG_SD_MIN_READ_KBPS (thẻ kém).
  */
 esp_err_t sd_mount(int cs_pin);
 
@@ -71,19 +71,67 @@ esp_err_t sd_mount(int cs_pin);
  */
 esp_err_t sd_unmount();
 
+/**
+ * @brief Lấy số ổ vật lý (pdrv) của thẻ trong FatFs, dùng cho ff_disk_read.
+ * @return pdrv, hoặc 0xFF nếu thẻ chưa mount.
+ */
+uint8_t sd_get_pdrv();
+
+/**
+ * @brief Kết quả dò bus của lần mount gần nhất.
+ */
+typedef struct {
+    bool     high_speed;   // Thẻ đã chuyển sang High-Speed bằng CMD6
+    uint32_t clock_khz;    // Clock SPI ổn định cao nhất tìm được
+    uint32_t read_kbps;    // Tốc độ đọc đo được ở clock đó
+} sd_bus_info_t;
+
+/**
+ * @brief Lấy thông tin bus (clock, tốc độ đọc) đo được lúc mount.
+ */
+const sd_bus_info_t& sd_get_bus_info();
+
 /**
  * @brief Đọc file metadata (ví dụ: "metadata.json") từ thẻ SD.
- * Hàm này sẽ parse file và nạp dữ liệu vào biến toàn cục `g_firmware_map`.
+ * Hàm này mở chỉ mục nhị phân /index.bin (tạo lại nếu index.txt đã đổi) và dựng menu.
  * @return 
- * - ESP_OK: Đọc và parse file thành công.
- * - ESP_FAIL: Lỗi khi mở file.
+ * - ESP_OK: Đọc chỉ mục và dựng menu thành công.
+ * - ESP_FAIL: Thẻ chưa mount hoặc không ghi được /index.bin.
+ * - ESP_ERR_NOT_FOUND: Không có index.txt.
  * - ESP_ERR_INVALID_ARG: Lỗi khi parse JSON.
  */
 esp_err_t sd_load_metadata();
 
+/**
+ * @brief Mở lại catalog sau khi gắn lại thẻ: cùng thẻ và index.txt không đổi (kích thước, mtime)
+ * thì giữ menu trong RAM và chỉ đọc header /index.bin, ngược lại gọi sd_load_metadata.
+ * @param changed Nếu khác NULL, nhận true khi menu đã được dựng lại.
+ */
+esp_err_t sd_reload_metadata(bool* changed);
+
+/**
+ * @brief Sự kiện hot-plug trả về từ sd_hotplug_poll.
+ */
+typedef enum {
+    SD_HOTPLUG_NONE = 0,        // Không có gì thay đổi
+    SD_HOTPLUG_REMOVED,         // Thẻ vừa bị rút, đã unmount (menu cũ vẫn giữ, nạp từ cache nội)
+    SD_HOTPLUG_SAME_CATALOG,    // Thẻ vừa gắn, catalog như cũ
+    SD_HOTPLUG_NEW_CATALOG,     // Thẻ vừa gắn, menu đã dựng lại (menu_init lại với sd_menu_count)
+    SD_HOTPLUG_FAILED,          // Thẻ vừa gắn nhưng mount/catalog lỗi (báo 1 lần, tự thử lại sau)
+} sd_hotplug_event_t;
+
+/**
+ * @brief Kiểm tra thẻ bị rút/gắn (chân CD nếu có CONFIG_SD_CARD_DETECT_GPIO, ngược lại lệnh CMD13
+ * lên thẻ đang mount), tối đa 1 lần mỗi CONFIG_SD_HOTPLUG_POLL_MS. Thẻ mới được mount và
+ * catalog được mở lại bằng sd_reload_metadata, không cần khởi động lại Host.
+ * Chỉ gọi khi không có phiên nạp nào đang đọc thẻ (task storage trong sd_service.cpp).
+ * @param err Nếu khác NULL, nhận mã lỗi khi trả về SD_HOTPLUG_FAILED (như sd_mount/sd_load_metadata).
+ */
+sd_hotplug_event_t sd_hotplug_poll(int cs_pin, esp_err_t* err);
+
 /**
  * @brief Tìm kiếm và lấy thông tin metadata của một firmware dựa trên ID.
- * Hàm này sẽ tra cứu trong `g_firmware_map`.
+ * Hàm này tra cứu trong chỉ mục /index.bin trên thẻ (tìm nhị phân theo fw_id).
  *
  * @param fw_id (const std::string&) ID của firmware cần tìm (KEY trong map).
  * @param out_metadata (firmware_metadata_t&) Tham chiếu đến một struct
@@ -94,16 +142,25 @@ esp_err_t sd_load_metadata();
  */
 esp_err_t sd_get_firmware_path(const std::string& fw_id, firmware_metadata_t& out_metadata);
 
-// 3. (MỚI) KHAI BÁO 2 HÀM LẤY MENU
+// 3. MENU: ĐỌC TỪNG MỤC THEO VỊ TRÍ (menu chỉ đọc các dòng đang hiển thị)
+/**
+ * @brief Số mục menu (gồm mục "(Erase Chip)" ở cuối), 0 nếu chưa load metadata.
+ */
+int sd_menu_count();
+
 /**
- * @brief Lấy mảng con trỏ chứa tên hiển thị menu.
- * @param out_count Biến tham chiếu để trả về số lượng mục.
- * @return Con trỏ tới mảng (const char**).
+ * @brief Đọc tên hiển thị và fw_id của mục ở vị trí pos (đọc 1 record trên thẻ).
+ * @param label Nhận tên hiển thị (ví dụ: "3. ESP32-C3 1.2.0").
+ * @param fw_id Nhận fw_id ("NULL" cho mục xóa chip).
+ * Không đọc được thẻ, hoặc thẻ đang bận (task storage giữ thẻ) -> tên hiển thị là fw_id.
+ * Không bao giờ chờ thẻ: gọi được từ task UI bất cứ lúc nào.
+ * @param stale Nếu khác NULL, nhận true khi tên hiển thị là fw_id chỉ vì thẻ đang bận (nên hỏi lại sau).
+ * @return ESP_OK, ESP_ERR_INVALID_ARG nếu pos ngoài menu.
  */
-const char** sd_get_menu_display_items(int& out_count);
+esp_err_t sd_menu_get_item(int pos, std::string& label, std::string& fw_id, bool* stale);
 
 /**
- * @brief Lấy mảng con trỏ chứa ID firmware tương ứng.
- * @return Con trỏ tới mảng (const char**).
+ * @brief Vị trí mục đầu tiên của nhóm device_type kế tiếp (dir > 0) hoặc trước đó (dir < 0), có quay vòng.
+ * Lùi khi đang ở giữa nhóm thì về đầu nhóm hiện tại.
  */
-const char** sd_get_menu_id_items();
\ No newline at end of file
+int sd_menu_group_start(int pos, int dir);
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sd_crc.h"
+
+static const char *TAG = "SD_CRC";
+
+#define BENCH_BLOCK_SIZE    512
+#define BENCH_ROUNDS        2000
+
+// --- BẢNG TRA (sinh lúc biên dịch) ---
+
+// CRC16: t[k][x] = ảnh hưởng của byte x khi còn k byte theo sau
+struct crc16_tables_t { uint16_t t[8][256]; };
+// CRC7 căn trái trong 8 bit (poly 0x09 << 1), t[k] như trên
+struct crc7_tables_t { uint8_t t[4][256]; };
+
+static constexpr crc16_tables_t make_crc16_tables()
+{
+    crc16_tables_t tb = {};
+    for (int i = 0; i < 256; i++) {
+        uint16_t c = (uint16_t) (i << 8);
+        for (int b = 0; b < 8; b++) {
+            c = (c & 0x8000) ? (uint16_t) ((c << 1) ^ 0x1021) : (uint16_t) (c << 1);
+        }
+        tb.t[0][i] = c;
+    }
+    for (int k = 1; k < 8; k++) {
+        for (int i = 0; i < 256; i++) {
+            uint16_t prev = tb.t[k - 1][i];
+            tb.t[k][i] = (uint16_t) ((prev << 8) ^ tb.t[0][prev >> 8]);
+        }
+    }
+    return tb;
+}
+
+static constexpr crc7_tables_t make_crc7_tables()
+{
+    crc7_tables_t tb = {};
+    for (int i = 0; i < 256; i++) {
+        uint8_t c = (uint8_t) i;
+        for (int b = 0; b < 8; b++) {
+            c = (c & 0x80) ? (uint8_t) ((c << 1) ^ 0x12) : (uint8_t) (c << 1);
+        }
+        tb.t[0][i] = c;
+    }
+    for (int k = 1; k < 4; k++) {
+        for (int i = 0; i < 256; i++) {
+            tb.t[k][i] = tb.t[0][tb.t[k - 1][i]];
+        }
+    }
+    return tb;
+}
+
+static constexpr crc16_tables_t s_crc16 = make_crc16_tables();
+static constexpr crc7_tables_t s_crc7 = make_crc7_tables();
+
+// Kernel nhanh chỉ được bật sau khi sd_crc_selftest() khớp với hàm gốc của driver
+static bool s_fast_ok = false;
+
+// --- KERNEL ---
+
+uint16_t sd_crc16(uint16_t crc, const uint8_t* p, size_t len)
+{
+    const auto& T = s_crc16.t;
+
+    // 8 byte / vòng: trạng thái CRC trộn vào 2 byte đầu, mỗi byte tra bảng theo số byte còn lại sau nó
+    while (len >= 8) {
+        crc = T[7][p[0] ^ (crc >> 8)] ^ T[6][p[1] ^ (crc & 0xFF)] ^
+              T[5][p[2]] ^ T[4][p[3]] ^ T[3][p[4]] ^ T[2][p[5]] ^ T[1][p[6]] ^ T[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (uint16_t) ((crc << 8) ^ T[0][(crc >> 8) ^ *p++]);
+    }
+    return crc;
+}
+
+uint8_t sd_crc7(const uint8_t* p, size_t len)
+{
+    const auto& T = s_crc7.t;
+    uint8_t crc = 0;
+
+    // 1 word (4 byte) / vòng
+    while (len >= 4) {
+        crc = T[3][crc ^ p[0]] ^ T[2][p[1]] ^ T[1][p[2]] ^ T[0][p[3]];
+        p += 4;
+        len -= 4;
+    }
+    while (len--) {
+        crc = T[0][crc ^ *p++];
+    }
+    return crc >> 1;
+}
+
+// --- BỌC HÀM CRC CỦA DRIVER SDSPI (-Wl,--wrap) ---
+
+extern "C" {
+uint16_t __real_sdspi_crc16(const uint8_t* data, size_t size);
+uint8_t __real_sdspi_crc7(const uint8_t* data, size_t size);
+
+uint16_t __wrap_sdspi_crc16(const uint8_t* data, size_t size)
+{
+    return s_fast_ok ? sd_crc16(0, data, size) : __real_sdspi_crc16(data, size);
+}
+
+uint8_t __wrap_sdspi_crc7(const uint8_t* data, size_t size)
+{
+    return s_fast_ok ? sd_crc7(data, size) : __real_sdspi_crc7(data, size);
+}
+}
+
+// --- KIỂM TRA ---
+
+// Bản tham chiếu từng bit
+static uint16_t crc16_bitwise(const uint8_t* p, size_t len)
+{
+    uint16_t crc = 0;
+    while (len--) {
+        crc ^= (uint16_t) (*p++ << 8);
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t crc7_bitwise(const uint8_t* p, size_t len)
+{
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *p++;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x12) : (uint8_t) (crc << 1);
+        }
+    }
+    return crc >> 1;
+}
+
+// Dữ liệu giả ngẫu nhiên cố định (LCG) để kết quả lặp lại được
+static void fill_pattern(uint8_t* buf, size_t len)
+{
+    uint32_t x = 0x12345678;
+    for (size_t i = 0; i < len; i++) {
+        x = x * 1103515245 + 12345;
+        buf[i] = (uint8_t) (x >> 16);
+    }
+}
+
+esp_err_t sd_crc_selftest(void)
+{
+    static const uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+    static const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00 };  // GO_IDLE_STATE -> CRC 0x95
+    static const uint8_t cmd8[] = { 0x48, 0x00, 0x00, 0x01, 0xAA };  // SEND_IF_COND  -> CRC 0x87
+    uint8_t block[BENCH_BLOCK_SIZE + 7];
+    fill_pattern(block, sizeof(block));
+
+    bool ok = sd_crc16(0, check, sizeof(check)) == 0x31C3 &&
+              sd_crc7(cmd0, sizeof(cmd0)) == (0x95 >> 1) &&
+              sd_crc7(cmd8, sizeof(cmd8)) == (0x87 >> 1);
+
+    // Phần đuôi (0..16 byte), vài độ dài quanh 1 block, với mọi độ lệch đầu buffer:
+    // phải khớp bản từng bit và hàm gốc của driver
+    static const uint16_t lens[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+                                     63, 64, 65, 511, BENCH_BLOCK_SIZE };
+    for (size_t off = 0; ok && off < 8; off++) {
+        for (size_t i = 0; ok && i < sizeof(lens) / sizeof(lens[0]); i++) {
+            const uint8_t* p = block + off;
+            uint16_t c16 = sd_crc16(0, p, lens[i]);
+            uint8_t c7 = sd_crc7(p, lens[i]);
+            ok = c16 == crc16_bitwise(p, lens[i]) && c16 == __real_sdspi_crc16(p, lens[i]) &&
+                 c7 == crc7_bitwise(p, lens[i]) && c7 == __real_sdspi_crc7(p, lens[i]);
+        }
+    }
+
+    s_fast_ok = ok;
+    if (!ok) {
+        ESP_LOGE(TAG, "CRC self-test failed, using driver CRC routines");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void sd_crc_benchmark(void)
+{
+    uint8_t block[BENCH_BLOCK_SIZE];
+    fill_pattern(block, sizeof(block));
+    volatile uint16_t sink = 0;
+
+    // Bảng từng byte (như sd_diskio_crc.c của Arduino)
+    int64_t start = esp_timer_get_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        uint16_t crc = 0;
+        for (size_t i = 0; i < sizeof(block); i++) {
+            crc = (uint16_t) ((crc << 8) ^ s_crc16.t[0][(crc >> 8) ^ block[i]]);
+        }
+        sink ^= crc;
+    }
+    int64_t table_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        sink ^= sd_crc16(0, block, sizeof(block));
+    }
+    int64_t slice_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        sink ^= __real_sdspi_crc16(block, sizeof(block));
+    }
+    int64_t rom_us = esp_timer_get_time() - start;
+
+    const double bytes = (double) BENCH_ROUNDS * sizeof(block);
+    ESP_LOGI(TAG, "CRC16 over %d x %d bytes:", BENCH_ROUNDS, BENCH_BLOCK_SIZE);
+    ESP_LOGI(TAG, "  byte table   : %.2f MB/s", bytes / table_us);
+    ESP_LOGI(TAG, "  slicing-by-8 : %.2f MB/s", bytes / slice_us);
+    ESP_LOGI(TAG, "  driver (ROM) : %.2f MB/s", bytes / rom_us);
+    (void) sink;
+}
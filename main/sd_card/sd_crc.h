@@ -0,0 +1,36 @@
+/**
+ * @file sd_crc.h
+ * @brief CRC của bus SD (CRC16-CCITT cho block dữ liệu, CRC7 cho lệnh).
+ *
+ * Driver sdspi của IDF gọi sdspi_crc16/sdspi_crc7 cho mỗi block 512 byte và
+ * mỗi lệnh. main/CMakeLists.txt bọc 2 hàm này (-Wl,--wrap) để dùng các kernel
+ * dưới đây: CRC16 slicing-by-8 (8 byte / vòng) và CRC7 xử lý theo word.
+ * Nếu tự kiểm tra lúc khởi động thất bại, driver quay về hàm gốc (ROM CRC).
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief CRC16-CCITT (poly 0x1021, init 0, MSB trước) như trong block dữ liệu SD.
+ */
+uint16_t sd_crc16(uint16_t crc, const uint8_t* data, size_t len);
+
+/**
+ * @brief CRC7 (poly 0x09) của frame lệnh SD, trả về 7 bit (chưa dịch trái/thêm end bit).
+ */
+uint8_t sd_crc7(const uint8_t* data, size_t len);
+
+/**
+ * @brief So kết quả các kernel với bản từng bit và ROM CRC trên vector mẫu.
+ * Chỉ khi ESP_OK thì driver SD mới dùng kernel nhanh.
+ */
+esp_err_t sd_crc_selftest(void);
+
+/**
+ * @brief Đo tốc độ (MB/s) CRC16 của 1 block 512 byte: slicing-by-8, bảng từng byte, ROM.
+ */
+void sd_crc_benchmark(void);
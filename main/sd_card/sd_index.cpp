@@ -0,0 +1,447 @@
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "ArduinoJson.h"
+#include "sd_index.h"
+
+static const char *TAG = "SD_INDEX";
+
+#define SD_INDEX_MAGIC      0x58444946u     // "FIDX"
+#define SD_INDEX_VERSION    2
+#define SD_INDEX_FIELDS     13
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;       // sizeof(index_record_t)
+    uint32_t count;             // Số record (thứ tự như index.txt = thứ tự menu)
+    uint32_t key_count;         // Số khóa (fw_id trùng chỉ giữ entry cuối, như std::map trước đây)
+    uint32_t source_size;       // Kích thước index.txt lúc tạo
+    uint32_t source_mtime;      // mtime index.txt lúc tạo
+    uint32_t strings_offset;
+    uint32_t records_offset;
+    uint32_t keys_offset;       // uint32_t chỉ số record, sắp theo fw_id
+    uint32_t total_size;
+} index_header_t;
+
+// Các trường của 1 firmware nằm liền nhau trong bảng chuỗi -> 1 lần đọc cho cả record
+typedef struct __attribute__((packed)) {
+    uint32_t strings;
+    uint16_t len[SD_INDEX_FIELDS];
+} index_record_t;
+
+// Trường 0 là fw_id (khóa), các trường còn lại ánh xạ vào firmware_metadata_t
+static const char* const s_json_keys[SD_INDEX_FIELDS] = {
+    "fw_id", "device_type", "version", "path", "md5",
+    "path_bootloader", "md5_bootloader", "path_partition", "md5_partition", "pack",
+    "sha256", "sha256_bootloader", "sha256_partition",
+};
+static std::string firmware_metadata_t::* const s_members[SD_INDEX_FIELDS] = {
+    NULL, &firmware_metadata_t::device_type, &firmware_metadata_t::version,
+    &firmware_metadata_t::path, &firmware_metadata_t::md5,
+    &firmware_metadata_t::path_bootloader, &firmware_metadata_t::md5_bootloader,
+    &firmware_metadata_t::path_partition, &firmware_metadata_t::md5_partition,
+    &firmware_metadata_t::path_pack,
+    &firmware_metadata_t::sha256, &firmware_metadata_t::sha256_bootloader,
+    &firmware_metadata_t::sha256_partition,
+};
+
+static File           s_index;      // /index.bin, hoặc index.txt ở chế độ đọc thẳng
+static index_header_t s_header;
+static bool           s_loaded = false;
+
+// --- CHẾ ĐỘ ĐỌC THẲNG index.txt (không ghi được /index.bin, hoặc CONFIG_SD_INDEX_CACHE=n) ---
+// Chỉ giữ vị trí byte + hash fw_id của mỗi phần tử; nội dung được parse lại khi cần.
+typedef struct {
+    uint32_t offset;            // Vị trí '{' của phần tử trong index.txt
+    uint32_t id_hash;           // FNV-1a của fw_id
+} stream_entry_t;
+
+static bool                        s_streaming = false;
+static std::vector<stream_entry_t> s_entries;   // Thứ tự như index.txt
+static std::vector<uint32_t>       s_by_hash;   // Chỉ số s_entries sắp theo id_hash
+
+static bool read_at(uint32_t pos, void* buf, size_t len)
+{
+    return s_index.seek(pos) && s_index.read((uint8_t*) buf, len) == len;
+}
+
+static bool read_record(uint32_t i, index_record_t& rec)
+{
+    return i < s_header.count && read_at(s_header.records_offset + i * sizeof(rec), &rec, sizeof(rec));
+}
+
+static bool read_fields(const index_record_t& rec, firmware_metadata_t& out, std::string* fw_id)
+{
+    size_t total = 0;
+    for (int f = 0; f < SD_INDEX_FIELDS; f++) total += rec.len[f];
+
+    std::string strings(total, '\0');
+    if (total && !read_at(rec.strings, &strings[0], total)) return false;
+
+    size_t pos = 0;
+    for (int f = 0; f < SD_INDEX_FIELDS; f++) {
+        if (s_members[f]) {
+            (out.*s_members[f]).assign(strings, pos, rec.len[f]);
+        } else if (fw_id) {
+            fw_id->assign(strings, pos, rec.len[f]);
+        }
+        pos += rec.len[f];
+    }
+    return true;
+}
+
+// Mở chỉ mục có sẵn nếu còn khớp với index.txt
+static bool open_index(const char* index_path, uint32_t source_size, uint32_t source_mtime)
+{
+    s_index = g_sd_fs.open(index_path, FILE_READ);
+    if (!s_index) return false;
+
+    if (!read_at(0, &s_header, sizeof(s_header)) || s_header.magic != SD_INDEX_MAGIC ||
+        s_header.version != SD_INDEX_VERSION || s_header.record_size != sizeof(index_record_t) ||
+        s_header.total_size != s_index.size()) {
+        ESP_LOGW(TAG, "%s is invalid, rebuilding.", index_path);
+        s_index.close();
+        return false;
+    }
+    if (s_header.source_size != source_size || s_header.source_mtime != source_mtime) {
+        ESP_LOGI(TAG, "index.txt changed, rebuilding %s.", index_path);
+        s_index.close();
+        return false;
+    }
+    return true;
+}
+
+static void skip_whitespace(File& f)
+{
+    while (f.available() && isspace(f.peek())) f.read();
+}
+
+static uint32_t fnv1a(const char* str)
+{
+    uint32_t hash = 2166136261u;
+    while (*str) hash = (hash ^ (uint8_t) *str++) * 16777619u;
+    return hash;
+}
+
+/*
+ * Duyệt mảng JSON gốc của index.txt từng phần tử: on_element(offset) được gọi khi con trỏ đọc
+ * nằm ở đầu phần tử và phải deserializeJson đúng 1 phần tử. Trả về false nếu on_element lỗi.
+ */
+template <typename F>
+static bool for_each_element(File& src, F&& on_element)
+{
+    if (!src.find('[')) return false;
+    while (true) {
+        skip_whitespace(src);
+        if (!src.available() || src.peek() == ']') return true;
+        if (!on_element((uint32_t) src.position())) return false;
+        if (!src.findUntil(",", "]")) return true;
+    }
+}
+
+static void fill_metadata(JsonDocument& doc, firmware_metadata_t& out)
+{
+    for (int f = 0; f < SD_INDEX_FIELDS; f++) {
+        if (s_members[f]) out.*s_members[f] = doc[s_json_keys[f]] | "";
+    }
+}
+
+// Đọc index.txt từng phần tử của mảng (JsonDocument chỉ giữ 1 firmware), chuỗi được ghi
+// thẳng ra file; chỉ giữ trong RAM record + fw_id để sắp bảng khóa ở cuối.
+static esp_err_t build_index(const char* json_path, const char* index_path, uint32_t source_size,
+                             uint32_t source_mtime)
+{
+    int64_t start = esp_timer_get_time();
+    File src = g_sd_fs.open(json_path, FILE_READ);
+    if (!src) return ESP_ERR_NOT_FOUND;
+
+    // Đổi phần mở rộng ("/index.bin" -> "/index.tmp"): vẫn là tên 8.3 hợp lệ khi FatFs không có LFN
+    std::string tmp_path = index_path;
+    size_t dot = tmp_path.rfind('.');
+    if (dot != std::string::npos && tmp_path.find('/', dot) == std::string::npos) tmp_path.resize(dot);
+    tmp_path += ".tmp";
+    File out = g_sd_fs.open(tmp_path.c_str(), FILE_WRITE);
+    if (!out) {
+        ESP_LOGE(TAG, "Cannot create %s", tmp_path.c_str());
+        src.close();
+        return ESP_FAIL;
+    }
+
+    index_header_t hdr = {};
+    hdr.magic = SD_INDEX_MAGIC;
+    hdr.version = SD_INDEX_VERSION;
+    hdr.record_size = sizeof(index_record_t);
+    hdr.source_size = source_size;
+    hdr.source_mtime = source_mtime;
+    hdr.strings_offset = sizeof(hdr);
+
+    std::vector<index_record_t> records;
+    std::vector<std::pair<std::string, uint32_t>> keys;
+    uint32_t pos = sizeof(hdr);
+    bool ok = out.write((const uint8_t*) &hdr, sizeof(hdr)) == sizeof(hdr);
+
+    JsonDocument doc;
+    ok = ok && for_each_element(src, [&](uint32_t offset) {
+        DeserializationError error = deserializeJson(doc, src);
+        if (error) {
+            ESP_LOGE(TAG, "Failed to parse entry at byte %" PRIu32 ": %s", offset, error.c_str());
+            return false;
+        }
+
+        const char* fw_id = doc["fw_id"];
+        if (!fw_id) {
+            ESP_LOGW(TAG, "Firmware entry without fw_id, skipping");
+            return true;
+        }
+        index_record_t rec = {};
+        rec.strings = pos;
+        for (int f = 0; f < SD_INDEX_FIELDS; f++) {
+            const char* value = doc[s_json_keys[f]] | "";
+            size_t len = strnlen(value, UINT16_MAX);
+            if (out.write((const uint8_t*) value, len) != len) return false;
+            rec.len[f] = len;
+            pos += len;
+        }
+        keys.emplace_back(fw_id, records.size());
+        records.push_back(rec);
+        return true;
+    });
+    src.close();
+
+    if (!ok) {
+        out.close();
+        g_sd_fs.remove(tmp_path.c_str());
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // --- BẢNG KHÓA: sắp theo fw_id, fw_id trùng -> giữ entry xuất hiện sau cùng ---
+    std::stable_sort(keys.begin(), keys.end(),
+                     [](const std::pair<std::string, uint32_t>& a, const std::pair<std::string, uint32_t>& b) {
+                         return a.first < b.first;
+                     });
+    std::vector<uint32_t> key_table;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (i + 1 < keys.size() && keys[i + 1].first == keys[i].first) continue;
+        key_table.push_back(keys[i].second);
+    }
+
+    hdr.count = records.size();
+    hdr.key_count = key_table.size();
+    hdr.records_offset = pos;
+    hdr.keys_offset = hdr.records_offset + records.size() * sizeof(index_record_t);
+    hdr.total_size = hdr.keys_offset + key_table.size() * sizeof(uint32_t);
+
+    size_t records_len = records.size() * sizeof(index_record_t);
+    size_t keys_len = key_table.size() * sizeof(uint32_t);
+    ok = out.write((const uint8_t*) records.data(), records_len) == records_len &&
+         out.write((const uint8_t*) key_table.data(), keys_len) == keys_len &&
+         out.seek(0) && out.write((const uint8_t*) &hdr, sizeof(hdr)) == sizeof(hdr);
+    out.close();
+
+    // Chỉ thay file cũ khi file mới đã ghi xong (mất điện giữa chừng -> lần boot sau tạo lại)
+    if (!ok || (g_sd_fs.exists(index_path) && !g_sd_fs.remove(index_path)) ||
+        !g_sd_fs.rename(tmp_path.c_str(), index_path)) {
+        ESP_LOGE(TAG, "Failed to write %s", index_path);
+        g_sd_fs.remove(tmp_path.c_str());
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Built %s: %" PRIu32 " entries, %" PRIu32 " bytes in %d ms", index_path, hdr.count,
+             hdr.total_size, (int) ((esp_timer_get_time() - start) / 1000));
+    return ESP_OK;
+}
+
+// Chế độ đọc thẳng: 1 lượt qua index.txt với filter chỉ giữ fw_id -> heap cố định vài KB
+// dù file lớn cỡ MB, RAM lâu dài 12 byte mỗi firmware (s_entries 8 byte + 1 ô s_by_hash).
+static esp_err_t scan_json(const char* json_path)
+{
+    int64_t start = esp_timer_get_time();
+    s_index = g_sd_fs.open(json_path, FILE_READ);
+    if (!s_index) return ESP_ERR_NOT_FOUND;
+
+    JsonDocument filter;
+    filter["fw_id"] = true;
+    JsonDocument doc;
+    bool ok = for_each_element(s_index, [&](uint32_t offset) {
+        DeserializationError error = deserializeJson(doc, s_index, DeserializationOption::Filter(filter));
+        if (error) {
+            ESP_LOGE(TAG, "Failed to parse entry at byte %" PRIu32 ": %s", offset, error.c_str());
+            return false;
+        }
+        const char* fw_id = doc["fw_id"];
+        if (!fw_id) {
+            ESP_LOGW(TAG, "Firmware entry without fw_id, skipping");
+        } else {
+            s_entries.push_back({ offset, fnv1a(fw_id) });
+        }
+        return true;
+    });
+    if (!ok) {
+        sd_index_close();
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_by_hash.resize(s_entries.size());
+    for (uint32_t i = 0; i < s_by_hash.size(); i++) s_by_hash[i] = i;
+    std::stable_sort(s_by_hash.begin(), s_by_hash.end(),
+                     [](uint32_t a, uint32_t b) { return s_entries[a].id_hash < s_entries[b].id_hash; });
+
+    s_streaming = true;
+    ESP_LOGI(TAG, "Scanned %s: %u entries in %d ms", json_path, (unsigned) s_entries.size(),
+             (int) ((esp_timer_get_time() - start) / 1000));
+    return ESP_OK;
+}
+
+// Parse lại 1 phần tử của index.txt tại vị trí đã ghi nhận lúc quét
+static bool parse_entry(uint32_t i, JsonDocument& doc, JsonDocument* filter)
+{
+    if (i >= s_entries.size() || !s_index.seek(s_entries[i].offset)) return false;
+    DeserializationError error = filter ? deserializeJson(doc, s_index, DeserializationOption::Filter(*filter))
+                                        : deserializeJson(doc, s_index);
+    return !error;
+}
+
+esp_err_t sd_index_load(const char* json_path, const char* index_path)
+{
+    sd_index_close();
+
+    File src = g_sd_fs.open(json_path, FILE_READ);
+    if (!src) {
+        ESP_LOGE(TAG, "Failed to open %s", json_path);
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t source_size = src.size();
+    uint32_t source_mtime = (uint32_t) src.getLastWrite();
+    src.close();
+
+#if CONFIG_SD_INDEX_CACHE
+    if (!open_index(index_path, source_size, source_mtime)) {
+        esp_err_t ret = build_index(json_path, index_path, source_size, source_mtime);
+        if (ret != ESP_OK && ret != ESP_FAIL) return ret;
+        if (ret != ESP_OK || !open_index(index_path, source_size, source_mtime)) {
+            // Thẻ đầy/chỉ đọc: vẫn dùng được catalog, chỉ chậm hơn lúc boot
+            ESP_LOGW(TAG, "Cannot cache %s, reading %s directly.", index_path, json_path);
+            return scan_json(json_path);
+        }
+    }
+
+    s_loaded = true;
+    ESP_LOGI(TAG, "Catalog index: %" PRIu32 " firmware", s_header.count);
+    return ESP_OK;
+#else
+    return scan_json(json_path);
+#endif
+}
+
+void sd_index_close()
+{
+    if (s_index) s_index.close();
+    s_loaded = false;
+    s_streaming = false;
+    s_entries.clear();
+    s_entries.shrink_to_fit();
+    s_by_hash.clear();
+    s_by_hash.shrink_to_fit();
+}
+
+uint32_t sd_index_count()
+{
+    if (s_streaming) return s_entries.size();
+    return s_loaded ? s_header.count : 0;
+}
+
+esp_err_t sd_index_get(uint32_t i, firmware_metadata_t& out, std::string* fw_id)
+{
+    if (s_streaming) {
+        JsonDocument doc;
+        if (!parse_entry(i, doc, NULL)) return i < s_entries.size() ? ESP_FAIL : ESP_ERR_NOT_FOUND;
+        fill_metadata(doc, out);
+        if (fw_id) *fw_id = doc["fw_id"] | "";
+        return ESP_OK;
+    }
+
+    index_record_t rec;
+    if (!s_loaded || !read_record(i, rec)) return ESP_ERR_NOT_FOUND;
+    return read_fields(rec, out, fw_id) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t sd_index_get_label(uint32_t i, std::string& fw_id, std::string& device_type, std::string& version)
+{
+    if (s_streaming) {
+        JsonDocument filter;
+        filter["fw_id"] = true;
+        filter["device_type"] = true;
+        filter["version"] = true;
+        JsonDocument doc;
+        if (!parse_entry(i, doc, &filter)) return i < s_entries.size() ? ESP_FAIL : ESP_ERR_NOT_FOUND;
+        fw_id = doc["fw_id"] | "";
+        device_type = doc["device_type"] | "";
+        version = doc["version"] | "";
+        return ESP_OK;
+    }
+
+    // fw_id, device_type, version là 3 trường đầu -> chỉ đọc phần đầu chuỗi của record
+    index_record_t rec;
+    if (!s_loaded || !read_record(i, rec)) return ESP_ERR_NOT_FOUND;
+    std::string strings(rec.len[0] + rec.len[1] + rec.len[2], '\0');
+    if (!strings.empty() && !read_at(rec.strings, &strings[0], strings.size())) return ESP_FAIL;
+    fw_id = strings.substr(0, rec.len[0]);
+    device_type = strings.substr(rec.len[0], rec.len[1]);
+    version = strings.substr(rec.len[0] + rec.len[1], rec.len[2]);
+    return ESP_OK;
+}
+
+// Chế độ đọc thẳng: tìm theo hash rồi parse lại để so fw_id (fw_id trùng -> entry sau cùng)
+static esp_err_t find_streaming(const std::string& fw_id, firmware_metadata_t& out)
+{
+    uint32_t hash = fnv1a(fw_id.c_str());
+    auto it = std::lower_bound(s_by_hash.begin(), s_by_hash.end(), hash,
+                               [](uint32_t i, uint32_t h) { return s_entries[i].id_hash < h; });
+
+    JsonDocument doc;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    for (; it != s_by_hash.end() && s_entries[*it].id_hash == hash; ++it) {
+        if (!parse_entry(*it, doc, NULL)) return ESP_FAIL;
+        if (fw_id == (doc["fw_id"] | "")) {
+            fill_metadata(doc, out);
+            ret = ESP_OK;
+        }
+    }
+    return ret;
+}
+
+esp_err_t sd_index_find(const std::string& fw_id, firmware_metadata_t& out)
+{
+    if (s_streaming) return find_streaming(fw_id, out);
+    if (!s_loaded) return ESP_ERR_NOT_FOUND;
+
+    uint32_t lo = 0;
+    uint32_t hi = s_header.key_count;
+    std::string key;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t record;
+        index_record_t rec;
+        if (!read_at(s_header.keys_offset + mid * sizeof(record), &record, sizeof(record)) ||
+            !read_record(record, rec)) {
+            return ESP_FAIL;
+        }
+
+        key.assign(rec.len[0], '\0');
+        if (rec.len[0] && !read_at(rec.strings, &key[0], rec.len[0])) return ESP_FAIL;
+
+        int cmp = fw_id.compare(key);
+        if (cmp == 0) return read_fields(rec, out, NULL) ? ESP_OK : ESP_FAIL;
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,59 @@
+#ifndef __SD_INDEX_H__
+#define __SD_INDEX_H__
+
+#include <string>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sd_card.h"
+
+/*
+ * Chỉ mục nhị phân của index.txt, lưu cạnh nó trên thẻ SD (/index.bin):
+ *   header | bảng chuỗi | record cố định (thứ tự như index.txt) | bảng khóa (record sắp theo fw_id)
+ * Được tạo lại khi kích thước hoặc mtime của index.txt thay đổi. Lúc boot chỉ đọc header,
+ * mỗi lần tra cứu chỉ đọc vài record -> thời gian và RAM không tăng theo số firmware.
+ *
+ * Không ghi được /index.bin (thẻ đầy/chỉ đọc) hoặc CONFIG_SD_INDEX_CACHE=n: đọc thẳng index.txt.
+ * Quét 1 lượt từng phần tử với filter chỉ giữ fw_id, ghi nhận vị trí byte của mỗi phần tử,
+ * rồi parse lại đúng phần tử đó khi cần (12 byte RAM mỗi firmware: vị trí + hash fw_id + 1 ô
+ * bảng sắp theo hash; heap parse vài KB). Ở cả 2 chế độ, menu của sd_card giữ thêm ~12 byte
+ * mỗi mục cộng chính chuỗi fw_id trong arena.
+ */
+
+/**
+ * @brief Mở chỉ mục, tạo lại từ json_path nếu chưa có hoặc đã cũ.
+ * @return
+ * - ESP_OK: Chỉ mục sẵn sàng.
+ * - ESP_ERR_NOT_FOUND: Không mở được index.txt.
+ * - ESP_ERR_INVALID_ARG: index.txt không phải mảng JSON hợp lệ.
+ * - ESP_FAIL: Lỗi đọc thẻ.
+ */
+esp_err_t sd_index_load(const char* json_path, const char* index_path);
+
+/**
+ * @brief Đóng file chỉ mục (gọi trước khi unmount thẻ).
+ */
+void sd_index_close();
+
+/**
+ * @brief Số firmware trong chỉ mục (0 nếu chưa load).
+ */
+uint32_t sd_index_count();
+
+/**
+ * @brief Đọc firmware thứ i theo thứ tự trong index.txt.
+ * @param fw_id Nếu khác NULL, nhận fw_id của firmware.
+ */
+esp_err_t sd_index_get(uint32_t i, firmware_metadata_t& out, std::string* fw_id = NULL);
+
+/**
+ * @brief Chỉ đọc các trường menu cần (fw_id, device_type, version) của firmware thứ i.
+ */
+esp_err_t sd_index_get_label(uint32_t i, std::string& fw_id, std::string& device_type, std::string& version);
+
+/**
+ * @brief Tìm firmware theo fw_id (tìm nhị phân trên bảng khóa).
+ * @return ESP_OK hoặc ESP_ERR_NOT_FOUND.
+ */
+esp_err_t sd_index_find(const std::string& fw_id, firmware_metadata_t& out);
+
+#endif // __SD_INDEX_H__
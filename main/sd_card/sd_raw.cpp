@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <algorithm>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_freertos_hooks.h"
+#include "esp_heap_caps.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "ff.h"
+#include "diskio_impl.h"    // ff_disk_read: gọi thẳng driver của ổ (sdmmc_read_sectors)
+#include "sd_card.h"
+#include "sd_raw.h"
+
+static const char *TAG = "SD_RAW";
+
+#define BENCH_BUFFER_SIZE   (16 * 1024)
+
+#define READAHEAD_STACK     3072
+#define READAHEAD_STOP      0xFF        // Gửi vào free_q để đánh thức task khi dừng
+
+// Một buffer đọc trước
+typedef struct {
+    uint8_t* data;
+    uint32_t len;               // 0 = lỗi đọc
+} ra_buffer_t;
+
+/*
+ * Đọc trước tuần tự: task nền lấy buffer trống từ free_q, đọc đoạn kế tiếp
+ * của file vào đó rồi đẩy sang ready_q theo đúng thứ tự. sd_raw_read chỉ
+ * copy từ buffer đã đầy, trả buffer về free_q khi dùng hết.
+ */
+struct sd_raw_prefetch {
+    sd_raw_file_t*    file;
+    ra_buffer_t       bufs[CONFIG_SD_READAHEAD_DEPTH > 0 ? CONFIG_SD_READAHEAD_DEPTH : 1];
+    uint32_t          buf_size;
+    QueueHandle_t     free_q;
+    QueueHandle_t     ready_q;
+    SemaphoreHandle_t done;
+    volatile bool     stop;
+    uint32_t          fill_pos;     // Vị trí file task đọc tiếp (chỉ task dùng)
+    size_t            fill_run;     // Con trỏ dải của task
+    int               cur;          // Buffer caller đang dùng, -1 nếu chưa có
+    uint32_t          cur_used;     // Số byte đã lấy trong buffer cur
+    bool              failed;       // Task gặp lỗi thẻ và đã ngừng đọc
+};
+
+static uint16_t volume_sector_size(FATFS* fs)
+{
+#if FF_MAX_SS != FF_MIN_SS
+    return fs->ssize;
+#else
+    return FF_MAX_SS;
+#endif
+}
+
+/*
+ * Dò chuỗi cluster 1 lần: f_lseek tới byte đầu của từng cluster để FatFs
+ * cập nhật fil->clust (tiến tuần tự nên mỗi bước chỉ đọc 1 entry FAT),
+ * rồi gộp các cluster kề nhau thành dải sector.
+ */
+static esp_err_t resolve_runs(FIL* fil, uint16_t ssize, std::vector<sd_raw_run_t>& runs)
+{
+    FATFS* fs = fil->obj.fs;
+    const uint32_t size = f_size(fil);
+    const uint32_t cluster_bytes = (uint32_t) fs->csize * ssize;
+
+    for (uint32_t pos = 0; pos < size; pos += cluster_bytes) {
+        // fil->clust là cluster chứa byte (fptr - 1)
+        if (f_lseek(fil, pos + 1) != FR_OK || fil->clust < 2) {
+            return ESP_FAIL;
+        }
+        uint32_t lba = fs->database + (fil->clust - 2) * fs->csize;
+        uint32_t sectors = (std::min(cluster_bytes, size - pos) + ssize - 1) / ssize;
+
+        if (!runs.empty() && runs.back().lba + runs.back().sectors == lba) {
+            runs.back().sectors += sectors;
+        } else {
+            runs.push_back({ pos, lba, sectors });
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t sd_raw_open(const char* path, sd_raw_file_t& out)
+{
+    out.runs.clear();
+    out.bounce = NULL;
+    out.size = 0;
+    out.position = 0;
+    out.run_index = 0;
+    out.prefetch = NULL;
+    out.stats = {};
+    out.pdrv = sd_get_pdrv();
+
+    // FIL có bộ đệm riêng 1 sector (PER_FILE_CACHE) -> cấp phát tạm trên heap
+    FIL* fil = (FIL*) malloc(sizeof(FIL));
+    if (!fil) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    char drv_path[8 + 256];
+    snprintf(drv_path, sizeof(drv_path), "%u:%s", out.pdrv, path);
+
+    esp_err_t ret = ESP_FAIL;
+    if (f_open(fil, drv_path, FA_READ) == FR_OK) {
+        out.size = f_size(fil);
+        out.sector_size = volume_sector_size(fil->obj.fs);
+        ret = resolve_runs(fil, out.sector_size, out.runs);
+        f_close(fil);
+    }
+    free(fil);
+
+    if (ret == ESP_OK) {
+        out.bounce = (uint8_t*) heap_caps_malloc(out.sector_size, MALLOC_CAP_DMA);
+        if (!out.bounce) {
+            out.runs.clear();
+            return ESP_ERR_NO_MEM;
+        }
+        ESP_LOGD(TAG, "%s: %" PRIu32 " bytes in %zu run(s)", path, out.size, out.runs.size());
+        return ESP_OK;
+    }
+
+    // --- FALLBACK: ĐỌC QUA FILE NHƯ CŨ ---
+    ESP_LOGW(TAG, "Cluster chain of %s not resolved, using File::read", path);
+    return sd_raw_open_fs(g_sd_fs, path, out);
+}
+
+esp_err_t sd_raw_open_fs(fs::FS& fs, const char* path, sd_raw_file_t& out)
+{
+    out.runs.clear();
+    out.bounce = NULL;
+    out.position = 0;
+    out.run_index = 0;
+    out.prefetch = NULL;
+    out.stats = {};
+    out.file = fs.open(path, FILE_READ);
+    if (!out.file) {
+        out.size = 0;
+        return ESP_ERR_NOT_FOUND;
+    }
+    out.size = out.file.size();
+    return ESP_OK;
+}
+
+// Đọc len byte bắt đầu từ pos theo các dải sector; run_index là con trỏ dải của người gọi
+static size_t read_runs(sd_raw_file_t& f, size_t& run_index, uint32_t pos, uint8_t* buf, size_t len)
+{
+    const uint32_t ss = f.sector_size;
+    len = std::min<size_t>(len, f.size - pos);   // File rỗng: không có dải nào
+    size_t done = 0;
+
+    if (len > 0 && pos < f.runs[run_index].file_offset) {
+        run_index = 0;
+    }
+    while (done < len) {
+        while (pos >= f.runs[run_index].file_offset + f.runs[run_index].sectors * ss) {
+            run_index++;
+        }
+        const sd_raw_run_t& run = f.runs[run_index];
+        const uint32_t in_run = pos - run.file_offset;
+        const uint32_t lba = run.lba + in_run / ss;
+        const uint32_t sector_offset = in_run % ss;
+        const size_t remain = len - done;
+
+        if (sector_offset == 0 && remain >= ss) {
+            // Nhiều sector nguyên: đọc thẳng vào buffer của caller, tối đa hết dải
+            uint32_t count = std::min<uint32_t>(remain / ss, run.sectors - in_run / ss);
+            if (ff_disk_read(f.pdrv, buf + done, lba, count) != RES_OK) {
+                ESP_LOGE(TAG, "Read of %" PRIu32 " sector(s) at %" PRIu32 " failed", count, lba);
+                break;
+            }
+            done += count * ss;
+            pos += count * ss;
+        } else {
+            // Đầu/cuối lệch sector: đọc 1 sector qua bộ đệm
+            if (ff_disk_read(f.pdrv, f.bounce, lba, 1) != RES_OK) {
+                ESP_LOGE(TAG, "Read of sector %" PRIu32 " failed", lba);
+                break;
+            }
+            size_t n = std::min<size_t>(ss - sector_offset, remain);
+            memcpy(buf + done, f.bounce + sector_offset, n);
+            done += n;
+            pos += n;
+        }
+    }
+    return done;
+}
+
+// --- ĐỌC TRƯỚC (READ-AHEAD) ---
+
+static void readahead_task(void* arg)
+{
+    sd_raw_prefetch_t* p = (sd_raw_prefetch_t*) arg;
+    sd_raw_file_t& f = *p->file;
+    uint8_t idx;
+
+    while (xQueueReceive(p->free_q, &idx, portMAX_DELAY) == pdTRUE) {
+        if (p->stop || idx == READAHEAD_STOP) {
+            break;
+        }
+        if (p->fill_pos >= f.size) {
+            continue;   // Hết file: giữ buffer lại, chờ lệnh dừng
+        }
+        // Buffer đầu tiên chỉ đọc tới ranh giới buf_size để các lần sau thẳng hàng sector
+        uint32_t want = std::min(p->buf_size - p->fill_pos % p->buf_size, f.size - p->fill_pos);
+        ra_buffer_t& b = p->bufs[idx];
+        b.len = read_runs(f, p->fill_run, p->fill_pos, b.data, want);
+        if (b.len != want) {
+            b.len = 0;
+            p->fill_pos = f.size;   // Lỗi thẻ: không đọc tiếp
+        } else {
+            p->fill_pos += want;
+        }
+        xQueueSend(p->ready_q, &idx, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(p->done);
+    vTaskDelete(NULL);
+}
+
+static void readahead_free(sd_raw_prefetch_t* p)
+{
+    for (ra_buffer_t& b : p->bufs) {
+        free(b.data);
+    }
+    if (p->free_q) vQueueDelete(p->free_q);
+    if (p->ready_q) vQueueDelete(p->ready_q);
+    if (p->done) vSemaphoreDelete(p->done);
+    free(p);
+}
+
+static void readahead_stop(sd_raw_file_t& f)
+{
+    sd_raw_prefetch_t* p = f.prefetch;
+    if (!p) {
+        return;
+    }
+    p->stop = true;
+    const uint8_t stop = READAHEAD_STOP;
+    xQueueSend(p->free_q, &stop, portMAX_DELAY);   // free_q có dư 1 chỗ cho lệnh dừng
+    xSemaphoreTake(p->done, portMAX_DELAY);
+    readahead_free(p);
+    f.prefetch = NULL;
+}
+
+esp_err_t sd_raw_start_readahead(sd_raw_file_t& f)
+{
+#if CONFIG_SD_READAHEAD_DEPTH > 0
+    if (f.file || f.prefetch) {
+        return ESP_OK;  // Fallback File::read đã có bộ đệm stdio, hoặc đang chạy
+    }
+
+    sd_raw_prefetch_t* p = (sd_raw_prefetch_t*) calloc(1, sizeof(sd_raw_prefetch_t));
+    if (!p) {
+        return ESP_ERR_NO_MEM;
+    }
+    p->file = &f;
+    p->buf_size = CONFIG_SD_READAHEAD_BUF_KB * 1024;
+    p->fill_pos = f.position;
+    p->fill_run = f.run_index;
+    p->cur = -1;
+    p->free_q = xQueueCreate(CONFIG_SD_READAHEAD_DEPTH + 1, sizeof(uint8_t));
+    p->ready_q = xQueueCreate(CONFIG_SD_READAHEAD_DEPTH, sizeof(uint8_t));
+    p->done = xSemaphoreCreateBinary();
+    bool ok = p->free_q && p->ready_q && p->done;
+    for (uint8_t i = 0; ok && i < CONFIG_SD_READAHEAD_DEPTH; i++) {
+        p->bufs[i].data = (uint8_t*) heap_caps_malloc(p->buf_size, MALLOC_CAP_DMA);
+        ok = p->bufs[i].data && xQueueSend(p->free_q, &i, 0) == pdTRUE;
+    }
+    // Ưu tiên cao hơn người đọc 1 bậc để buffer được nạp lại ngay khi trả về
+    if (!ok || xTaskCreate(readahead_task, "sd_readahead", READAHEAD_STACK, p,
+                           uxTaskPriorityGet(NULL) + 1, NULL) != pdPASS) {
+        ESP_LOGW(TAG, "Read-ahead unavailable, reading synchronously");
+        readahead_free(p);
+        return ESP_ERR_NO_MEM;
+    }
+    f.prefetch = p;
+#endif
+    return ESP_OK;
+}
+
+static size_t read_prefetched(sd_raw_file_t& f, uint8_t* buf, size_t len)
+{
+    sd_raw_prefetch_t* p = f.prefetch;
+    len = std::min<size_t>(len, f.size - f.position);
+    size_t done = 0;
+
+    while (done < len && !p->failed) {
+        if (p->cur < 0) {
+            uint8_t idx;
+            if (xQueueReceive(p->ready_q, &idx, 0) == pdTRUE) {
+                f.stats.hits++;
+            } else {
+                int64_t start = esp_timer_get_time();
+                xQueueReceive(p->ready_q, &idx, portMAX_DELAY);
+                f.stats.stalls++;
+                f.stats.stall_us += (uint32_t) (esp_timer_get_time() - start);
+            }
+            if (p->bufs[idx].len == 0) {
+                xQueueSend(p->free_q, &idx, 0);
+                p->failed = true;
+                break;
+            }
+            p->cur = idx;
+            p->cur_used = 0;
+        }
+
+        ra_buffer_t& b = p->bufs[p->cur];
+        size_t n = std::min<size_t>(b.len - p->cur_used, len - done);
+        memcpy(buf + done, b.data + p->cur_used, n);
+        p->cur_used += n;
+        done += n;
+        f.position += n;
+
+        if (p->cur_used == b.len) {
+            uint8_t idx = (uint8_t) p->cur;
+            xQueueSend(p->free_q, &idx, 0);
+            p->cur = -1;
+        }
+    }
+    return done;
+}
+
+size_t sd_raw_read(sd_raw_file_t& f, uint8_t* buf, size_t len)
+{
+    if (f.file) {
+        size_t n = f.file.read(buf, len);
+        f.position += n;
+        return n;
+    }
+    if (f.prefetch) {
+        return read_prefetched(f, buf, len);
+    }
+    size_t n = read_runs(f, f.run_index, f.position, buf, len);
+    f.position += n;
+    return n;
+}
+
+bool sd_raw_seek(sd_raw_file_t& f, uint32_t pos)
+{
+    if (pos > f.size) {
+        return false;
+    }
+    if (f.file) {
+        if (!f.file.seek(pos)) return false;
+    } else if (f.prefetch && pos != f.position) {
+        // Đọc trước chỉ phục vụ tuần tự: nhảy vị trí thì khởi động lại từ pos mới
+        readahead_stop(f);
+        f.position = pos;
+        return sd_raw_start_readahead(f) == ESP_OK;
+    }
+    f.position = pos;
+    return true;
+}
+
+void sd_raw_close(sd_raw_file_t& f)
+{
+    readahead_stop(f);
+    if (f.stats.hits + f.stats.stalls > 0) {
+        ESP_LOGI(TAG, "Read-ahead: %" PRIu32 " hit(s), %" PRIu32 " stall(s), %" PRIu32 " ms waiting",
+                 f.stats.hits, f.stats.stalls, f.stats.stall_us / 1000);
+    }
+    if (f.file) {
+        f.file.close();
+    }
+    free(f.bounce);
+    f.bounce = NULL;
+    f.runs.clear();
+}
+
+// --- ĐO TẢI CPU: đếm số vòng lặp của idle task trong lúc đọc ---
+// Hook trả về false để idle không ngủ (WFI), số vòng tỉ lệ với thời gian CPU rảnh.
+static volatile uint32_t s_idle_loops;
+
+static bool idle_counter_hook(void)
+{
+    s_idle_loops++;
+    return false;
+}
+
+typedef struct {
+    uint32_t bytes;
+    int64_t  us;
+    uint32_t idle_loops;
+} bench_result_t;
+
+static double mb_per_s(const bench_result_t& r)
+{
+    return r.us > 0 ? (double) r.bytes / (double) r.us : 0.0;   // byte/us == MB/s
+}
+
+static double cpu_load(const bench_result_t& r, double idle_loops_per_us)
+{
+    double idle = (r.us > 0 && idle_loops_per_us > 0) ? r.idle_loops / (idle_loops_per_us * r.us) : 0.0;
+    return idle >= 1.0 ? 0.0 : (1.0 - idle) * 100.0;
+}
+
+static void bench_file_read(const char* path, uint8_t* buffer, bench_result_t& out)
+{
+    File file = g_sd_fs.open(path, FILE_READ);
+    if (!file) {
+        return;
+    }
+    s_idle_loops = 0;
+    int64_t start = esp_timer_get_time();
+    size_t n;
+    while ((n = file.read(buffer, BENCH_BUFFER_SIZE)) > 0) {
+        out.bytes += n;
+    }
+    out.us = esp_timer_get_time() - start;
+    out.idle_loops = s_idle_loops;
+    file.close();
+}
+
+// Tính cả thời gian dò chuỗi cluster lúc mở
+static size_t bench_raw_read(const char* path, uint8_t* buffer, bool readahead, bench_result_t& out)
+{
+    sd_raw_file_t raw;
+    s_idle_loops = 0;
+    int64_t start = esp_timer_get_time();
+    if (sd_raw_open(path, raw) != ESP_OK) {
+        return 0;
+    }
+    if (readahead) {
+        sd_raw_start_readahead(raw);
+    }
+    size_t n;
+    while ((n = sd_raw_read(raw, buffer, BENCH_BUFFER_SIZE)) > 0) {
+        out.bytes += n;
+    }
+    out.us = esp_timer_get_time() - start;
+    out.idle_loops = s_idle_loops;
+    size_t runs = raw.runs.size();
+    sd_raw_close(raw);
+    return runs;
+}
+
+void sd_raw_benchmark(const char* path)
+{
+    uint8_t* buffer = (uint8_t*) heap_caps_malloc(BENCH_BUFFER_SIZE, MALLOC_CAP_DMA);
+    if (!buffer) {
+        ESP_LOGE(TAG, "Failed to allocate benchmark buffer!");
+        return;
+    }
+    if (esp_register_freertos_idle_hook(idle_counter_hook) != ESP_OK) {
+        free(buffer);
+        return;
+    }
+
+    // Hiệu chuẩn: số vòng idle / us khi CPU hoàn toàn rảnh
+    s_idle_loops = 0;
+    int64_t start = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(100));
+    double idle_rate = (double) s_idle_loops / (double) (esp_timer_get_time() - start);
+
+    bench_result_t file_res = {};
+    bench_result_t raw_res = {};
+    bench_result_t ra_res = {};
+    bench_file_read(path, buffer, file_res);
+    size_t runs = bench_raw_read(path, buffer, false, raw_res);
+    bench_raw_read(path, buffer, true, ra_res);
+
+    esp_deregister_freertos_idle_hook(idle_counter_hook);
+    free(buffer);
+
+    ESP_LOGI(TAG, "%s: %" PRIu32 " bytes, %zu run(s)%s", path, raw_res.bytes, runs, runs > 1 ? " (fragmented)" : "");
+    ESP_LOGI(TAG, "  File::read : %.2f MB/s, CPU %.0f%%", mb_per_s(file_res), cpu_load(file_res, idle_rate));
+    ESP_LOGI(TAG, "  sd_raw_read: %.2f MB/s, CPU %.0f%%", mb_per_s(raw_res), cpu_load(raw_res, idle_rate));
+    ESP_LOGI(TAG, "  read-ahead : %.2f MB/s, CPU %.0f%%", mb_per_s(ra_res), cpu_load(ra_res, idle_rate));
+}
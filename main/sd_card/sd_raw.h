@@ -0,0 +1,104 @@
+/**
+ * @file sd_raw.h
+ * @brief Đọc file firmware trực tiếp theo sector của thẻ SD.
+ *
+ * Chuỗi cluster của file được dò 1 lần lúc mở và gộp thành các dải sector
+ * liên tiếp. Mỗi lần đọc sau đó là 1 lệnh đọc nhiều block (CMD18, driver
+ * sdspi dùng DMA) ghi thẳng vào buffer của caller, không qua stdio/VFS và không
+ * duyệt bảng FAT nữa.
+ */
+
+#pragma once
+
+#include "FS.h"
+#include <vector>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Một dải sector liên tiếp trên thẻ chứa một phần của file.
+ */
+typedef struct {
+    uint32_t file_offset;   // Vị trí byte trong file của sector đầu dải
+    uint32_t lba;           // Sector vật lý đầu dải
+    uint32_t sectors;       // Số sector của dải
+} sd_raw_run_t;
+
+/**
+ * @brief Thống kê đọc trước của 1 file.
+ */
+typedef struct {
+    uint32_t hits;          // Số buffer đã đầy sẵn khi cần
+    uint32_t stalls;        // Số lần phải chờ task đọc trước
+    uint32_t stall_us;      // Tổng thời gian chờ
+} sd_raw_stats_t;
+
+typedef struct sd_raw_prefetch sd_raw_prefetch_t;
+
+/**
+ * @brief File đang mở để đọc raw.
+ * Nếu không dò được chuỗi cluster (ví dụ volume không phải FatFs),
+ * `file` được mở và mọi thao tác đi qua File::read như cũ.
+ */
+typedef struct {
+    std::vector<sd_raw_run_t> runs;
+    File      file;             // Chỉ dùng khi fallback
+    uint8_t*  bounce;           // 1 sector, cho phần đầu/cuối không thẳng hàng sector
+    uint32_t  size;
+    uint32_t  position;
+    size_t    run_index;        // Dải chứa `position` (con trỏ đọc tuần tự)
+    sd_raw_prefetch_t* prefetch;  // != NULL khi đang đọc trước
+    sd_raw_stats_t     stats;
+    uint16_t  sector_size;
+    uint8_t   pdrv;
+} sd_raw_file_t;
+
+/**
+ * @brief Mở file trên thẻ SD đã mount và dò chuỗi cluster của nó.
+ * @param path Đường dẫn như SD.open (ví dụ "/fw/app.bin").
+ * @param out  File raw, phải đóng bằng sd_raw_close.
+ * @return
+ * - ESP_OK: Mở thành công (raw hoặc fallback File).
+ * - ESP_ERR_NOT_FOUND: Không mở được file.
+ * - ESP_ERR_NO_MEM: Không đủ bộ nhớ.
+ */
+esp_err_t sd_raw_open(const char* path, sd_raw_file_t& out);
+
+/**
+ * @brief Mở file trên 1 fs::FS bất kỳ (ví dụ cache LittleFS nội) với cùng giao diện đọc,
+ * mọi thao tác đi qua File::read.
+ * @return ESP_OK hoặc ESP_ERR_NOT_FOUND.
+ */
+esp_err_t sd_raw_open_fs(fs::FS& fs, const char* path, sd_raw_file_t& out);
+
+/**
+ * @brief Đọc tuần tự từ vị trí hiện tại.
+ * @return Số byte đọc được (0 khi hết file hoặc lỗi thẻ).
+ */
+size_t sd_raw_read(sd_raw_file_t& f, uint8_t* buf, size_t len);
+
+/**
+ * @brief Bật đọc trước tuần tự: task nền đọc sẵn CONFIG_SD_READAHEAD_DEPTH buffer
+ * x CONFIG_SD_READAHEAD_BUF_KB KB phía trước vị trí hiện tại. Seek tới vị trí khác
+ * sẽ khởi động lại từ đó. Không làm gì nếu DEPTH = 0 hoặc đang dùng fallback File.
+ * Trong lúc đọc trước, file không được di chuyển trong bộ nhớ.
+ * @return ESP_OK, hoặc ESP_ERR_NO_MEM (vẫn đọc được, nhưng đồng bộ).
+ */
+esp_err_t sd_raw_start_readahead(sd_raw_file_t& f);
+
+/**
+ * @brief Đặt lại vị trí đọc.
+ * @return false nếu pos vượt quá kích thước file.
+ */
+bool sd_raw_seek(sd_raw_file_t& f, uint32_t pos);
+
+/**
+ * @brief Dừng đọc trước (nếu có), in thống kê hit/stall, đóng file và giải phóng bộ đệm.
+ */
+void sd_raw_close(sd_raw_file_t& f);
+
+/**
+ * @brief Đo tốc độ đọc (MB/s) và tải CPU của sd_raw_read so với File::read trên cùng file.
+ * Số dải sector được in kèm để phân biệt file liền mạch và file bị phân mảnh.
+ */
+void sd_raw_benchmark(const char* path);
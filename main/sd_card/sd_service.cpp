@@ -0,0 +1,96 @@
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "sdkconfig.h"
+#include "sd_service.h"
+
+static const char *TAG = "SD_SERVICE";
+
+// Ưu tiên thấp nhất trong các task của Host (xem bảng trong main.cpp): mount/dựng catalog
+// chỉ chạy khi UI và đường dữ liệu đang chờ. Stack đủ cho FatFs mount + ArduinoJson khi dựng chỉ mục.
+#define STORAGE_TASK_STACK      4096
+#define STORAGE_TASK_PRIORITY   3
+#define STORAGE_EVENT_QUEUE_LEN 4
+
+#define STORAGE_BIT_PAUSE   BIT0    // Có phiên nạp: không đụng tới thẻ
+#define STORAGE_BIT_IDLE    BIT1    // Task không ở trong sd_hotplug_poll
+
+typedef struct {
+    sd_hotplug_event_t event;
+    esp_err_t          err;
+} storage_msg_t;
+
+static EventGroupHandle_t s_storage_bits = NULL;
+static QueueHandle_t      s_storage_queue = NULL;
+static int                s_cs_pin = -1;
+
+static void storage_task(void* arg)
+{
+    for (;;) {
+        // Xóa IDLE trước rồi mới xem PAUSE: sd_service_wait_paused hoặc thấy IDLE đang set
+        // (task sẽ thấy PAUSE ở bước kế), hoặc chờ tới khi lần poll này xong
+        xEventGroupClearBits(s_storage_bits, STORAGE_BIT_IDLE);
+        if (!(xEventGroupGetBits(s_storage_bits) & STORAGE_BIT_PAUSE)) {
+            storage_msg_t msg = { SD_HOTPLUG_NONE, ESP_OK };
+            msg.event = sd_hotplug_poll(s_cs_pin, &msg.err);
+            if (msg.event != SD_HOTPLUG_NONE) {
+                // Không chờ UI: queue đầy thì bỏ sự kiện, task storage không bao giờ bị UI chặn
+                if (xQueueSend(s_storage_queue, &msg, 0) != pdTRUE) {
+                    ESP_LOGW(TAG, "UI queue full, hot-plug event %d dropped", (int) msg.event);
+                }
+                ESP_LOGD(TAG, "Stack high-water mark: %u bytes", (unsigned) uxTaskGetStackHighWaterMark(NULL));
+            }
+        }
+        xEventGroupSetBits(s_storage_bits, STORAGE_BIT_IDLE);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SD_HOTPLUG_POLL_MS));
+    }
+}
+
+esp_err_t sd_service_start(int cs_pin)
+{
+    if (s_storage_bits != NULL) return ESP_OK;
+
+    s_storage_bits = xEventGroupCreate();
+    s_storage_queue = xQueueCreate(STORAGE_EVENT_QUEUE_LEN, sizeof(storage_msg_t));
+    if (s_storage_bits == NULL || s_storage_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate storage task resources!");
+        return ESP_ERR_NO_MEM;
+    }
+    s_cs_pin = cs_pin;
+    xEventGroupSetBits(s_storage_bits, STORAGE_BIT_IDLE);
+
+    if (xTaskCreate(storage_task, "storage", STORAGE_TASK_STACK, NULL, STORAGE_TASK_PRIORITY, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create storage task!");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+bool sd_service_poll(sd_hotplug_event_t* event, esp_err_t* err)
+{
+    if (s_storage_queue == NULL) return false;
+    storage_msg_t msg;
+    if (xQueueReceive(s_storage_queue, &msg, 0) != pdTRUE) return false;
+    if (event) *event = msg.event;
+    if (err) *err = msg.err;
+    return true;
+}
+
+void sd_service_pause(bool pause)
+{
+    if (s_storage_bits == NULL) return;
+    if (!pause) {
+        xEventGroupClearBits(s_storage_bits, STORAGE_BIT_PAUSE);
+        return;
+    }
+    xEventGroupSetBits(s_storage_bits, STORAGE_BIT_PAUSE);
+}
+
+bool sd_service_wait_paused(uint32_t timeout_ms)
+{
+    if (s_storage_bits == NULL) return true;
+    EventBits_t bits = xEventGroupWaitBits(s_storage_bits, STORAGE_BIT_IDLE, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms));
+    return (bits & STORAGE_BIT_IDLE) != 0;
+}
@@ -0,0 +1,42 @@
+/**
+ * @file sd_service.h
+ * @brief Task storage: theo dõi thẻ SD (hot-plug) ngoài task UI.
+ *
+ * Mount, dò clock và dựng lại catalog mất vài trăm ms tới vài giây; chạy trên task riêng
+ * để nút nhấn và OLED không bị treo theo. Kết quả được gửi cho UI qua queue
+ * (sd_service_poll), UI chỉ vẽ lại menu. Trong lúc có phiên nạp, task bị tạm dừng
+ * (sd_service_pause) để không tranh bus SPI với đường dữ liệu.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sd_card.h"
+
+/**
+ * @brief Tạo task storage. Gọi 1 lần sau khi setup() đã thử mount thẻ lần đầu.
+ * @param cs_pin Chân CS của thẻ SD (như sd_mount).
+ * @return ESP_OK, hoặc ESP_ERR_NO_MEM nếu không tạo được task/queue.
+ */
+esp_err_t sd_service_start(int cs_pin);
+
+/**
+ * @brief Lấy 1 sự kiện hot-plug (không chặn). Gọi từ task UI.
+ * @param err Mã lỗi kèm theo khi event là SD_HOTPLUG_FAILED.
+ * @return true nếu có sự kiện.
+ */
+bool sd_service_poll(sd_hotplug_event_t* event, esp_err_t* err);
+
+/**
+ * @brief Tạm dừng / chạy lại việc kiểm tra thẻ. Không chặn: lần mount/dựng catalog đang dở
+ * vẫn chạy tiếp, dùng sd_service_wait_paused để chờ nó xong.
+ */
+void sd_service_pause(bool pause);
+
+/**
+ * @brief Chờ tối đa timeout_ms tới khi task storage không còn đụng tới thẻ (sau sd_service_pause(true)).
+ * Gọi từ task nạp, không gọi từ task UI.
+ * @return true nếu thẻ đã rảnh (hoặc chưa có task storage).
+ */
+bool sd_service_wait_paused(uint32_t timeout_ms);
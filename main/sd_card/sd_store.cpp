@@ -0,0 +1,51 @@
+#include <ctype.h>
+#include "esp_log.h"
+#include "sd_store.h"
+
+static const char *TAG = "SD_STORE";
+
+bool sd_store_valid_hash(const std::string& sha256)
+{
+    if (sha256.length() != SD_STORE_HASH_LEN) return false;
+    for (char c : sha256) {
+        if (!isxdigit((unsigned char) c)) return false;
+    }
+    return true;
+}
+
+std::string sd_store_blob_path(const std::string& sha256)
+{
+    if (!sd_store_valid_hash(sha256)) return "";
+    std::string hash = sha256;
+    for (char& c : hash) c = tolower((unsigned char) c);
+    return std::string(SD_STORE_DIR "/") + hash.substr(0, 2) + "/" + hash + ".bin";
+}
+
+static void resolve_one(std::string& path, const std::string& sha256)
+{
+    if (!path.empty() || sha256.empty()) return;
+    path = sd_store_blob_path(sha256);
+    if (path.empty()) {
+        ESP_LOGW(TAG, "Invalid SHA-256 in catalog: %s", sha256.c_str());
+    }
+}
+
+void sd_store_resolve(firmware_metadata_t& metadata)
+{
+    resolve_one(metadata.path_bootloader, metadata.sha256_bootloader);
+    resolve_one(metadata.path_partition, metadata.sha256_partition);
+    resolve_one(metadata.path, metadata.sha256);
+}
+
+bool sd_store_digest_equal(const uint8_t digest[SD_STORE_DIGEST_LEN], const std::string& sha256)
+{
+    static const char hex[] = "0123456789abcdef";
+    if (!sd_store_valid_hash(sha256)) return false;
+    for (int i = 0; i < SD_STORE_DIGEST_LEN; i++) {
+        if (tolower((unsigned char) sha256[i * 2]) != hex[digest[i] >> 4] ||
+            tolower((unsigned char) sha256[i * 2 + 1]) != hex[digest[i] & 0xF]) {
+            return false;
+        }
+    }
+    return true;
+}
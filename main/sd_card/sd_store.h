@@ -0,0 +1,45 @@
+/**
+ * @file sd_store.h
+ * @brief Kho blob theo nội dung trên thẻ SD.
+ *
+ * Mỗi ảnh (bootloader, partition table, app) được lưu 1 lần dưới tên là SHA-256
+ * của chính nó: /blobs/<2 ký tự đầu>/<64 ký tự hex>.bin (tên dài: cần CONFIG_FATFS_LFN_HEAP,
+ * đã bật trong sdkconfig). Nhiều firmware dùng chung
+ * bootloader/partition -> cùng 1 file trên thẻ, cùng 1 bản trong cache nội và cache RAM
+ * (các cache này khóa theo MD5 nội dung nên cũng chỉ giữ 1 bản).
+ *
+ * Trong index.txt, entry chỉ cần "sha256" / "sha256_bootloader" / "sha256_partition"
+ * thay cho "path*"; "md5*" vẫn cần vì target chỉ tính được MD5 (bỏ qua ảnh đã có,
+ * kiểm tra sau khi ghi). SHA-256 được kiểm tra lúc chép ảnh vào cache nội.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include "esp_err.h"
+#include "sd_card.h"
+
+#define SD_STORE_DIR        "/blobs"
+#define SD_STORE_HASH_LEN   64      // SHA-256 dạng hex
+#define SD_STORE_DIGEST_LEN 32
+
+/**
+ * @brief Chuỗi là SHA-256 hợp lệ (64 ký tự hex).
+ */
+bool sd_store_valid_hash(const std::string& sha256);
+
+/**
+ * @brief Đường dẫn blob của SHA-256 (chữ thường), "" nếu hash không hợp lệ.
+ */
+std::string sd_store_blob_path(const std::string& sha256);
+
+/**
+ * @brief Điền đường dẫn blob cho các ảnh chỉ có SHA-256 (giữ nguyên path đã ghi rõ).
+ */
+void sd_store_resolve(firmware_metadata_t& metadata);
+
+/**
+ * @brief So digest 32 byte với SHA-256 dạng hex (không phân biệt hoa/thường).
+ */
+bool sd_store_digest_equal(const uint8_t digest[SD_STORE_DIGEST_LEN], const std::string& sha256);
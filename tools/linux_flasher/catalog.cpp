@@ -0,0 +1,64 @@
+#include "catalog.h"
+#include "ArduinoJson.h"
+#include <fstream>
+#include <cstdio>
+#include <cctype>
+
+static const char *METADATA_FILE_PATH = "/index.txt";
+static const char *BLOB_DIR = "/blobs";
+
+// Giống main/sd_card/sd_store.cpp: path rỗng + SHA-256 hợp lệ -> /blobs/ab/ab...ef.bin
+static void resolve_blob(std::string& path, const std::string& sha256)
+{
+    if (!path.empty() || sha256.length() != 64) return;
+    std::string hash = sha256;
+    for (char& c : hash) {
+        if (!isxdigit((unsigned char) c)) return;
+        c = tolower((unsigned char) c);
+    }
+    path = std::string(BLOB_DIR) + "/" + hash.substr(0, 2) + "/" + hash + ".bin";
+}
+
+bool catalog_load(const std::string& root, std::map<std::string, firmware_metadata_t>& out)
+{
+    std::ifstream file(root + METADATA_FILE_PATH);
+    if (!file) {
+        fprintf(stderr, "[catalog] cannot open %s%s\n", root.c_str(), METADATA_FILE_PATH);
+        return false;
+    }
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    if (error) {
+        fprintf(stderr, "[catalog] JSON parse error: %s\n", error.c_str());
+        return false;
+    }
+
+    out.clear();
+    for (JsonObject firmware_obj : doc.as<JsonArray>()) {
+        const char* fw_id = firmware_obj["fw_id"];
+        if (!fw_id) {
+            fprintf(stderr, "[catalog] entry without fw_id, skipping\n");
+            continue;
+        }
+        out[fw_id] = firmware_metadata_t{
+            .device_type = firmware_obj["device_type"] | "",
+            .version = firmware_obj["version"] | "",
+            .path = firmware_obj["path"] | "",
+            .md5 = firmware_obj["md5"] | "",
+            .path_bootloader = firmware_obj["path_bootloader"] | "",
+            .md5_bootloader = firmware_obj["md5_bootloader"] | "",
+            .path_partition = firmware_obj["path_partition"] | "",
+            .md5_partition = firmware_obj["md5_partition"] | "",
+            .path_pack = firmware_obj["pack"] | "",
+            .sha256 = firmware_obj["sha256"] | "",
+            .sha256_bootloader = firmware_obj["sha256_bootloader"] | "",
+            .sha256_partition = firmware_obj["sha256_partition"] | ""
+        };
+        firmware_metadata_t& metadata = out[fw_id];
+        resolve_blob(metadata.path_bootloader, metadata.sha256_bootloader);
+        resolve_blob(metadata.path_partition, metadata.sha256_partition);
+        resolve_blob(metadata.path, metadata.sha256);
+    }
+    return true;
+}
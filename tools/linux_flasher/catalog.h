@@ -0,0 +1,37 @@
+/**
+ * @file catalog.h
+ * @brief Đọc file index.txt (cùng định dạng JSON với thẻ SD của thiết bị Host).
+ */
+
+#pragma once
+
+#include <string>
+#include <map>
+
+/**
+ * @brief Metadata của một firmware, giống hệt firmware_metadata_t trong main/sd_card/sd_card.h.
+ * Các path là đường dẫn tính từ gốc thẻ SD (ví dụ "/FW_S3_V1/app.bin").
+ */
+typedef struct {
+    std::string device_type;
+    std::string version;
+    std::string path;
+    std::string md5;
+    std::string path_bootloader;
+    std::string md5_bootloader;
+    std::string path_partition;
+    std::string md5_partition;
+    std::string path_pack;
+    std::string sha256;             // Kho blob: ảnh nằm ở /blobs/<2 hex>/<sha256>.bin nếu không có path
+    std::string sha256_bootloader;
+    std::string sha256_partition;
+} firmware_metadata_t;
+
+/**
+ * @brief Parse <root>/index.txt vào map fw_id -> metadata.
+ * Ảnh chỉ ghi SHA-256 được gán đường dẫn blob (như sd_store_resolve của Host).
+ * @param root Thư mục gốc (bản sao thẻ SD trên máy Linux).
+ * @param out  Map kết quả (bị xóa trước khi nạp).
+ * @return true nếu đọc và parse thành công.
+ */
+bool catalog_load(const std::string& root, std::map<std::string, firmware_metadata_t>& out);
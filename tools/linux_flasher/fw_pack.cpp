@@ -0,0 +1,303 @@
+/*
+ * fw_pack: đóng gói bootloader + partition table + app của 1 build ESP-IDF thành 1 file .fwp
+ * (định dạng ở main/flasher/fw_pack_format.h) để Host nạp bằng 1 lượt đọc tuần tự.
+ *
+ *   fw_pack -o FW_S3_V1.fwp <build_dir>     Tạo pack từ <build_dir>/flasher_args.json
+ *   fw_pack -i FW_S3_V1.fwp                 Kiểm tra pack (MD5 header, block, segment)
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include "ArduinoJson.h"
+#include "md5_hash.h"
+#include "fw_pack_format.h"
+
+typedef struct {
+    uint32_t             address;
+    std::string          name;
+    std::string          path;
+    bool                 is_app;
+    std::vector<uint8_t> data;
+} input_segment_t;
+
+static uint32_t align_up(uint32_t value, uint32_t align)
+{
+    return (value + align - 1) / align * align;
+}
+
+static void md5(const uint8_t *data, size_t len, uint8_t out[FW_PACK_MD5_LEN])
+{
+    MD5Context ctx;
+    MD5Init(&ctx);
+    MD5Update(&ctx, data, len);
+    MD5Final(out, &ctx);
+}
+
+static std::string md5_hex(const uint8_t digest[FW_PACK_MD5_LEN])
+{
+    char hex[FW_PACK_MD5_LEN * 2 + 1];
+    for (int i = 0; i < FW_PACK_MD5_LEN; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+static bool read_file(const std::string& path, std::vector<uint8_t>& out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return false;
+    }
+    out.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// MD5 của header (trường header_md5 = 0) + bảng segment + bảng block
+static void header_digest(fw_pack_header_t hdr, const fw_pack_segment_t *segs, const uint8_t *blocks,
+                          uint8_t out[FW_PACK_MD5_LEN])
+{
+    memset(hdr.header_md5, 0, sizeof(hdr.header_md5));
+    MD5Context ctx;
+    MD5Init(&ctx);
+    MD5Update(&ctx, (const uint8_t *) &hdr, sizeof(hdr));
+    MD5Update(&ctx, (const uint8_t *) segs, hdr.segment_count * sizeof(fw_pack_segment_t));
+    MD5Update(&ctx, blocks, hdr.block_count * FW_PACK_MD5_LEN);
+    MD5Final(out, &ctx);
+}
+
+// MD5 từng block 4KB của 1 ảnh, block cuối đệm 0xFF (giống flash sau khi ghi)
+static void block_digests(const std::vector<uint8_t>& data, std::vector<uint8_t>& table)
+{
+    for (size_t pos = 0; pos < data.size(); pos += FW_PACK_BLOCK_SIZE) {
+        uint8_t block[FW_PACK_BLOCK_SIZE];
+        size_t len = std::min<size_t>(FW_PACK_BLOCK_SIZE, data.size() - pos);
+        memcpy(block, &data[pos], len);
+        memset(block + len, 0xFF, sizeof(block) - len);
+
+        uint8_t digest[FW_PACK_MD5_LEN];
+        md5(block, sizeof(block), digest);
+        table.insert(table.end(), digest, digest + FW_PACK_MD5_LEN);
+    }
+}
+
+// flasher_args.json do idf.py sinh ra: "flash_files" { "0x10000": "app.bin", ... }
+// và mỗi phân vùng có 1 object { "offset", "file" } mang tên của nó.
+static bool load_build_dir(const std::string& build_dir, std::vector<input_segment_t>& out)
+{
+    std::ifstream file(build_dir + "/flasher_args.json");
+    if (!file) {
+        fprintf(stderr, "cannot open %s/flasher_args.json (run idf.py build first)\n", build_dir.c_str());
+        return false;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, file);
+    if (error) {
+        fprintf(stderr, "flasher_args.json parse error: %s\n", error.c_str());
+        return false;
+    }
+
+    for (JsonPair entry : doc["flash_files"].as<JsonObject>()) {
+        input_segment_t seg;
+        seg.address = strtoul(entry.key().c_str(), NULL, 0);
+        seg.path = build_dir + "/" + entry.value().as<std::string>();
+        seg.is_app = false;
+
+        // Tên phân vùng: object cùng "file" ("bootloader", "partition-table", "app", "otadata", ...)
+        for (JsonPair part : doc.as<JsonObject>()) {
+            if (part.value()["file"].is<const char*>() && part.value()["file"] == entry.value()) {
+                seg.name = part.key().c_str();
+                seg.is_app = (seg.name == "app");
+                break;
+            }
+        }
+        if (seg.name.empty()) {
+            seg.name = entry.value().as<std::string>();
+            seg.name = seg.name.substr(seg.name.find_last_of('/') + 1);
+        }
+        if (seg.name == "partition-table") seg.name = "partition";  // Cùng tên với flasher.cpp
+        if (seg.name.size() >= FW_PACK_NAME_LEN) seg.name.resize(FW_PACK_NAME_LEN - 1);
+
+        if (!read_file(seg.path, seg.data)) return false;
+        out.push_back(std::move(seg));
+    }
+    return true;
+}
+
+static int build_pack(const std::string& build_dir, const std::string& out_path)
+{
+    std::vector<input_segment_t> inputs;
+    if (!load_build_dir(build_dir, inputs)) return EXIT_FAILURE;
+    if (inputs.empty() || inputs.size() > FW_PACK_MAX_SEGMENTS) {
+        fprintf(stderr, "need 1..%d segments, got %zu\n", FW_PACK_MAX_SEGMENTS, inputs.size());
+        return EXIT_FAILURE;
+    }
+    std::sort(inputs.begin(), inputs.end(),
+              [](const input_segment_t& a, const input_segment_t& b) { return a.address < b.address; });
+
+    // --- KIỂM TRA: Host so sánh/ghi theo sector 4KB ---
+    for (size_t i = 0; i < inputs.size(); i++) {
+        const input_segment_t& seg = inputs[i];
+        if (seg.data.empty() || seg.address % FW_PACK_BLOCK_SIZE != 0) {
+            fprintf(stderr, "%s: empty or not 4KB aligned (0x%08" PRIx32 ")\n", seg.path.c_str(), seg.address);
+            return EXIT_FAILURE;
+        }
+        if (i > 0 && inputs[i - 1].address + inputs[i - 1].data.size() > seg.address) {
+            fprintf(stderr, "%s overlaps %s\n", seg.path.c_str(), inputs[i - 1].path.c_str());
+            return EXIT_FAILURE;
+        }
+    }
+
+    // --- BỐ CỤC ---
+    fw_pack_header_t hdr = {};
+    std::vector<fw_pack_segment_t> segs(inputs.size());
+    std::vector<uint8_t> blocks;
+
+    hdr.magic = FW_PACK_MAGIC;
+    hdr.version = FW_PACK_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.segment_count = inputs.size();
+    hdr.block_size = FW_PACK_BLOCK_SIZE;
+    hdr.block_table_offset = sizeof(hdr) + segs.size() * sizeof(fw_pack_segment_t);
+
+    for (size_t i = 0; i < inputs.size(); i++) {
+        fw_pack_segment_t& seg = segs[i];
+        seg.address = inputs[i].address;
+        seg.raw_size = inputs[i].data.size();
+        seg.stored_size = seg.raw_size;
+        seg.compression = FW_PACK_COMPRESSION_NONE;
+        seg.flags = inputs[i].is_app ? FW_PACK_SEG_APP : 0;
+        seg.first_block = blocks.size() / FW_PACK_MD5_LEN;
+        strncpy(seg.name, inputs[i].name.c_str(), sizeof(seg.name) - 1);
+        md5(inputs[i].data.data(), inputs[i].data.size(), seg.md5);
+        block_digests(inputs[i].data, blocks);
+    }
+    hdr.block_count = blocks.size() / FW_PACK_MD5_LEN;
+    hdr.data_offset = align_up(hdr.block_table_offset + blocks.size(), FW_PACK_DATA_ALIGN);
+
+    uint32_t pos = hdr.data_offset;
+    for (fw_pack_segment_t& seg : segs) {
+        seg.file_offset = pos;
+        pos = align_up(pos + seg.stored_size, FW_PACK_DATA_ALIGN);
+    }
+    hdr.total_size = segs.back().file_offset + segs.back().stored_size;
+    header_digest(hdr, segs.data(), blocks.data(), hdr.header_md5);
+
+    // --- GHI FILE (khoảng đệm căn lề = 0xFF) ---
+    std::vector<uint8_t> pack(hdr.total_size, 0xFF);
+    memcpy(&pack[0], &hdr, sizeof(hdr));
+    memcpy(&pack[sizeof(hdr)], segs.data(), segs.size() * sizeof(fw_pack_segment_t));
+    memcpy(&pack[hdr.block_table_offset], blocks.data(), blocks.size());
+    for (size_t i = 0; i < segs.size(); i++) {
+        memcpy(&pack[segs[i].file_offset], inputs[i].data.data(), inputs[i].data.size());
+    }
+
+    std::ofstream out(out_path, std::ios::binary | std::ios::trunc);
+    if (!out.write((const char *) pack.data(), pack.size())) {
+        fprintf(stderr, "cannot write %s\n", out_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    printf("%s: %zu segments, %" PRIu32 " blocks, %" PRIu32 " bytes\n", out_path.c_str(), segs.size(),
+           hdr.block_count, hdr.total_size);
+    for (const fw_pack_segment_t& seg : segs) {
+        printf("  %-16.16s 0x%08" PRIx32 " %8" PRIu32 " bytes  md5 %s\n", seg.name, seg.address, seg.raw_size,
+               md5_hex(seg.md5).c_str());
+    }
+    printf("index.txt: \"pack\": \"/%s\"\n", out_path.substr(out_path.find_last_of('/') + 1).c_str());
+    return EXIT_SUCCESS;
+}
+
+static int inspect_pack(const std::string& path)
+{
+    std::vector<uint8_t> pack;
+    if (!read_file(path, pack)) return EXIT_FAILURE;
+
+    fw_pack_header_t hdr;
+    if (pack.size() < sizeof(hdr)) {
+        fprintf(stderr, "%s: too small\n", path.c_str());
+        return EXIT_FAILURE;
+    }
+    memcpy(&hdr, pack.data(), sizeof(hdr));
+    if (hdr.magic != FW_PACK_MAGIC || hdr.version != FW_PACK_VERSION || hdr.header_size != sizeof(hdr) ||
+        hdr.segment_count == 0 || hdr.segment_count > FW_PACK_MAX_SEGMENTS || hdr.total_size != pack.size() ||
+        hdr.block_table_offset + (uint64_t) hdr.block_count * FW_PACK_MD5_LEN > hdr.data_offset ||
+        hdr.data_offset > pack.size()) {
+        fprintf(stderr, "%s: not a valid v%d pack\n", path.c_str(), FW_PACK_VERSION);
+        return EXIT_FAILURE;
+    }
+
+    const fw_pack_segment_t *segs = (const fw_pack_segment_t *) &pack[sizeof(hdr)];
+    const uint8_t *blocks = &pack[hdr.block_table_offset];
+    uint8_t digest[FW_PACK_MD5_LEN];
+    header_digest(hdr, segs, blocks, digest);
+    bool ok = memcmp(digest, hdr.header_md5, sizeof(digest)) == 0;
+    printf("%s: %u segments, %" PRIu32 " blocks, header MD5 %s\n", path.c_str(), hdr.segment_count,
+           hdr.block_count, ok ? "OK" : "BAD");
+
+    for (int i = 0; i < hdr.segment_count; i++) {
+        fw_pack_segment_t seg;
+        memcpy(&seg, &segs[i], sizeof(seg));
+        uint32_t nblocks = (seg.raw_size + FW_PACK_BLOCK_SIZE - 1) / FW_PACK_BLOCK_SIZE;
+        if (seg.compression != FW_PACK_COMPRESSION_NONE || seg.stored_size != seg.raw_size ||
+            seg.file_offset + (uint64_t) seg.stored_size > pack.size() || seg.first_block + nblocks > hdr.block_count) {
+            printf("  %-16.16s bad segment entry\n", seg.name);
+            ok = false;
+            continue;
+        }
+
+        std::vector<uint8_t> data(&pack[seg.file_offset], &pack[seg.file_offset] + seg.raw_size);
+        std::vector<uint8_t> table;
+        block_digests(data, table);
+        md5(data.data(), data.size(), digest);
+        bool seg_ok = memcmp(digest, seg.md5, sizeof(digest)) == 0 &&
+                      memcmp(table.data(), &blocks[seg.first_block * FW_PACK_MD5_LEN], table.size()) == 0;
+        ok = ok && seg_ok;
+        printf("  %-16.16s 0x%08" PRIx32 " %8" PRIu32 " bytes @%-8" PRIu32 " %s%s\n", seg.name, seg.address,
+               seg.raw_size, seg.file_offset, seg_ok ? "OK" : "BAD", (seg.flags & FW_PACK_SEG_APP) ? " [app]" : "");
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -o <out.fwp> <build_dir>\n"
+            "       %s -i <pack.fwp>\n"
+            "  -o  tao pack tu <build_dir>/flasher_args.json (idf.py build)\n"
+            "  -i  kiem tra pack: MD5 header, MD5 tung block 4KB va tung segment\n",
+            prog, prog);
+}
+
+int main(int argc, char **argv)
+{
+    std::string out_path;
+    std::string inspect_path;
+
+    int c;
+    while ((c = getopt(argc, argv, "o:i:h")) != -1) {
+        switch (c) {
+        case 'o': out_path = optarg; break;
+        case 'i': inspect_path = optarg; break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+
+    if (!inspect_path.empty()) {
+        return inspect_pack(inspect_path);
+    }
+    if (out_path.empty() || optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return build_pack(argv[optind], out_path);
+}
@@ -0,0 +1,53 @@
+#include "image_cache.h"
+#include <map>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static std::map<std::string, mapped_image_t> s_images;
+
+const mapped_image_t* image_cache_get(const std::string& path)
+{
+    auto it = s_images.find(path);
+    if (it != s_images.end()) {
+        return &it->second;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "[image] cannot open %s: %s\n", path.c_str(), strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "[image] %s is empty or unreadable\n", path.c_str());
+        close(fd);
+        return NULL;
+    }
+
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // Mapping vẫn còn hiệu lực sau khi đóng fd
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "[image] mmap %s failed: %s\n", path.c_str(), strerror(errno));
+        return NULL;
+    }
+    // Đọc tuần tự + nạp trước vào page cache để worker đầu tiên không phải chờ đĩa
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    madvise(addr, st.st_size, MADV_WILLNEED);
+
+    mapped_image_t image = { (const uint8_t *)addr, (size_t)st.st_size };
+    return &s_images.emplace(path, image).first->second;
+}
+
+void image_cache_clear()
+{
+    for (auto& entry : s_images) {
+        munmap((void *)entry.second.data, entry.second.size);
+    }
+    s_images.clear();
+}
@@ -0,0 +1,29 @@
+/**
+ * @file image_cache.h
+ * @brief Cache ảnh firmware dạng mmap, chia sẻ giữa các worker.
+ *
+ * Ảnh được map read-only (MAP_SHARED) trong process cha TRƯỚC khi fork,
+ * nên N worker dùng chung một bản trong page cache thay vì N bản sao.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+typedef struct {
+    const uint8_t *data;    // Con trỏ tới vùng map (chỉ đọc)
+    size_t         size;    // Kích thước file
+} mapped_image_t;
+
+/**
+ * @brief Lấy ảnh đã map theo đường dẫn, map lần đầu nếu chưa có.
+ * @return NULL nếu không mở/map được hoặc file rỗng.
+ */
+const mapped_image_t* image_cache_get(const std::string& path);
+
+/**
+ * @brief Unmap toàn bộ ảnh trong cache.
+ */
+void image_cache_clear();
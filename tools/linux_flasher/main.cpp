@@ -0,0 +1,324 @@
+/*
+ * Tên Dự Án: ESP32 Host Flasher - Linux gang flashing daemon
+ * Mô tả: Nạp cùng một firmware cho nhiều Target qua nhiều adapter USB-UART
+ * (/dev/ttyUSB*, /dev/ttyACM*) cùng lúc. Dùng chung file index.txt với thẻ SD.
+ *
+ * Kiến trúc: process-per-port. Thư viện esp_loader giữ trạng thái toàn cục nên
+ * mỗi cổng chạy trong 1 process con riêng. Ảnh firmware được mmap trong process
+ * cha trước khi fork -> các con chia sẻ cùng các trang trong page cache.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/wait.h>
+
+#include "esp_loader.h"
+#include "linux_port.h"
+#include "catalog.h"
+#include "image_cache.h"
+
+// Cùng giá trị với main/flasher/flasher.h
+#define ESP_PARTITION_ADDR   0x8000
+#define ESP_APPLICATION_ADDR 0x10000
+#define BUFFER_SIZE          4096
+
+#define DEFAULT_BAUD         115200
+#define DEFAULT_HIGH_BAUD    921600
+#define DEFAULT_INTERVAL_MS  1000
+#define DEFAULT_REMOVE_MISSES 3     // Số lần dò liên tiếp không thấy target -> coi như đã tháo ra
+#define PROBE_SYNC_TIMEOUT_MS 100
+
+typedef struct {
+    const mapped_image_t *image;
+    uint32_t              offset;   // 0 = địa chỉ bootloader, tính theo chip lúc chạy
+    std::string           md5;
+    std::string           name;
+    bool                  is_bootloader;
+} segment_t;
+
+typedef struct {
+    uint32_t high_baud;
+    uint32_t interval_ms;
+    uint32_t remove_misses;
+    bool     loop;
+} options_t;
+
+typedef enum {
+    UNIT_ABSENT,    // Không connect được: chưa có target trên cổng
+    UNIT_PASS,
+    UNIT_FAIL,      // Đã connect nhưng nạp / kiểm tra MD5 thất bại
+} unit_result_t;
+
+static volatile sig_atomic_t s_stop = 0;
+static std::map<pid_t, std::string> s_workers;
+
+static void on_signal(int sig)
+{
+    s_stop = 1;
+}
+
+// ESP32 và ESP32-S2 đặt bootloader ở 0x1000, các chip mới hơn ở 0x0
+static uint32_t bootloader_address(target_chip_t chip)
+{
+    return (chip == ESP32_CHIP || chip == ESP32S2_CHIP) ? 0x1000 : 0x0;
+}
+
+static bool flash_segment(const char *port, const segment_t& seg, uint32_t offset)
+{
+    const mapped_image_t *img = seg.image;
+    printf("[%s] %s: %zu bytes -> 0x%08" PRIx32 "\n", port, seg.name.c_str(), img->size, offset);
+
+    if (esp_loader_flash_start(offset, img->size, BUFFER_SIZE) != ESP_LOADER_SUCCESS) {
+        fprintf(stderr, "[%s] flash_start failed\n", port);
+        return false;
+    }
+
+    // esp_loader_flash_write đệm 0xFF vào cuối buffer -> không truyền thẳng vùng map read-only
+    uint8_t buffer[BUFFER_SIZE];
+    for (size_t pos = 0; pos < img->size; pos += BUFFER_SIZE) {
+        size_t len = std::min<size_t>(BUFFER_SIZE, img->size - pos);
+        memcpy(buffer, img->data + pos, len);
+        if (esp_loader_flash_write(buffer, len) != ESP_LOADER_SUCCESS) {
+            fprintf(stderr, "[%s] write error at offset %zu\n", port, pos);
+            return false;
+        }
+    }
+
+    esp_loader_error_t err;
+    if (seg.md5.length() == 32) {
+        err = esp_loader_flash_verify_known_md5(offset, img->size, (const uint8_t *)seg.md5.c_str());
+    } else {
+        err = esp_loader_flash_verify(); // MD5 tính ở host trong lúc ghi
+    }
+    if (err != ESP_LOADER_SUCCESS) {
+        fprintf(stderr, "[%s] MD5 check failed for %s (err=%d)\n", port, seg.name.c_str(), err);
+        return false;
+    }
+    return true;
+}
+
+static unit_result_t flash_unit(const char *port, const std::vector<segment_t>& segments, const options_t& opt)
+{
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    if (esp_loader_connect(&connect_config) != ESP_LOADER_SUCCESS) {
+        return UNIT_ABSENT;
+    }
+    target_chip_t chip = esp_loader_get_target();
+    printf("[%s] connected, chip=%d\n", port, chip);
+
+    if (opt.high_baud != DEFAULT_BAUD) {
+        if (esp_loader_change_transmission_rate(opt.high_baud) == ESP_LOADER_SUCCESS &&
+            loader_port_change_transmission_rate(opt.high_baud) == ESP_LOADER_SUCCESS) {
+            printf("[%s] baudrate boosted to %" PRIu32 "\n", port, opt.high_baud);
+        } else {
+            printf("[%s] baudrate boost failed, continue at %d\n", port, DEFAULT_BAUD);
+        }
+    }
+
+    for (const segment_t& seg : segments) {
+        uint32_t offset = seg.is_bootloader ? bootloader_address(chip) : seg.offset;
+        if (!flash_segment(port, seg, offset)) {
+            return UNIT_FAIL;
+        }
+    }
+
+    esp_loader_reset_target();
+    return UNIT_PASS;
+}
+
+// 1 lần dò: reset vào bootloader và SYNC đúng 1 lần (không nạp gì)
+static bool probe_target(const loader_linux_config_t& config)
+{
+    if (loader_port_linux_init(&config) != ESP_LOADER_SUCCESS) {
+        return false; // Adapter bị rút cũng là không còn target
+    }
+    esp_loader_connect_args_t probe = { .sync_timeout = PROBE_SYNC_TIMEOUT_MS, .trials = 1 };
+    bool present = esp_loader_connect(&probe) == ESP_LOADER_SUCCESS;
+    if (present) {
+        esp_loader_reset_target(); // Trả target về chạy ứng dụng giữa các lần dò
+    }
+    loader_port_linux_deinit();
+    return present;
+}
+
+// Chế độ loop: sau khi nạp xong (PASS hay FAIL) chờ target bị tháo ra -
+// remove_misses lần dò liên tiếp không thấy - rồi mới nhận target tiếp theo.
+static void wait_for_removal(const char *port, const loader_linux_config_t& config, const options_t& opt)
+{
+    printf("[%s] waiting for unit removal\n", port);
+    uint32_t missed = 0;
+    while (!s_stop && missed < opt.remove_misses) {
+        usleep(opt.interval_ms * 1000);
+        missed = probe_target(config) ? 0 : missed + 1;
+    }
+}
+
+// Process con: phục vụ 1 cổng cho tới khi hết việc (hoặc bị dừng ở chế độ loop)
+static int worker_main(const char *port, const std::vector<segment_t>& segments, const options_t& opt)
+{
+    loader_linux_config_t config = { .device = port, .baudrate = DEFAULT_BAUD };
+    uint32_t units = 0;
+    uint32_t failures = 0;
+
+    do {
+        if (loader_port_linux_init(&config) != ESP_LOADER_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+        unit_result_t result = flash_unit(port, segments, opt);
+        loader_port_linux_deinit();
+
+        if (result == UNIT_ABSENT && opt.loop) {
+            // Chưa có target, thử lại sau interval
+            usleep(opt.interval_ms * 1000);
+            continue;
+        }
+
+        units++;
+        if (result == UNIT_PASS) {
+            printf("[%s] unit %" PRIu32 ": PASS\n", port, units);
+        } else {
+            failures++;
+            fprintf(stderr, "[%s] unit %" PRIu32 ": FAIL%s\n", port, units,
+                    result == UNIT_ABSENT ? " (no target)" : "");
+        }
+        if (opt.loop) {
+            wait_for_removal(port, config, opt);
+        }
+    } while (opt.loop && !s_stop);
+
+    if (opt.loop) {
+        printf("[%s] %" PRIu32 " unit(s): %" PRIu32 " pass, %" PRIu32 " fail\n",
+               port, units, units - failures, failures);
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Usage: %s -r <sd_root> -f <fw_id> [-b baud] [-l] [-i interval_ms] [-m misses] <port> [port...]\n"
+            "  -r  thu muc goc chua index.txt (ban sao the SD)\n"
+            "  -f  fw_id trong index.txt\n"
+            "  -b  baud toc do cao sau khi connect (mac dinh %d)\n"
+            "  -l  che do daemon: moi cong lien tuc cho va nap target moi\n"
+            "  -i  khoang cho giua 2 lan do target o che do -l (ms, mac dinh %d)\n"
+            "  -m  so lan do lien tiep khong thay target thi coi la da thao ra (mac dinh %d)\n",
+            prog, DEFAULT_HIGH_BAUD, DEFAULT_INTERVAL_MS, DEFAULT_REMOVE_MISSES);
+}
+
+int main(int argc, char **argv)
+{
+    std::string root;
+    std::string fw_id;
+    options_t opt = { DEFAULT_HIGH_BAUD, DEFAULT_INTERVAL_MS, DEFAULT_REMOVE_MISSES, false };
+
+    // Worker fork ra rồi kết thúc bằng _exit(): xả stdout theo dòng để log khi bị chuyển hướng
+    // không bị mất hoặc bị in lặp từ buffer kế thừa
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    int c;
+    while ((c = getopt(argc, argv, "r:f:b:li:m:h")) != -1) {
+        switch (c) {
+        case 'r': root = optarg; break;
+        case 'f': fw_id = optarg; break;
+        case 'b': opt.high_baud = strtoul(optarg, NULL, 10); break;
+        case 'l': opt.loop = true; break;
+        case 'i': opt.interval_ms = strtoul(optarg, NULL, 10); break;
+        case 'm': opt.remove_misses = std::max<uint32_t>(1, strtoul(optarg, NULL, 10)); break;
+        default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (root.empty() || fw_id.empty() || optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // --- BƯỚC 1: ĐỌC CATALOG ---
+    std::map<std::string, firmware_metadata_t> catalog;
+    if (!catalog_load(root, catalog)) {
+        return EXIT_FAILURE;
+    }
+    auto it = catalog.find(fw_id);
+    if (it == catalog.end()) {
+        fprintf(stderr, "Firmware ID %s not found in index.txt\n", fw_id.c_str());
+        return EXIT_FAILURE;
+    }
+    const firmware_metadata_t& metadata = it->second;
+
+    // --- BƯỚC 2: MAP ẢNH (1 LẦN, TRƯỚC KHI FORK) ---
+    struct { const std::string& path; const std::string& md5; uint32_t offset; const char *name; bool boot; } parts[] = {
+        { metadata.path_bootloader, metadata.md5_bootloader, 0,                    "bootloader", true  },
+        { metadata.path_partition,  metadata.md5_partition,  ESP_PARTITION_ADDR,   "partition",  false },
+        { metadata.path,            metadata.md5,            ESP_APPLICATION_ADDR, "app",        false },
+    };
+    std::vector<segment_t> segments;
+    for (const auto& part : parts) {
+        if (part.path.empty()) {
+            continue;
+        }
+        const mapped_image_t *img = image_cache_get(root + part.path);
+        if (!img) {
+            return EXIT_FAILURE;
+        }
+        segments.push_back({ img, part.offset, part.md5, part.name, part.boot });
+    }
+    if (segments.empty()) {
+        fprintf(stderr, "Firmware ID %s has no images\n", fw_id.c_str());
+        return EXIT_FAILURE;
+    }
+    printf("Firmware %s (%s %s): %zu segment(s), %d port(s)\n", fw_id.c_str(),
+           metadata.device_type.c_str(), metadata.version.c_str(), segments.size(), argc - optind);
+
+    // --- BƯỚC 3: FORK 1 WORKER / CỔNG ---
+    struct sigaction sa = {};
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    for (int i = optind; i < argc; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            s_stop = 1;
+            break;
+        }
+        if (pid == 0) {
+            _exit(worker_main(argv[i], segments, opt));
+        }
+        s_workers[pid] = argv[i];
+    }
+
+    // --- BƯỚC 4: GIÁM SÁT WORKER ---
+    int failed = 0;
+    bool forwarded = false;
+    while (!s_workers.empty()) {
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (s_stop && !forwarded) {
+                for (const auto& w : s_workers) {
+                    kill(w.first, SIGTERM);
+                }
+                forwarded = true;
+            }
+            continue;
+        }
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+        printf("[%s] worker exited: %s\n", s_workers[pid].c_str(), ok ? "OK" : "FAILED");
+        failed += ok ? 0 : 1;
+        s_workers.erase(pid);
+    }
+
+    image_cache_clear();
+    printf("Done: %d port(s) failed\n", failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+#include "linux_port.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+static int s_serial = -1;
+static int64_t s_time_end;
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static speed_t convert_baudrate(uint32_t baud)
+{
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 500000: return B500000;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    default: return B0;
+    }
+}
+
+static esp_loader_error_t configure(int fd, uint32_t baudrate)
+{
+    struct termios options;
+    speed_t baud = convert_baudrate(baudrate);
+
+    if (baud == B0) {
+        return ESP_LOADER_ERROR_INVALID_PARAM;
+    }
+    if (tcgetattr(fd, &options) != 0) {
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    cfmakeraw(&options);
+    cfsetispeed(&options, baud);
+    cfsetospeed(&options, baud);
+    options.c_cflag |= (CLOCAL | CREAD);
+    options.c_cflag &= ~(PARENB | CSTOPB | CSIZE | CRTSCTS);
+    options.c_cflag |= CS8;
+    options.c_iflag &= ~(IXON | IXOFF | IXANY);
+    // Đọc không chặn: thời gian chờ do poll() quản lý
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+
+    return tcsetattr(fd, TCSANOW, &options) == 0 ? ESP_LOADER_SUCCESS : ESP_LOADER_ERROR_FAIL;
+}
+
+// Đặt mức RTS/DTR trong 1 ioctl: mạch auto-reset 2 transistor chỉ kéo EN/GPIO0 khi 2 đường
+// khác mức, đổi lần lượt từng đường sẽ đi qua trạng thái trung gian ngoài ý muốn.
+// Pty không có đường modem -> bỏ qua lỗi.
+static void set_modem_lines(int dtr, int rts)
+{
+    int lines = 0;
+    if (ioctl(s_serial, TIOCMGET, &lines) != 0) {
+        return;
+    }
+    lines = dtr ? (lines | TIOCM_DTR) : (lines & ~TIOCM_DTR);
+    lines = rts ? (lines | TIOCM_RTS) : (lines & ~TIOCM_RTS);
+    ioctl(s_serial, TIOCMSET, &lines);
+}
+
+esp_loader_error_t loader_port_linux_init(const loader_linux_config_t *config)
+{
+    s_serial = open(config->device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (s_serial < 0) {
+        fprintf(stderr, "[%s] open failed: %s\n", config->device, strerror(errno));
+        return ESP_LOADER_ERROR_FAIL;
+    }
+
+    esp_loader_error_t err = configure(s_serial, config->baudrate);
+    if (err != ESP_LOADER_SUCCESS) {
+        fprintf(stderr, "[%s] termios setup failed\n", config->device);
+        close(s_serial);
+        s_serial = -1;
+        return err;
+    }
+
+    // Thả cả EN và GPIO0 (mức không tích cực)
+    set_modem_lines(0, 0);
+    tcflush(s_serial, TCIOFLUSH);
+    return ESP_LOADER_SUCCESS;
+}
+
+void loader_port_linux_deinit(void)
+{
+    if (s_serial >= 0) {
+        close(s_serial);
+        s_serial = -1;
+    }
+}
+
+esp_loader_error_t loader_port_write(const uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    int64_t deadline = now_ms() + timeout;
+    size_t written = 0;
+
+    while (written < size) {
+        ssize_t n = write(s_serial, data + written, size - written);
+        if (n > 0) {
+            written += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return ESP_LOADER_ERROR_FAIL;
+        }
+
+        int64_t left = deadline - now_ms();
+        if (left <= 0) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+        struct pollfd pfd = { .fd = s_serial, .events = POLLOUT };
+        poll(&pfd, 1, (int)left);
+    }
+    return ESP_LOADER_SUCCESS;
+}
+
+esp_loader_error_t loader_port_read(uint8_t *data, uint16_t size, uint32_t timeout)
+{
+    int64_t deadline = now_ms() + timeout;
+    size_t received = 0;
+
+    while (received < size) {
+        ssize_t n = read(s_serial, data + received, size - received);
+        if (n > 0) {
+            received += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            return ESP_LOADER_ERROR_FAIL;
+        }
+
+        int64_t left = deadline - now_ms();
+        if (left <= 0) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+        struct pollfd pfd = { .fd = s_serial, .events = POLLIN };
+        int ret = poll(&pfd, 1, (int)left);
+        if (ret == 0) {
+            return ESP_LOADER_ERROR_TIMEOUT;
+        }
+        if (ret > 0 && (pfd.revents & (POLLHUP | POLLERR)) && !(pfd.revents & POLLIN)) {
+            return ESP_LOADER_ERROR_FAIL; // Adapter bị rút / đầu pty bên kia đã đóng
+        }
+    }
+    return ESP_LOADER_SUCCESS;
+}
+
+// Chuỗi ClassicReset của esptool: giữ EN trong reset với GPIO0 thả, rồi cùng lúc
+// kéo GPIO0 LOW và nhả EN -> target đọc GPIO0 = LOW khi khởi động và vào ROM bootloader.
+// Không bao giờ để DTR và RTS cùng tích cực (với mạch 2 transistor, cả EN và GPIO0 đều bị thả).
+void loader_port_enter_bootloader(void)
+{
+    set_modem_lines(0, 1);      // GPIO0 HIGH, EN LOW
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(1, 0);      // GPIO0 LOW, EN HIGH
+    loader_port_delay_ms(SERIAL_FLASHER_BOOT_HOLD_TIME_MS);
+    set_modem_lines(0, 0);      // Thả GPIO0
+}
+
+void loader_port_reset_target(void)
+{
+    set_modem_lines(0, 1);
+    loader_port_delay_ms(SERIAL_FLASHER_RESET_HOLD_TIME_MS);
+    set_modem_lines(0, 0);
+}
+
+void loader_port_delay_ms(uint32_t ms)
+{
+    usleep(ms * 1000);
+}
+
+void loader_port_start_timer(uint32_t ms)
+{
+    s_time_end = now_ms() + ms;
+}
+
+uint32_t loader_port_remaining_time(void)
+{
+    int64_t remaining = s_time_end - now_ms();
+    return (remaining > 0) ? (uint32_t)remaining : 0;
+}
+
+void loader_port_debug_print(const char *str)
+{
+    printf("DEBUG: %s\n", str);
+}
+
+esp_loader_error_t loader_port_change_transmission_rate(uint32_t baudrate)
+{
+    return configure(s_serial, baudrate);
+}
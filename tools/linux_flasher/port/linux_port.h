@@ -0,0 +1,29 @@
+/**
+ * @file linux_port.h
+ * @brief Port termios của esp-serial-flasher cho Linux (USB-UART /dev/ttyUSB*, /dev/ttyACM*, pty).
+ *
+ * Reset target dùng mạch auto-reset 2 transistor của các adapter USB-UART
+ * (RTS -> EN, DTR -> GPIO0) với chuỗi ClassicReset của esptool.
+ * Thư viện esp_loader giữ trạng thái toàn cục, nên mỗi process chỉ mở 1 cổng.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_loader_io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *device;     // Đường dẫn cổng, ví dụ "/dev/ttyUSB0"
+    uint32_t baudrate;      // Baud khởi tạo (thường 115200)
+} loader_linux_config_t;
+
+esp_loader_error_t loader_port_linux_init(const loader_linux_config_t *config);
+void loader_port_linux_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,375 @@
+#include "fake_target.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "md5_hash.h"
+
+#define SLIP_END        0xC0
+#define SLIP_ESC        0xDB
+#define SLIP_ESC_END    0xDC
+#define SLIP_ESC_ESC    0xDD
+
+// Mã lệnh / lỗi như private_include/protocol.h của esp-serial-flasher
+#define CMD_FLASH_BEGIN     0x02
+#define CMD_FLASH_DATA      0x03
+#define CMD_FLASH_END       0x04
+#define CMD_SYNC            0x08
+#define CMD_WRITE_REG       0x09
+#define CMD_READ_REG        0x0A
+#define CMD_SPI_SET_PARAMS  0x0B
+#define CMD_SPI_ATTACH      0x0D
+#define CMD_CHANGE_BAUDRATE 0x0F
+#define CMD_SPI_FLASH_MD5   0x13
+#define CMD_SECTOR_MAP      0xE0    // main/flasher/sector_map.h
+#define ERR_INVALID_COMMAND 0x05
+#define ERR_INVALID_CRC     0x07
+
+#define CHIP_DETECT_MAGIC_REG_ADDR 0x40001000
+#define ESP32C3_MAGIC_VALUE        0x1b31506f
+#define ESP32C3_SPI_W0_REG         0x60002058
+#define FLASH_ID_4MB               0x00164020   // Byte 2 = 0x16 -> 4MB
+
+struct fake_target {
+    fake_target_config_t config;
+    std::string          port;
+    int                  master;
+    int                  slave;     // Giữ mở để phía master không nhận EIO khi flasher đóng cổng
+    std::thread          thread;
+    std::atomic<bool>    stop;
+
+    std::mutex           lock;      // Bảo vệ các trường dưới
+    bool                 present;
+    std::vector<uint8_t> flash;
+    fake_target_stats_t  stats;
+    uint32_t             write_offset;
+    uint32_t             write_block;
+};
+
+static uint32_t get_u32(const uint8_t* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void md5(const uint8_t* data, size_t len, uint8_t out[16])
+{
+    MD5Context ctx;
+    MD5Init(&ctx);
+    MD5Update(&ctx, data, len);
+    MD5Final(out, &ctx);
+}
+
+static void slip_append(std::vector<uint8_t>& out, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == SLIP_END) {
+            out.push_back(SLIP_ESC);
+            out.push_back(SLIP_ESC_END);
+        } else if (data[i] == SLIP_ESC) {
+            out.push_back(SLIP_ESC);
+            out.push_back(SLIP_ESC_ESC);
+        } else {
+            out.push_back(data[i]);
+        }
+    }
+}
+
+static void send_all(int fd, const std::vector<uint8_t>& buf)
+{
+    size_t sent = 0;
+    while (sent < buf.size()) {
+        ssize_t n = write(fd, buf.data() + sent, buf.size() - sent);
+        if (n > 0) {
+            sent += (size_t) n;
+        } else {
+            struct pollfd pfd = { .fd = fd, .events = POLLOUT, .revents = 0 };
+            poll(&pfd, 1, 10);
+        }
+    }
+}
+
+// Response: direction(1) | command(1) | size(2) | value(4) | data | status(2)
+static void respond(fake_target_t* t, uint8_t command, uint32_t value, const uint8_t* data, size_t len,
+                    uint8_t error = 0)
+{
+    const uint16_t size = (uint16_t) (len + 2);
+    const uint8_t header[8] = { 0x01, command, (uint8_t) size, (uint8_t) (size >> 8),
+                                (uint8_t) value, (uint8_t) (value >> 8), (uint8_t) (value >> 16), (uint8_t) (value >> 24) };
+    const uint8_t status[2] = { (uint8_t) (error ? 1 : 0), error };
+
+    std::vector<uint8_t> out;
+    out.push_back(SLIP_END);
+    slip_append(out, header, sizeof(header));
+    if (len) {
+        slip_append(out, data, len);
+    }
+    slip_append(out, status, sizeof(status));
+    out.push_back(SLIP_END);
+    send_all(t->master, out);
+}
+
+static bool in_flash(uint32_t offset, uint32_t len)
+{
+    return offset <= FAKE_TARGET_FLASH_SIZE && len <= FAKE_TARGET_FLASH_SIZE - offset;
+}
+
+static void handle_frame(fake_target_t* t, const std::vector<uint8_t>& frame)
+{
+    if (frame.size() < 8 || frame[0] != 0x00) {
+        return;
+    }
+    const uint8_t command = frame[1];
+    const uint8_t checksum = frame[4];
+    const uint8_t* data = frame.data() + 8;
+    const size_t data_len = frame.size() - 8;
+
+    std::lock_guard<std::mutex> guard(t->lock);
+    if (!t->present) {
+        return;
+    }
+
+    switch (command) {
+    case CMD_SYNC:
+        t->stats.syncs++;
+        for (int i = 0; i < 8; i++) {
+            respond(t, command, 0, NULL, 0);
+        }
+        break;
+
+    case CMD_READ_REG: {
+        uint32_t addr = data_len >= 4 ? get_u32(data) : 0;
+        uint32_t value = 0;
+        if (addr == CHIP_DETECT_MAGIC_REG_ADDR) {
+            value = ESP32C3_MAGIC_VALUE;
+        } else if (addr == ESP32C3_SPI_W0_REG) {
+            value = FLASH_ID_4MB;
+        }
+        respond(t, command, value, NULL, 0);
+        break;
+    }
+
+    case CMD_WRITE_REG:
+    case CMD_SPI_SET_PARAMS:
+    case CMD_SPI_ATTACH:
+    case CMD_CHANGE_BAUDRATE:
+    case CMD_FLASH_END:
+        respond(t, command, 0, NULL, 0);
+        break;
+
+    case CMD_FLASH_BEGIN: {
+        // erase_size | packet_count | packet_size | offset | encrypted
+        uint32_t erase_size = data_len >= 16 ? get_u32(data) : 0;
+        uint32_t offset = data_len >= 16 ? get_u32(data + 12) : 0;
+        if (data_len < 16 || !in_flash(offset, erase_size)) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        memset(&t->flash[offset], 0xFF, erase_size);
+        t->write_offset = offset;
+        t->write_block = get_u32(data + 8);
+        t->stats.flash_begins++;
+        respond(t, command, 0, NULL, 0);
+        break;
+    }
+
+    case CMD_FLASH_DATA: {
+        // data_size | sequence | 0 | 0 | payload
+        if (data_len < 16) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        uint32_t size = get_u32(data);
+        uint32_t seq = get_u32(data + 4);
+        const uint8_t* payload = data + 16;
+        uint32_t offset = t->write_offset + seq * t->write_block;
+        uint8_t sum = 0xEF;
+        for (uint32_t i = 0; data_len - 16 >= size && i < size; i++) {
+            sum ^= payload[i];
+        }
+        if (data_len - 16 < size || sum != checksum) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_CRC);
+            break;
+        }
+        if (!in_flash(offset, size)) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        memcpy(&t->flash[offset], payload, size);
+        if (t->config.corrupt_writes) {
+            t->flash[offset] ^= 0x01;
+        }
+        t->stats.flash_blocks++;
+        respond(t, command, 0, NULL, 0);
+        break;
+    }
+
+    case CMD_SPI_FLASH_MD5: {
+        // address | size | 0 | 0 -> ROM trả 32 ký tự hex
+        t->stats.md5_cmds++;
+        if (data_len < 16 || !in_flash(get_u32(data), get_u32(data + 4))) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        uint8_t digest[16];
+        md5(&t->flash[get_u32(data)], get_u32(data + 4), digest);
+        char hex[33];
+        for (int i = 0; i < 16; i++) {
+            snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+        }
+        respond(t, command, 0, (const uint8_t*) hex, 32);
+        break;
+    }
+
+    case CMD_SECTOR_MAP: {
+        // addr | size | sector_size | digest_len -> N * digest_len byte
+        t->stats.map_cmds++;
+        if (!t->config.sector_map) {
+            t->stats.invalid_cmds++;
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        if (data_len < 16) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        uint32_t addr = get_u32(data);
+        uint32_t size = get_u32(data + 4);
+        uint32_t sector = get_u32(data + 8);
+        uint32_t digest_len = get_u32(data + 12);
+        if (!sector || digest_len > 16 || !in_flash(addr, size)) {
+            respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+            break;
+        }
+        std::vector<uint8_t> table;
+        for (uint32_t pos = 0; pos < size; pos += sector) {
+            uint8_t digest[16];
+            md5(&t->flash[addr + pos], std::min(sector, size - pos), digest);
+            table.insert(table.end(), digest, digest + digest_len);
+        }
+        respond(t, command, 0, table.data(), table.size());
+        break;
+    }
+
+    default:
+        t->stats.invalid_cmds++;
+        respond(t, command, 0, NULL, 0, ERR_INVALID_COMMAND);
+        break;
+    }
+}
+
+static void serve(fake_target_t* t)
+{
+    std::vector<uint8_t> frame;
+    bool in_frame = false;
+    bool escaped = false;
+    uint8_t buf[512];
+
+    while (!t->stop) {
+        struct pollfd pfd = { .fd = t->master, .events = POLLIN, .revents = 0 };
+        if (poll(&pfd, 1, 20) <= 0 || !(pfd.revents & POLLIN)) {
+            continue;
+        }
+        ssize_t n = read(t->master, buf, sizeof(buf));
+        for (ssize_t i = 0; i < n; i++) {
+            uint8_t b = buf[i];
+            if (b == SLIP_END) {
+                if (in_frame && !frame.empty()) {
+                    handle_frame(t, frame);
+                }
+                frame.clear();
+                in_frame = true;
+                escaped = false;
+            } else if (!in_frame) {
+                continue;
+            } else if (escaped) {
+                frame.push_back(b == SLIP_ESC_END ? SLIP_END : SLIP_ESC);
+                escaped = false;
+            } else if (b == SLIP_ESC) {
+                escaped = true;
+            } else {
+                frame.push_back(b);
+            }
+        }
+    }
+}
+
+fake_target_t* fake_target_start(const fake_target_config_t& config)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        if (master >= 0) close(master);
+        return NULL;
+    }
+    struct termios options;
+    tcgetattr(master, &options);
+    cfmakeraw(&options);
+    tcsetattr(master, TCSANOW, &options);
+
+    fake_target_t* t = new fake_target();
+    t->config = config;
+    t->port = ptsname(master);
+    t->master = master;
+    t->slave = open(t->port.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+    t->stop = false;
+    t->present = true;
+    t->flash.assign(FAKE_TARGET_FLASH_SIZE, 0xFF);
+    t->stats = {};
+    t->write_offset = 0;
+    t->write_block = 0;
+    t->thread = std::thread(serve, t);
+    return t;
+}
+
+void fake_target_stop(fake_target_t* target)
+{
+    target->stop = true;
+    target->thread.join();
+    close(target->slave);
+    close(target->master);
+    delete target;
+}
+
+const char* fake_target_port(const fake_target_t* target)
+{
+    return target->port.c_str();
+}
+
+void fake_target_set_present(fake_target_t* target, bool present, bool fresh)
+{
+    std::lock_guard<std::mutex> guard(target->lock);
+    target->present = present;
+    if (fresh) {
+        std::fill(target->flash.begin(), target->flash.end(), 0xFF);
+    }
+}
+
+fake_target_stats_t fake_target_stats(fake_target_t* target)
+{
+    std::lock_guard<std::mutex> guard(target->lock);
+    return target->stats;
+}
+
+bool fake_target_flash_equals(fake_target_t* target, uint32_t offset, const uint8_t* data, size_t len)
+{
+    std::lock_guard<std::mutex> guard(target->lock);
+    return in_flash(offset, len) && memcmp(&target->flash[offset], data, len) == 0;
+}
+
+void fake_target_flash_write(fake_target_t* target, uint32_t offset, const uint8_t* data, size_t len)
+{
+    std::lock_guard<std::mutex> guard(target->lock);
+    if (in_flash(offset, len)) {
+        memcpy(&target->flash[offset], data, len);
+    }
+}
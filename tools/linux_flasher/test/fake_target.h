@@ -0,0 +1,66 @@
+/**
+ * @file fake_target.h
+ * @brief Target giả cho test host: 1 cặp pty, phía master trả lời giao thức ROM bootloader.
+ *
+ * Phía slave (fake_target_port) được mở như một adapter USB-UART bình thường.
+ * Hỗ trợ SYNC, READ_REG/WRITE_REG (nhận diện ESP32-C3, flash ID 4MB), SPI_ATTACH,
+ * SPI_SET_PARAMS, CHANGE_BAUDRATE, FLASH_BEGIN/DATA/END, SPI_FLASH_MD5 và tùy chọn
+ * lệnh mở rộng SECTOR_MAP_CMD. Lệnh khác trả lỗi "invalid command" như ROM.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FAKE_TARGET_FLASH_SIZE  (4 * 1024 * 1024)
+
+typedef struct {
+    bool sector_map;        // Trả lời SECTOR_MAP_CMD như stub có lệnh mở rộng
+    bool corrupt_writes;    // Lật 1 bit mỗi block FLASH_DATA -> MD5 sau khi nạp sai
+} fake_target_config_t;
+
+typedef struct {
+    uint32_t syncs;         // Số lệnh SYNC đã trả lời
+    uint32_t flash_begins;
+    uint32_t flash_blocks;
+    uint32_t md5_cmds;      // SPI_FLASH_MD5
+    uint32_t map_cmds;      // SECTOR_MAP_CMD (kể cả khi trả lỗi)
+    uint32_t invalid_cmds;  // Lệnh không hỗ trợ
+} fake_target_stats_t;
+
+typedef struct fake_target fake_target_t;
+
+/**
+ * @brief Tạo cặp pty và thread phục vụ. Flash ban đầu toàn 0xFF.
+ * @return NULL nếu không tạo được pty.
+ */
+fake_target_t* fake_target_start(const fake_target_config_t& config);
+
+/**
+ * @brief Dừng thread, đóng pty và giải phóng.
+ */
+void fake_target_stop(fake_target_t* target);
+
+/**
+ * @brief Đường dẫn phía slave (ví dụ "/dev/pts/5") để truyền cho flasher.
+ */
+const char* fake_target_port(const fake_target_t* target);
+
+/**
+ * @brief Giả lập cắm/tháo target: khi vắng mặt mọi byte nhận được đều bị bỏ qua.
+ * @param fresh true -> target mới cắm vào có flash trống (0xFF).
+ */
+void fake_target_set_present(fake_target_t* target, bool present, bool fresh);
+
+fake_target_stats_t fake_target_stats(fake_target_t* target);
+
+/**
+ * @brief So sánh 1 vùng flash của target giả với dữ liệu mong đợi.
+ */
+bool fake_target_flash_equals(fake_target_t* target, uint32_t offset, const uint8_t* data, size_t len);
+
+/**
+ * @brief Ghi thẳng vào flash của target giả (chuẩn bị nội dung trước test).
+ */
+void fake_target_flash_write(fake_target_t* target, uint32_t offset, const uint8_t* data, size_t len);
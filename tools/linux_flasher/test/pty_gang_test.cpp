@@ -0,0 +1,243 @@
+/*
+ * Test host cho linux_flasher: chạy daemon thật trên các cặp pty, phía bên kia là
+ * target giả (fake_target) trả lời giao thức ROM bootloader.
+ *
+ *   pty_gang_test <đường dẫn linux_flasher>
+ *
+ * 1. Nạp 1 lần trên 2 cổng cùng lúc: flash của cả 2 target phải khớp ảnh.
+ * 2. Chế độ -l: target đã nạp còn cắm thì không bị nạp lại, FAIL được đếm theo unit,
+ *    tháo ra rồi cắm target mới thì được nạp tiếp.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "fake_target.h"
+#include "md5_hash.h"
+
+#define WAIT_TIMEOUT_MS     20000
+#define DAEMON_INTERVAL_MS  "50"
+#define DAEMON_MISSES       "3"
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+typedef struct {
+    const char*          name;
+    uint32_t             offset;
+    std::vector<uint8_t> data;
+} test_image_t;
+
+static std::string s_flasher;
+static std::string s_root;
+static std::vector<test_image_t> s_images;
+
+static std::string md5_hex(const std::vector<uint8_t>& data)
+{
+    MD5Context ctx;
+    uint8_t digest[16];
+    MD5Init(&ctx);
+    MD5Update(&ctx, data.data(), data.size());
+    MD5Final(digest, &ctx);
+    char hex[33];
+    for (int i = 0; i < 16; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+// Thư mục gốc giả lập thẻ SD: index.txt + bootloader/partition/app ngẫu nhiên
+static bool make_root(void)
+{
+    char tmpl[] = "/tmp/linux_flasher_test.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        return false;
+    }
+    s_root = tmpl;
+
+    srand(1234);
+    s_images = {
+        { "bootloader", 0x0,     std::vector<uint8_t>(12 * 1024) },
+        { "partition",  0x8000,  std::vector<uint8_t>(3 * 1024) },
+        { "app",        0x10000, std::vector<uint8_t>(70 * 1024 + 20) },
+    };
+    for (test_image_t& img : s_images) {
+        for (uint8_t& b : img.data) b = (uint8_t) rand();
+        std::ofstream(s_root + "/" + img.name + ".bin", std::ios::binary)
+            .write((const char*) img.data.data(), img.data.size());
+    }
+
+    std::ofstream index(s_root + "/index.txt");
+    index << "[{\"fw_id\":\"TEST\",\"device_type\":\"C3\",\"version\":\"1.0\""
+          << ",\"path_bootloader\":\"/bootloader.bin\",\"md5_bootloader\":\"" << md5_hex(s_images[0].data) << "\""
+          << ",\"path_partition\":\"/partition.bin\",\"md5_partition\":\"" << md5_hex(s_images[1].data) << "\""
+          << ",\"path\":\"/app.bin\",\"md5\":\"" << md5_hex(s_images[2].data) << "\"}]\n";
+    return index.good();
+}
+
+static pid_t spawn_flasher(const std::vector<std::string>& args, const std::string& log)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        std::vector<char*> argv = { (char*) s_flasher.c_str(), (char*) "-r", (char*) s_root.c_str(),
+                                    (char*) "-f", (char*) "TEST", (char*) "-b", (char*) "115200" };
+        for (const std::string& a : args) argv.push_back((char*) a.c_str());
+        argv.push_back(NULL);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+static bool wait_until(const std::function<bool()>& cond, int timeout_ms = WAIT_TIMEOUT_MS)
+{
+    for (int waited = 0; waited < timeout_ms; waited += 10) {
+        if (cond()) return true;
+        usleep(10 * 1000);
+    }
+    return cond();
+}
+
+// Chờ daemon thoát, trả về exit code (-1 nếu quá hạn hoặc bị giết)
+static int wait_exit(pid_t pid)
+{
+    int status = 0;
+    bool done = wait_until([&] { return waitpid(pid, &status, WNOHANG) == pid; });
+    if (!done) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static bool flashed(fake_target_t* target)
+{
+    for (const test_image_t& img : s_images) {
+        if (!fake_target_flash_equals(target, img.offset, img.data.data(), img.data.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string read_file(const std::string& path)
+{
+    std::ifstream file(path);
+    std::stringstream ss;
+    ss << file.rdbuf();
+    return ss.str();
+}
+
+static bool test_single_pass(void)
+{
+    fake_target_t* a = fake_target_start({});
+    fake_target_t* b = fake_target_start({});
+    CHECK(a && b);
+
+    std::string log = s_root + "/single.log";
+    pid_t pid = spawn_flasher({ fake_target_port(a), fake_target_port(b) }, log);
+    int code = wait_exit(pid);
+    printf("%s", read_file(log).c_str());
+    CHECK(code == EXIT_SUCCESS);
+    CHECK(flashed(a));
+    CHECK(flashed(b));
+    CHECK(fake_target_stats(a).md5_cmds == s_images.size());
+    CHECK(fake_target_stats(b).md5_cmds == s_images.size());
+
+    fake_target_stop(a);
+    fake_target_stop(b);
+    return true;
+}
+
+static bool loop_mode_checks(pid_t pid, fake_target_t* good, fake_target_t* bad, const std::string& log)
+{
+    const uint32_t segments = s_images.size();
+
+    // Unit 1 trên mỗi cổng: 1 PASS, 1 FAIL (MD5 sai ngay segment đầu)
+    CHECK(wait_until([&] { return fake_target_stats(good).md5_cmds == segments && flashed(good); }));
+    CHECK(wait_until([&] { return fake_target_stats(bad).md5_cmds == 1; }));
+
+    // Target vẫn cắm: daemon chỉ dò (SYNC), không nạp lại
+    uint32_t syncs = fake_target_stats(good).syncs;
+    usleep(1500 * 1000);
+    CHECK(fake_target_stats(good).flash_begins == segments);
+    CHECK(fake_target_stats(bad).flash_begins == 1);
+    CHECK(fake_target_stats(good).syncs > syncs);
+
+    // Tháo ra đủ lâu để daemon thấy DAEMON_MISSES lần dò hụt, rồi cắm target mới
+    fake_target_set_present(good, false, false);
+    usleep(3000 * 1000);
+    fake_target_set_present(good, true, true);
+    CHECK(wait_until([&] { return fake_target_stats(good).md5_cmds == 2 * segments && flashed(good); }));
+
+    kill(pid, SIGTERM);
+    int code = wait_exit(pid);
+    std::string out = read_file(log);
+    printf("%s", out.c_str());
+    CHECK(code == EXIT_FAILURE);
+    CHECK(out.find(std::string("[") + fake_target_port(good) + "] 2 unit(s): 2 pass, 0 fail") != std::string::npos);
+    CHECK(out.find(std::string("[") + fake_target_port(bad) + "] 1 unit(s): 0 pass, 1 fail") != std::string::npos);
+    return true;
+}
+
+static bool test_loop_mode(void)
+{
+    fake_target_t* good = fake_target_start({});
+    fake_target_t* bad = fake_target_start({ .sector_map = false, .corrupt_writes = true });
+    CHECK(good && bad);
+
+    std::string log = s_root + "/loop.log";
+    pid_t pid = spawn_flasher({ "-l", "-i", DAEMON_INTERVAL_MS, "-m", DAEMON_MISSES,
+                                fake_target_port(good), fake_target_port(bad) }, log);
+    bool ok = loop_mode_checks(pid, good, bad, log);
+    if (!ok) {
+        kill(pid, SIGTERM); // Daemon chuyển tiếp cho các worker
+        wait_exit(pid);
+        printf("%s", read_file(log).c_str());
+    }
+
+    fake_target_stop(good);
+    fake_target_stop(bad);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <linux_flasher>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    s_flasher = argv[1];
+    if (!make_root()) {
+        fprintf(stderr, "cannot create test root\n");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = test_single_pass();
+    ok = test_loop_mode() && ok;
+
+    std::string cleanup = "rm -rf '" + s_root + "'";
+    if (system(cleanup.c_str()) != 0) {
+        fprintf(stderr, "cannot remove %s\n", s_root.c_str());
+    }
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+/*
+ * Test host cho main/flasher/sector_map.cpp: esp_loader thật (port termios) nói chuyện với
+ * target giả qua pty.
+ *
+ * 1. Target có SECTOR_MAP_CMD: 1 lệnh cho cả vùng, đúng các sector khác.
+ * 2. Target chỉ có ROM (lệnh mở rộng bị từ chối): dò tính năng 1 lần, rồi MD5 cả ảnh và
+ *    chia đôi - mọi sector khác đều được đánh dấu, số lệnh MD5 ít hơn hẳn số sector.
+ * 3. Ảnh không đổi: đúng 1 lệnh MD5, không sector nào phải ghi.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "esp_loader.h"
+#include "linux_port.h"
+#include "md5_hash.h"
+#include "sector_map.h"
+#include "trace_log.h"
+#include "fake_target.h"
+
+#define IMAGE_OFFSET    0x10000
+#define IMAGE_SIZE      (40 * SECTOR_MAP_SECTOR_SIZE + 100)     // 41 sector, sector cuối chỉ có 100 byte
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            return false; \
+        } \
+    } while (0)
+
+static std::vector<uint8_t> s_image;
+static const uint32_t s_dirty[] = { 3, 17, 40 };
+
+// --- sd_raw trên bộ nhớ: file duy nhất là s_image ---
+
+bool sd_raw_seek(sd_raw_file_t& f, uint32_t pos)
+{
+    if (pos > f.size) return false;
+    f.position = pos;
+    return true;
+}
+
+size_t sd_raw_read(sd_raw_file_t& f, uint8_t* buf, size_t len)
+{
+    size_t n = std::min<size_t>(len, f.size - f.position);
+    memcpy(buf, s_image.data() + f.position, n);
+    f.position += n;
+    return n;
+}
+
+void trace_log(trace_msg_t id, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+}
+
+static std::string md5_hex(const uint8_t* data, size_t len)
+{
+    MD5Context ctx;
+    uint8_t digest[16];
+    MD5Init(&ctx);
+    MD5Update(&ctx, data, len);
+    MD5Final(digest, &ctx);
+    char hex[33];
+    for (int i = 0; i < 16; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", digest[i]);
+    }
+    return hex;
+}
+
+// Flash của target = ảnh, trừ các sector trong s_dirty (dirty = false -> khớp hoàn toàn)
+static void load_flash(fake_target_t* target, bool dirty)
+{
+    std::vector<uint8_t> flash = s_image;
+    flash.resize(41 * SECTOR_MAP_SECTOR_SIZE, 0xFF);
+    if (dirty) {
+        for (uint32_t sector : s_dirty) {
+            flash[sector * SECTOR_MAP_SECTOR_SIZE + 50] ^= 0x5A;
+        }
+    }
+    fake_target_flash_write(target, IMAGE_OFFSET, flash.data(), flash.size());
+}
+
+static bool connect(fake_target_t* target)
+{
+    loader_linux_config_t config = { .device = fake_target_port(target), .baudrate = 115200 };
+    if (loader_port_linux_init(&config) != ESP_LOADER_SUCCESS) {
+        return false;
+    }
+    esp_loader_connect_args_t connect_config = ESP_LOADER_CONNECT_DEFAULT();
+    sector_map_reset_caps();
+    return esp_loader_connect(&connect_config) == ESP_LOADER_SUCCESS;
+}
+
+static esp_err_t diff(const char* image_md5, std::vector<bool>& changed)
+{
+    sd_raw_file_t file = {};
+    file.size = s_image.size();
+    return sector_map_diff(file, 0, file.size, IMAGE_OFFSET, NULL, image_md5, changed);
+}
+
+static uint32_t count_changed(const std::vector<bool>& changed)
+{
+    uint32_t n = 0;
+    for (bool c : changed) n += c ? 1 : 0;
+    return n;
+}
+
+static bool test_stub_map(void)
+{
+    fake_target_t* target = fake_target_start({ .sector_map = true, .corrupt_writes = false });
+    CHECK(target);
+    CHECK(connect(target));
+    load_flash(target, true);
+
+    std::vector<bool> changed;
+    CHECK(diff(NULL, changed) == ESP_OK);
+    CHECK(changed.size() == 41);
+    CHECK(count_changed(changed) == 3);
+    for (uint32_t sector : s_dirty) CHECK(changed[sector]);
+    fake_target_stats_t stats = fake_target_stats(target);
+    CHECK(stats.map_cmds == 1);
+    CHECK(stats.md5_cmds == 0);
+
+    loader_port_linux_deinit();
+    fake_target_stop(target);
+    return true;
+}
+
+static bool test_rom_fallback(void)
+{
+    fake_target_t* target = fake_target_start({ .sector_map = false, .corrupt_writes = false });
+    CHECK(target);
+    CHECK(connect(target));
+    const std::string image_md5 = md5_hex(s_image.data(), s_image.size());
+
+    // Ảnh khác ở 3 sector: dò tính năng (bị từ chối) rồi MD5 cả ảnh + chia đôi
+    load_flash(target, true);
+    const uint32_t invalid = fake_target_stats(target).invalid_cmds; // GET_SECURITY_INFO lúc connect
+    std::vector<bool> changed;
+    CHECK(diff(image_md5.c_str(), changed) == ESP_OK);
+    for (uint32_t sector : s_dirty) CHECK(changed[sector]);
+    fake_target_stats_t stats = fake_target_stats(target);
+    printf("rom fallback: %u/41 sectors flagged, %u MD5 command(s)\n", count_changed(changed), stats.md5_cmds);
+    CHECK(stats.map_cmds == 1);
+    CHECK(stats.invalid_cmds == invalid + 1);
+    CHECK(stats.md5_cmds <= 16);
+    CHECK(count_changed(changed) <= 10);
+
+    // Đã biết không hỗ trợ: không gửi lại SECTOR_MAP_CMD. Không có MD5 ảnh -> băm cả vùng từ file
+    CHECK(diff(NULL, changed) == ESP_OK);
+    for (uint32_t sector : s_dirty) CHECK(changed[sector]);
+    CHECK(fake_target_stats(target).map_cmds == 1);
+
+    // Ảnh không đổi: 1 lệnh MD5 là đủ
+    load_flash(target, false);
+    uint32_t before = fake_target_stats(target).md5_cmds;
+    CHECK(diff(image_md5.c_str(), changed) == ESP_OK);
+    CHECK(count_changed(changed) == 0);
+    CHECK(fake_target_stats(target).md5_cmds == before + 1);
+
+    before = fake_target_stats(target).md5_cmds;
+    CHECK(diff(NULL, changed) == ESP_OK);
+    CHECK(count_changed(changed) == 0);
+    CHECK(fake_target_stats(target).md5_cmds == before + 1);
+    CHECK(fake_target_stats(target).map_cmds == 1);
+
+    loader_port_linux_deinit();
+    fake_target_stop(target);
+    return true;
+}
+
+int main(void)
+{
+    srand(4321);
+    s_image.resize(IMAGE_SIZE);
+    for (uint8_t& b : s_image) b = (uint8_t) rand();
+
+    bool ok = test_stub_map();
+    ok = test_rom_fallback() && ok;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,9 @@
+// Shim host cho test: chỉ đủ kiểu để include main/sd_card/sd_raw.h
+#pragma once
+
+namespace fs {
+class File {};
+class FS {};
+}
+
+using fs::File;
@@ -0,0 +1,12 @@
+// Shim host cho test: heap_caps_malloc -> malloc
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+static inline void* heap_caps_malloc(size_t size, unsigned caps)
+{
+    return malloc(size);
+}
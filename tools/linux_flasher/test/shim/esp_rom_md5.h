@@ -0,0 +1,23 @@
+// Shim host cho test: MD5 của ROM -> md5_hash.c của esp-serial-flasher
+#pragma once
+
+#include "md5_hash.h"
+
+#define ESP_ROM_MD5_DIGEST_LEN 16
+
+typedef struct MD5Context md5_context_t;
+
+static inline void esp_rom_md5_init(md5_context_t* ctx)
+{
+    MD5Init(ctx);
+}
+
+static inline void esp_rom_md5_update(md5_context_t* ctx, const void* buf, uint32_t len)
+{
+    MD5Update(ctx, (const unsigned char*) buf, len);
+}
+
+static inline void esp_rom_md5_final(uint8_t* digest, md5_context_t* ctx)
+{
+    MD5Final(digest, ctx);
+}